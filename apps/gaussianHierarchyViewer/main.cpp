@@ -16,14 +16,39 @@
 #include <core/view/MultiViewManager.hpp>
 #include <core/system/String.hpp>
 #include "projects/hierarchyviewer/renderer/HierarchyView.hpp" 
+#include "projects/hierarchyviewer/renderer/PoseMessage.hpp"
+#include "projects/hierarchyviewer/renderer/PoseMailbox.hpp"
+#include "projects/hierarchyviewer/renderer/PoseTelemetry.hpp"
+#include "projects/hierarchyviewer/renderer/PosePredictor.hpp"
+#include "projects/hierarchyviewer/renderer/SpscQueue.hpp"
+#include "projects/hierarchyviewer/renderer/FrameEncoder.hpp"
+#include "projects/hierarchyviewer/renderer/PoseChannel.hpp"
+#include "projects/hierarchyviewer/renderer/LatencyTrace.hpp"
 
 #include <core/renderer/DepthRenderer.hpp>
 #include <core/raycaster/Raycaster.hpp>
 #include <core/view/SceneDebugView.hpp>
+#include <core/assets/CameraRecorder.hpp>
+#include <core/system/Utils.hpp>
 
 #include <asio.hpp>
-#include <nlohmann/json.hpp>
 #include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <csignal>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <cerrno>
+#endif
 
 #define PROGRAM_NAME "sibr_3Dhierarchy"
 using namespace sibr;
@@ -33,87 +58,519 @@ const char* usage = ""
 ;
 
 using asio::ip::udp;
-using json = nlohmann::json;
 
-// Struct to hold camera transform data
-struct CameraTransform {
-	sibr::Vector3f position;
-	sibr::Quaternionf rotation;
-};
+// Newest pose from the UDP thread, read by the render loop without blocking either side
+sibr::PoseMailbox poseMailbox;
+sibr::PoseTelemetry poseTelemetry;
 
-// Shared variable to store camera transform
-std::shared_ptr<CameraTransform> cameraTransform = nullptr;
-std::mutex cameraTransformMutex;
+// Render thread side of the pose channel
+sibr::PosePredictor posePredictor;
+sibr::PoseSample latestPose;
+uint64_t latestPoseApplied = 0;
+sibr::LatencyTrace latencyTrace;
 
 std::atomic<bool> _running {false};
-std::atomic<bool> _newData {false};
 
 // Function to update the absolute camera transform
-void updateCameraTransform(const sibr::Vector3f& transform, const sibr::Quaternionf& rotation) {
-	std::cout << "in updateCameraTransform" << std::endl;
-	std::lock_guard<std::mutex> lock(cameraTransformMutex);
-	if (!cameraTransform) {
-		cameraTransform = std::make_shared<CameraTransform>();
-	}
-	cameraTransform->position = transform;
-	cameraTransform->rotation = rotation;
+void updateCameraTransform(const sibr::PoseMessage& pose) {
+	poseMailbox.publish(pose);
 }
 
-// Function to translate the camera transform
-void translateCamera(const sibr::Vector3f& translation, const sibr::Quaternionf& rotation) {
-	std::cout << "in translateCamera" << std::endl;
-	std::lock_guard<std::mutex> lock(cameraTransformMutex);
-	if (!cameraTransform) {
-		cameraTransform = std::make_shared<CameraTransform>();
-	}
-	cameraTransform->position += translation;
-	cameraTransform->rotation = rotation;
+// Lockstep requests, rendered one by one in arrival order. A single pose is a request for one camera.
+struct LockstepRequest {
+    sibr::SensorRequest rig;
+    udp::endpoint sender;
+};
+
+constexpr size_t kMaxLockstepDepth = 64;
+sibr::SpscQueue<LockstepRequest, kMaxLockstepDepth> lockstepQueue;
+// Wakes the render loop up when requests are queued.
+std::mutex lockstepMutex;
+std::condition_variable lockstepQueued;
+bool lockstepEnabled = false;
+size_t lockstepDepth = 4;
+int maxSensors = 1;
+static_assert(sibr::kMaxSensors <= HierarchyView::kMaxSensors, "requests can carry more sensors than a view renders");
+
+// Socket poses are received on. Replies are sent from it too, so that they come from the port requests go to.
+asio::io_context poseContext;
+std::unique_ptr<udp::socket> poseSocket;
+std::mutex poseSocketMutex;
+
+// Nothing to answer without a socket (shared memory input) or a sender.
+void replyFrame(udp::socket* socket, const udp::endpoint& to, const sibr::FrameResponse& response) {
+    if (!socket || to.port() == 0)
+        return;
+    char packet[sibr::kFrameResponseSize];
+    sibr::encodeFrameResponse(response, packet);
+    asio::error_code error;
+    // Dropped replies come from the receive thread, the others from the render loop.
+    std::lock_guard<std::mutex> lock(poseSocketMutex);
+    socket->send_to(asio::buffer(packet), to, 0, error);
+}
+
+// Queue every valid request of the batch, reply right away to those that do not fit.
+void queueLockstepRequests(udp::socket* socket, const char* const* data, const size_t* lengths, const udp::endpoint* senders, int count) {
+    bool queued = false;
+    for (int i = 0; i < count; i++) {
+        LockstepRequest request;
+        sibr::PoseMessage pose;
+        bool valid;
+        if (lengths[i] > 0 && (uint8_t)data[i][0] == sibr::kSensorRequestMagic) {
+            valid = sibr::parseSensorRequest(data[i], lengths[i], request.rig);
+        }
+        else {
+            valid = sibr::parsePose(data[i], lengths[i], pose);
+            request.rig = sibr::sensorRequestOf(pose);
+        }
+        if (!valid || request.rig.frameId < 0 || request.rig.count > maxSensors) {
+            poseTelemetry.rejected();
+            continue;
+        }
+        request.rig.receivedAt = sibr::PoseTelemetry::now();
+        request.sender = senders[i];
+        poseTelemetry.received(request.rig.receivedAt);
+
+        if (!lockstepQueue.push(request, lockstepDepth)) {
+            sibr::FrameResponse response;
+            response.status = sibr::FrameResponse::Dropped;
+            response.frameId = request.rig.frameId;
+            replyFrame(socket, request.sender, response);
+        }
+        else {
+            queued = true;
+        }
+    }
+    if (queued) {
+        // Taking the lock orders the push before the wait predicate of the render loop.
+        { std::lock_guard<std::mutex> lock(lockstepMutex); }
+        lockstepQueued.notify_one();
+    }
+}
+
+// Apply the newest pose of a batch of datagrams, the others are superseded.
+void handlePoseBatch(udp::socket* socket, const char* const* data, const size_t* lengths, const udp::endpoint* senders, int count) {
+    if (lockstepEnabled) {
+        queueLockstepRequests(socket, data, lengths, senders, count);
+        return;
+    }
+
+    sibr::PoseMessage pose;
+    int rejected = 0;
+    int chosen = sibr::parseNewestPose(data, lengths, count, pose, rejected);
+    if (rejected)
+        poseTelemetry.rejected(rejected);
+    if (chosen < 0)
+        return;
+
+    pose.receivedAt = sibr::PoseTelemetry::now();
+    poseTelemetry.received(pose.receivedAt);
+    poseTelemetry.superseded(count - 1 - rejected);
+    if (poseTelemetry.logDue(pose.receivedAt)) {
+        std::cout << "[pose] seq " << pose.sequence << " position " << pose.position[0] << " " << pose.position[1] << " " << pose.position[2]
+            << " rotation " << pose.rotation[0] << " " << pose.rotation[1] << " " << pose.rotation[2] << " " << pose.rotation[3]
+            << " batch " << count << std::endl;
+    }
+
+    // Absolute position update
+    updateCameraTransform(pose);
 }
 
 void runUDPServer(std::atomic<bool>& _running) {
     try {
-        asio::io_context io_context;
-        udp::socket socket(io_context, udp::endpoint(udp::v4(), 4444));
+        udp::socket& socket = *poseSocket;
 
         std::cout << "UDP Server started. Waiting for messages..." << std::endl;
 
-        char data[1024];
-        udp::endpoint sender_endpoint;
+        // Every wakeup drains all pending datagrams, only the newest pose matters.
+        static char buffers[sibr::kMaxPoseBatch][sibr::kMaxPoseMessage];
+        const char* data[sibr::kMaxPoseBatch];
+        size_t lengths[sibr::kMaxPoseBatch];
+        udp::endpoint senders[sibr::kMaxPoseBatch];
+        for (int i = 0; i < sibr::kMaxPoseBatch; i++)
+            data[i] = buffers[i];
+
+#ifdef __linux__
+        mmsghdr msgs[sibr::kMaxPoseBatch];
+        iovec iovs[sibr::kMaxPoseBatch];
+        sockaddr_storage addresses[sibr::kMaxPoseBatch];
+        std::memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < sibr::kMaxPoseBatch; i++) {
+            iovs[i].iov_base = buffers[i];
+            iovs[i].iov_len = sibr::kMaxPoseMessage;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &addresses[i];
+        }
+        const int fd = socket.native_handle();
+
+        // The timeout only bounds how long shutdown takes.
+        timeval timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 100000;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
 
         while (_running) {
-            asio::error_code error;
-            size_t length = socket.receive_from(asio::buffer(data), sender_endpoint, 0, error);
-
-            if (!error && length > 0) {
-                std::string jsonStr(data, length);
-                std::cout << "Received JSON: " << jsonStr << std::endl;
-
-                // Parse JSON
-                json jsonData = json::parse(jsonStr);
-
-                // Absolute position update
-                sibr::Vector3f position(
-                    jsonData["position"]["x"],
-                    jsonData["position"]["y"],
-                    jsonData["position"]["z"]
-                );
-                sibr::Quaternionf rotation(
-                    jsonData["rotation"]["w"],
-                    jsonData["rotation"]["x"],
-                    jsonData["rotation"]["y"],
-                    jsonData["rotation"]["z"]
-                );
-
-                updateCameraTransform(position, rotation);
-
-                _newData = true;
-            } else if (error) {
-                std::cerr << "Error receiving data: " << error.message() << std::endl;
+            // Block for the first datagram, then take whatever else is queued.
+            for (int i = 0; i < sibr::kMaxPoseBatch; i++)
+                msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+            int count = recvmmsg(fd, msgs, sibr::kMaxPoseBatch, MSG_WAITFORONE, nullptr);
+            if (count < 0) {
+                if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)
+                    std::cerr << "Error receiving data: " << std::strerror(errno) << std::endl;
+                continue;
+            }
+            for (int i = 0; i < count; i++) {
+                lengths[i] = msgs[i].msg_len;
+                if (lockstepEnabled) {
+                    std::memcpy(senders[i].data(), &addresses[i], msgs[i].msg_hdr.msg_namelen);
+                    senders[i].resize(msgs[i].msg_hdr.msg_namelen);
+                }
             }
+            handlePoseBatch(&socket, data, lengths, senders, count);
         }
+#else
+        // The timeout only bounds how long shutdown takes. A blocking asio receive would
+        // wait in poll() without it, so datagrams are read from the native handle.
+        const auto fd = socket.native_handle();
+#ifdef _WIN32
+        DWORD timeout = 100;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+#else
+        timeval timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 100000;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#endif
+
+        auto receive = [&](int i) {
+            sockaddr_storage address;
+            socklen_t addressLength = sizeof(address);
+            const auto received = recvfrom(fd, buffers[i], (int)sibr::kMaxPoseMessage, 0, reinterpret_cast<sockaddr*>(&address), &addressLength);
+            if (received < 0)
+                return false;
+            lengths[i] = (size_t)received;
+            if (lockstepEnabled) {
+                std::memcpy(senders[i].data(), &address, addressLength);
+                senders[i].resize(addressLength);
+            }
+            return true;
+        };
+
+        while (_running) {
+            if (!receive(0)) {
+#ifdef _WIN32
+                const int error = WSAGetLastError();
+                if (error != WSAETIMEDOUT && error != WSAEINTR)
+                    std::cerr << "Error receiving data: " << asio::error_code(error, asio::system_category()).message() << std::endl;
+#else
+                if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)
+                    std::cerr << "Error receiving data: " << std::strerror(errno) << std::endl;
+#endif
+                continue;
+            }
+            int count = 1;
+            asio::error_code error;
+            while (count < sibr::kMaxPoseBatch && socket.available(error) > 0 && !error && receive(count))
+                count++;
+            handlePoseBatch(&socket, data, lengths, senders, count);
+        }
+#endif
+    } catch (std::exception& e) {
+        std::cerr << "UDP Server error: " << e.what() << std::endl;
+    }
+}
+
+// Read poses from a shared memory slot instead of the socket, same handling as a batch of one datagram.
+void runShmServer(std::atomic<bool>& _running, std::string name, bool spin) {
+    sibr::PoseChannel channel;
+    if (!channel.create(name)) {
+        std::cerr << "Could not create the shared memory pose channel " << name << std::endl;
+        return;
+    }
+    std::cout << "Shared memory pose channel " << name << " ready. Waiting for poses..." << std::endl;
+
+    static char buffer[sibr::kPoseChannelCapacity];
+    const char* data[1] = { buffer };
+    size_t lengths[1];
+    udp::endpoint senders[1];
+    uint64_t overwritten = 0;
+    while (_running) {
+        // The timeout only bounds how long shutdown takes.
+        if (!channel.wait(buffer, lengths[0], 100000, spin))
+            continue;
+        poseTelemetry.superseded(channel.overwritten() - overwritten);
+        overwritten = channel.overwritten();
+        handlePoseBatch(nullptr, data, lengths, senders, 1);
+    }
+}
+
+// Start the pose receiver, the shared memory channel if one is named, else the UDP socket.
+std::thread startPoseInput(const std::string& shmName, bool spin) {
+    _running = true;
+    if (shmName != "")
+        return std::thread(runShmServer, std::ref(_running), shmName, spin);
+    try {
+        poseSocket.reset(new udp::socket(poseContext, udp::endpoint(udp::v4(), 4444)));
     } catch (std::exception& e) {
         std::cerr << "UDP Server error: " << e.what() << std::endl;
+        return std::thread();
     }
+    return std::thread(runUDPServer, std::ref(_running));
+}
+
+// Pose for a frame expected on screen at displayTime: the newest received one, extrapolated if predict is set.
+// Returns false if the camera should be left as is.
+bool framePose(bool predict, uint64_t displayTime, sibr::Vector3f& position, sibr::Quaternionf& rotation) {
+	const bool fresh = poseMailbox.fetch(latestPose);
+	if (fresh) {
+		latestPoseApplied = sibr::PoseTelemetry::now();
+		poseTelemetry.applied(latestPose, latestPoseApplied);
+		posePredictor.observe(latestPose.pose);
+	}
+
+	if (predict) {
+		Eigen::Vector3f p;
+		Eigen::Quaternionf q;
+		if (!posePredictor.predict(displayTime, p, q))
+			return false;
+		position = p;
+		rotation = q;
+		return true;
+	}
+
+	if (fresh) {
+		position = sibr::Vector3f(latestPose.pose.position[0], latestPose.pose.position[1], latestPose.pose.position[2]);
+		rotation = sibr::Quaternionf(latestPose.pose.rotation[0], latestPose.pose.rotation[1], latestPose.pose.rotation[2], latestPose.pose.rotation[3]);
+	}
+	return fresh;
+}
+
+// Identify frames rendered from pose.
+sibr::FrameTag poseTag(const sibr::PoseMessage& pose) {
+	sibr::FrameTag tag;
+	tag.poseSequence = pose.sequence;
+	tag.frameId = pose.frameId;
+	tag.poseTimestamp = pose.timestamp;
+	tag.receivedAt = pose.receivedAt;
+	tag.appliedAt = latestPoseApplied;
+	return tag;
+}
+
+sibr::FrameTag poseTag(const sibr::SensorRequest& rig) {
+	sibr::FrameTag tag;
+	tag.poseSequence = rig.sequence;
+	tag.frameId = rig.frameId;
+	tag.poseTimestamp = rig.timestamp;
+	tag.receivedAt = rig.receivedAt;
+	tag.appliedAt = sibr::PoseTelemetry::now();
+	return tag;
+}
+
+// Trace the pose of the frame just presented, only the first frame using a pose counts.
+void tracePresented(const sibr::LatencyStamps& frame) {
+	sibr::LatencyStamps stamps = frame;
+	stamps.presented = sibr::PoseTelemetry::now();
+	latencyTrace.record(stamps);
+}
+
+// Write the latency histograms next to the per-pose CSV, foo.csv gives foo_histograms.csv.
+void writeLatencyHistograms(const std::string& csvPath) {
+	if (csvPath == "" || latencyTrace.samples() == 0)
+		return;
+	const size_t dot = csvPath.find_last_of('.');
+	const std::string stem = (dot == std::string::npos || csvPath.find_first_of("/\\", dot) != std::string::npos) ? csvPath : csvPath.substr(0, dot);
+	std::ofstream out(stem + "_histograms.csv");
+	latencyTrace.writeHistograms(out);
+}
+
+// Set the cameras of a rig, eyes holds the default intrinsics and at least rig.count cameras.
+void applyRig(sibr::Camera* eyes, const sibr::Camera& base, const sibr::SensorRequest& rig) {
+	for (int k = 0; k < rig.count; k++) {
+		const sibr::SensorPose& sensor = rig.sensors[k];
+		sibr::Camera& eye = eyes[k];
+		eye = base;
+		eye.position(sibr::Vector3f(sensor.position[0], sensor.position[1], sensor.position[2]));
+		eye.rotation(sibr::Quaternionf(sensor.rotation[0], sensor.rotation[1], sensor.rotation[2], sensor.rotation[3]));
+		if (sensor.fovy > 0.0f)
+			eye.fovy(sensor.fovy);
+	}
+}
+
+// Running average of the time from frame start to scan-out, the prediction target.
+struct FrameClock {
+	uint64_t start = 0;
+	double frameTime = 0.0;
+	uint64_t displayLatency = 0;
+
+	uint64_t begin() {
+		start = sibr::PoseTelemetry::now();
+		return start + uint64_t(frameTime) + displayLatency;
+	}
+
+	void end() {
+		const double elapsed = double(sibr::PoseTelemetry::now() - start);
+		frameTime = frameTime == 0.0 ? elapsed : 0.9 * frameTime + 0.1 * elapsed;
+	}
+};
+
+std::atomic<bool> _interrupted {false};
+
+// Render without window: follow the path file if given, else the UDP pose (or the first input camera).
+int runHeadless(GaussianAppArgs& myArgs, BasicIBRScene::Ptr scene, HierarchyView::Ptr view, const Vector2u& resolution) {
+	std::vector<sibr::Camera> path;
+	if (myArgs.pathFile.get() != "") {
+		sibr::CameraRecorder recorder;
+		recorder.loadPath(myArgs.pathFile.get(), resolution.x(), resolution.y());
+		path = recorder.cameras();
+	}
+
+	sibr::Camera eye(*scene->cameras()->inputCameras()[0]);
+	eye.aspect(resolution.x() / float(resolution.y()));
+
+	// Frames are encoded and written on worker threads. Paths are offline recordings and
+	// wait for the encoder, live poses drop frames rather than stall the renderer.
+	const std::string outDir = myArgs.outPath.get();
+	std::unique_ptr<sibr::FrameEncoder> encoder;
+	if (outDir != "") {
+		sibr::makeDirectory(outDir);
+
+		sibr::FrameEncoder::Options options;
+		if (!sibr::FrameEncoder::parseCodec(myArgs.encode.get(), options.codec) || !sibr::FrameEncoder::supported(options.codec)) {
+			SIBR_WRG << "Codec " << myArgs.encode.get() << " not available, writing png" << std::endl;
+			options.codec = sibr::FrameCodec::PNG;
+		}
+		options.workers = myArgs.encodeWorkers;
+		options.queueDepth = myArgs.encodeQueue;
+		options.quality = myArgs.encodeQuality;
+		options.block = myArgs.encodeBlock || !path.empty();
+
+		const bool multiSensor = myArgs.lockstep && myArgs.sensors > 1;
+		const std::string extension = sibr::FrameEncoder::extension(options.codec);
+		encoder.reset(new sibr::FrameEncoder(resolution.x(), resolution.y(), options, [outDir, multiSensor, extension](const sibr::EncodedFrame& frame) {
+			std::ostringstream name;
+			name << outDir << "/" << std::setw(8) << std::setfill('0') << frame.index;
+			if (multiSensor)
+				name << "_" << frame.tag.sensor;
+			name << "." << extension;
+			std::ofstream file(name.str(), std::ios::binary);
+			file.write((const char*)frame.data, frame.size);
+		}));
+	}
+
+	// Lockstep renders queued requests in order; the maintenance step for the next one overlaps with the current.
+	const bool poseInput = (myArgs.tcpEnabled || myArgs.poseShm.get() != "") && path.empty();
+	const bool lockstep = myArgs.lockstep && poseInput;
+	lockstepEnabled = lockstep;
+	lockstepDepth = size_t(std::min(std::max(1, myArgs.lockstepDepth.get()), int(kMaxLockstepDepth)));
+	view->setLockstep(lockstep);
+	maxSensors = std::min(std::max(1, myArgs.sensors.get()), sibr::kMaxSensors);
+	LockstepRequest request;
+	std::vector<sibr::Camera> sensors(sibr::kMaxSensors, eye);
+	std::vector<sibr::Camera> lookahead(sibr::kMaxSensors, eye);
+
+	std::thread udpServerThread;
+	if (poseInput)
+		udpServerThread = startPoseInput(myArgs.poseShm.get(), myArgs.poseShmSpin);
+
+	std::signal(SIGINT, [](int) { _interrupted = true; });
+	std::signal(SIGTERM, [](int) { _interrupted = true; });
+
+	const size_t maxFrames = path.empty() ? size_t(std::max(0, myArgs.headlessFrames.get())) : path.size();
+	const auto interval = std::chrono::seconds(std::max(1, myArgs.statsInterval.get()));
+	auto periodStart = std::chrono::steady_clock::now();
+	size_t periodFrames = 0;
+	size_t frameId = 0;
+	sibr::Vector3f posePosition;
+	sibr::Quaternionf poseRotation;
+	FrameClock frameClock;
+	frameClock.displayLatency = uint64_t(std::max(0.0f, myArgs.displayLatency.get()) * 1000.0f);
+
+	while (!_interrupted && (maxFrames == 0 || frameId < maxFrames)) {
+		const uint64_t displayTime = frameClock.begin();
+		sibr::FrameTag tag;
+		if (!path.empty()) {
+			eye = path[frameId];
+			tag.frameId = int64_t(frameId);
+		}
+		else if (lockstep) {
+			if (!lockstepQueue.pop(request)) {
+				// The timeout only bounds how long an interrupt takes to be noticed.
+				std::unique_lock<std::mutex> lock(lockstepMutex);
+				lockstepQueued.wait_for(lock, std::chrono::milliseconds(100), [] { return lockstepQueue.front() != nullptr; });
+				continue;
+			}
+			applyRig(sensors.data(), eye, request.rig);
+			if (const LockstepRequest* next = lockstepQueue.front()) {
+				applyRig(lookahead.data(), eye, next->rig);
+				view->setLookahead(lookahead.data(), next->rig.count);
+			}
+			else {
+				view->setLookahead(nullptr);
+			}
+			tag = poseTag(request.rig);
+		}
+		else {
+			if (framePose(myArgs.predictPoses, displayTime, posePosition, poseRotation)) {
+				eye.position(posePosition);
+				eye.rotation(poseRotation);
+			}
+			if (latestPose.pose.hasGaze)
+				view->setFoveaFocus(latestPose.pose.gaze[0], latestPose.pose.gaze[1]);
+			tag = poseTag(latestPose.pose);
+		}
+		view->setFrameTag(tag);
+
+		// Every camera of a rig is a frame of its own in the ring, the reply names the last one.
+		const int views = lockstep ? request.rig.count : 1;
+		const std::vector<float>& image = lockstep ? view->renderSensors(sensors.data(), views) : view->renderOffscreen(eye);
+		tracePresented(view->frameStamps());
+		if (lockstep) {
+			sibr::FrameResponse response;
+			response.frameId = request.rig.frameId;
+			response.ringFrame = view->publishedFrame();
+			response.renderedAt = sibr::PoseTelemetry::now();
+			replyFrame(poseSocket.get(), request.sender, response);
+		}
+		if (encoder) {
+			const size_t pixels = size_t(resolution.x()) * resolution.y() * 3;
+			for (int k = 0; k < views; k++) {
+				tag.sensor = uint32_t(k);
+				encoder->submit(image.data() + k * pixels, tag, lockstep ? uint64_t(request.rig.frameId) : uint64_t(frameId));
+			}
+		}
+
+		frameClock.end();
+		frameId++;
+		periodFrames++;
+		const auto now = std::chrono::steady_clock::now();
+		if (now - periodStart >= interval) {
+			const double seconds = std::chrono::duration<double>(now - periodStart).count();
+			std::cout << "[headless] frame " << frameId << ", " << std::fixed << std::setprecision(1) << periodFrames / seconds << " fps";
+			if (encoder)
+				std::cout << ", " << encoder->encoded() << " encoded (" << encoder->encodedBytes() / (1024 * 1024) << " MiB), " << encoder->dropped() << " dropped";
+			std::cout << std::endl;
+			if (udpServerThread.joinable()) {
+				poseTelemetry.report(std::cout);
+				latencyTrace.report(std::cout);
+			}
+			periodStart = now;
+			periodFrames = 0;
+		}
+	}
+
+	if (udpServerThread.joinable()) {
+		_running = false;
+		udpServerThread.join();
+	}
+
+	if (encoder) {
+		encoder->flush();
+		std::cout << "[headless] " << encoder->encoded() << " frames written, " << encoder->dropped() << " dropped by the encoder" << std::endl;
+	}
+	writeLatencyHistograms(myArgs.latencyCsv);
+
+	return EXIT_SUCCESS;
 }
 
 int main(int ac, char** av) {
@@ -123,6 +580,12 @@ int main(int ac, char** av) {
 	GaussianAppArgs myArgs;
 	myArgs.displayHelpIfRequired();
 
+	// The shared memory slot keeps only the newest packet, queued requests would be lost without a reply.
+	if (myArgs.lockstep && myArgs.poseShm.get() != "") {
+		std::cerr << "--lockstep needs the UDP pose input, it cannot be used with --pose-shm" << std::endl;
+		return EXIT_FAILURE;
+	}
+
 	//const bool doVSync = !myArgs.vsync;
 	myArgs.vsync = false;
 	// rendering size
@@ -136,15 +599,19 @@ int main(int ac, char** av) {
 	const char* toload = myArgs.modelPath.get().c_str();
 	const char* scaffold = myArgs.scaffoldPath.get().c_str();
 
-	bool udpEnabled = myArgs.tcpEnabled;
+	bool udpEnabled = myArgs.tcpEnabled || myArgs.poseShm.get() != "";
+	poseTelemetry.debugLog = myArgs.poseLog;
+	const bool headless = myArgs.headless;
 
-	// Window setup
-	sibr::Window		window(PROGRAM_NAME, sibr::Vector2i(50, 50), myArgs, getResourcesDirectory() + "/hierarchy/" + PROGRAM_NAME + ".ini");
+	// Window setup, headless runs create no window and no GL context.
+	std::unique_ptr<sibr::Window> window;
+	if (!headless)
+		window.reset(new sibr::Window(PROGRAM_NAME, sibr::Vector2i(50, 50), myArgs, getResourcesDirectory() + "/hierarchy/" + PROGRAM_NAME + ".ini"));
 
 	sibr::BasicIBRScene::SceneOptions opts;
 	opts.cameras = true;
 	opts.images = false;
-	opts.mesh = true;
+	opts.mesh = !headless;
 	opts.renderTargets = false;
 	opts.texture = false;
 
@@ -180,7 +647,39 @@ int main(int ac, char** av) {
 	const unsigned int sceneResWidth = usedResolution.x();
 	const unsigned int sceneResHeight = usedResolution.y();
 
-	HierarchyView::Ptr	pointBasedView(new HierarchyView(scene, sceneResWidth, sceneResHeight, toload, scaffold, myArgs.budget.get()));
+	sibr::DisplayFormat displayFormat = sibr::DisplayFormat::Float;
+	if (!sibr::parseDisplayFormat(myArgs.displayFormat.get(), displayFormat))
+		SIBR_WRG << "Unknown display format " << myArgs.displayFormat.get() << ", using float" << std::endl;
+
+	HierarchyView::Ptr	pointBasedView(new HierarchyView(scene, sceneResWidth, sceneResHeight, toload, scaffold, myArgs.budget.get(), myArgs.cpuCut || myArgs.foveation > 0.0f || (headless && myArgs.lockstep && myArgs.sensors > 1), myArgs.cpuRaster, headless, displayFormat));
+
+	if (myArgs.foveation > 0.0f)
+		pointBasedView->setFoveation(myArgs.foveation, myArgs.foveaRadius, myArgs.foveaMax);
+
+	if (udpEnabled) {
+		pointBasedView->setPoseTelemetry(&poseTelemetry);
+		pointBasedView->setLatencyTrace(&latencyTrace);
+	}
+	if (myArgs.latencyCsv.get() != "" && !latencyTrace.openCsv(myArgs.latencyCsv.get()))
+		std::cerr << "Could not open the latency trace " << myArgs.latencyCsv.get() << std::endl;
+
+	if (myArgs.frameRing.get() != "") {
+		if (pointBasedView->enableFrameRing(myArgs.frameRing.get(), myArgs.frameRingSlots.get()))
+			std::cout << "Publishing frames to shared memory " << myArgs.frameRing.get() << std::endl;
+		else
+			std::cerr << "Could not create the frame ring " << myArgs.frameRing.get() << std::endl;
+	}
+
+	if (headless)
+		return runHeadless(myArgs, scene, pointBasedView, usedResolution);
+
+	if (myArgs.dynamicResolution > 0.0f) {
+		sibr::UpscaleFilter filter = sibr::UpscaleFilter::Bicubic;
+		if (!sibr::parseUpscaleFilter(myArgs.upscaleFilter.get(), filter))
+			SIBR_WRG << "Unknown upscale filter " << myArgs.upscaleFilter.get() << ", using bicubic" << std::endl;
+		pointBasedView->setDynamicResolution(myArgs.dynamicResolution, myArgs.dynamicMinScale, filter);
+	}
+	pointBasedView->setIdleSkip(myArgs.idleSkip);
 
 	// Raycaster.
 	std::shared_ptr<sibr::Raycaster> raycaster = std::make_shared<sibr::Raycaster>();
@@ -192,10 +691,12 @@ int main(int ac, char** av) {
 	generalCamera->setup(scene->cameras()->inputCameras(), Viewport(0, 0, (float)usedResolution.x(), (float)usedResolution.y()), raycaster, { -1.0f,-1.0f });
 
 	// Add views to mvm.
-	MultiViewManager        multiViewManager(window, false);
+	MultiViewManager        multiViewManager(*window, false);
 
-	if (myArgs.rendering_mode == 1) 
+	if (myArgs.rendering_mode == 1) {
 		multiViewManager.renderingMode(IRenderingMode::Ptr(new StereoAnaglyphRdrMode()));
+		pointBasedView->setStereo(true);
+	}
 	
 	multiViewManager.addIBRSubView("Point view", pointBasedView, usedResolution, ImGuiWindowFlags_ResizeFromAnySide);
 	multiViewManager.addCameraForView("Point view", generalCamera);
@@ -221,43 +722,64 @@ int main(int ac, char** av) {
     if (udpEnabled) {
         std::cout << "UDP Enabled! Starting UDP server..." << std::endl;
         
-		_running = true;
-		udpServerThread = std::thread(runUDPServer, std::ref(_running));
+		udpServerThread = startPoseInput(myArgs.poseShm.get(), myArgs.poseShmSpin);
 
 		// Enable JSON camera mode
 		generalCamera->switchMode(sibr::InteractiveCameraHandler::JSON);
     }
 
+	sibr::Vector3f posePosition;
+	sibr::Quaternionf poseRotation;
+	FrameClock frameClock;
+	frameClock.displayLatency = uint64_t(std::max(0.0f, myArgs.displayLatency.get()) * 1000.0f);
+	const auto statsInterval = std::chrono::seconds(std::max(1, myArgs.statsInterval.get()));
+	auto statsStart = std::chrono::steady_clock::now();
+
 	// Main looooooop.
-	while (window.isOpened()) {
+	while (window->isOpened()) {
 
+		const uint64_t displayTime = frameClock.begin();
 		sibr::Input::poll();
-		window.makeContextCurrent();
+		window->makeContextCurrent();
 		if (sibr::Input::global().key().isPressed(sibr::Key::Escape)) {
-			window.close();
+			window->close();
 		}
 		
 		sibr::Input& input = sibr::Input::global();
 
-		// Check if cameraTransform is available and update the camera
-		if (_newData) {
-			_newData =  false;
-			std::lock_guard<std::mutex> lock(cameraTransformMutex);
-			generalCamera->updateCameraTransform(cameraTransform->position, cameraTransform->rotation);
+		// Apply the newest pose, or its extrapolation to when this frame reaches the screen
+		if (framePose(myArgs.predictPoses, displayTime, posePosition, poseRotation)) {
+			generalCamera->updateCameraTransform(posePosition, poseRotation);
 		}
+		if (latestPose.pose.hasGaze)
+			pointBasedView->setFoveaFocus(latestPose.pose.gaze[0], latestPose.pose.gaze[1]);
+		pointBasedView->setFrameTag(poseTag(latestPose.pose));
 		
+		if ((udpEnabled || myArgs.idleSkip) && std::chrono::steady_clock::now() - statsStart >= statsInterval) {
+			if (udpEnabled) {
+				poseTelemetry.report(std::cout);
+				latencyTrace.report(std::cout);
+			}
+			if (myArgs.idleSkip)
+				pointBasedView->idleSkip().report(std::cout);
+			statsStart = std::chrono::steady_clock::now();
+		}
+
 		multiViewManager.onUpdate(input);
-		multiViewManager.onRender(window);
+		multiViewManager.onRender(*window);
 
-		window.swapBuffer();
+		window->swapBuffer();
+		tracePresented(pointBasedView->frameStamps());
+		frameClock.end();
 		CHECK_GL_ERROR;
 	}
 
 	// Clean up
-    if (udpEnabled) {
+    if (udpServerThread.joinable()) {
         _running = false; // Stop the UDP server
         udpServerThread.join(); // Wait for the UDP server thread to finish
     }
+	writeLatencyHistograms(myArgs.latencyCsv);
 
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "ArenaPlacement.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+namespace sibr {
+
+	ArenaPlacement::ArenaPlacement(size_t capacity, size_t alignment) :
+		_capacity(capacity / alignment * alignment),
+		_alignment(alignment)
+	{
+		if (_capacity > 0)
+			_free[0] = _capacity;
+	}
+
+	size_t ArenaPlacement::place(size_t bytes)
+	{
+		const size_t size = aligned(std::max<size_t>(bytes, 1), _alignment);
+		for (auto it = _free.begin(); it != _free.end(); ++it)
+		{
+			if (it->second < size)
+				continue;
+
+			const size_t offset = it->first;
+			const size_t rest = it->second - size;
+			_free.erase(it);
+			if (rest > 0)
+				_free[offset + size] = rest;
+			_blocks[offset] = size;
+			_used += size;
+			return offset;
+		}
+		return kNoSpace;
+	}
+
+	bool ArenaPlacement::release(size_t offset)
+	{
+		auto block = _blocks.find(offset);
+		if (block == _blocks.end())
+			return false;
+
+		size_t start = offset;
+		size_t size = block->second;
+		_used -= size;
+		_blocks.erase(block);
+
+		// Merge with the free range starting right after and the one ending right before.
+		auto next = _free.find(offset + size);
+		if (next != _free.end())
+		{
+			size += next->second;
+			_free.erase(next);
+		}
+		auto after = _free.lower_bound(start);
+		if (after != _free.begin())
+		{
+			auto prev = std::prev(after);
+			if (prev->first + prev->second == start)
+			{
+				start = prev->first;
+				size += prev->second;
+				_free.erase(prev);
+			}
+		}
+		_free[start] = size;
+		return true;
+	}
+
+	size_t ArenaPlacement::blockSize(size_t offset) const
+	{
+		auto block = _blocks.find(offset);
+		return block == _blocks.end() ? 0 : block->second;
+	}
+
+	size_t ArenaPlacement::largestFree() const
+	{
+		size_t largest = 0;
+		for (const auto& range : _free)
+			largest = std::max(largest, range.second);
+		return largest;
+	}
+
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+
+#pragma once
+
+# include "Config.hpp"
+# include <cstddef>
+# include <cstdint>
+# include <map>
+
+namespace sibr {
+
+	/**
+	 * Placement of blocks in a range of capacity bytes: first fit among the
+	 * free ranges, which are kept sorted by offset and merged with their
+	 * neighbours when a block is released. Only offsets are handled, no
+	 * memory is touched, so it works the same for any kind of memory.
+	 */
+	class SIBR_EXP_ULR_EXPORT ArenaPlacement
+	{
+	public:
+
+		static constexpr size_t kNoSpace = SIZE_MAX;
+
+		explicit ArenaPlacement(size_t capacity = 0, size_t alignment = 256);
+
+		/**
+		 * Place a block, its size rounded up to the alignment.
+		 * \return the offset of the block, kNoSpace if no free range can hold it
+		 */
+		size_t place(size_t bytes);
+
+		/**
+		 * Release the block placed at offset.
+		 * \return false if no block starts there
+		 */
+		bool release(size_t offset);
+
+		/** \return the rounded size of the block placed at offset, 0 if none. */
+		size_t blockSize(size_t offset) const;
+
+		size_t capacity() const { return _capacity; }
+		size_t used() const { return _used; }
+		size_t blocks() const { return _blocks.size(); }
+
+		/** \return the size of the largest free range. */
+		size_t largestFree() const;
+
+		/** \return bytes rounded up to a multiple of alignment. */
+		static size_t aligned(size_t bytes, size_t alignment) { return (bytes + alignment - 1) / alignment * alignment; }
+
+	private:
+
+		size_t _capacity;
+		size_t _alignment;
+		size_t _used = 0;
+		std::map<size_t, size_t> _free;   ///< Offset to size of the free ranges.
+		std::map<size_t, size_t> _blocks; ///< Offset to size of the placed blocks.
+	};
+
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "Compaction.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace sibr {
+namespace Compaction {
+
+	Measure markLive(const Slot* slots, int numSlots, const int* active, int numActive, std::vector<char>& live)
+	{
+		live.assign(numSlots, 0);
+		for (int i = 0; i < numActive; i++)
+		{
+			int s = active[i];
+			while (s >= 0 && s < numSlots && !live[s])
+			{
+				live[s] = 1;
+				s = slots[s].parent;
+			}
+		}
+
+		Measure m;
+		m.usedSlots = numSlots;
+		for (int s = 0; s < numSlots; s++)
+		{
+			m.usedGaussians += slots[s].count;
+			if (live[s])
+			{
+				m.liveSlots++;
+				m.liveGaussians += slots[s].count;
+			}
+		}
+		return m;
+	}
+
+	bool shouldCompact(const Policy& policy, const Measure& measure)
+	{
+		if (measure.usedSlots - measure.liveSlots < policy.minDeadNodes)
+			return false;
+		return measure.fragmentation() >= policy.triggerFragmentation;
+	}
+
+	void Compactor::place(const Slot& s, int oldSlot, std::vector<Run>& runs)
+	{
+		_remap[oldSlot] = _keptSlots++;
+		_dstStart[oldSlot] = _dstGaussians;
+
+		if (s.count > 0)
+		{
+			// Neighbouring nodes are usually neighbours in the payload too, merge them.
+			if (!runs.empty() && runs.back().src + runs.back().count == s.start && runs.back().dst + runs.back().count == _dstGaussians)
+				runs.back().count += s.count;
+			else
+				runs.push_back({ s.start, _dstGaussians, s.count });
+		}
+		_dstGaussians += s.count;
+	}
+
+	Measure Compactor::begin(const Slot* slots, int numSlots, const int* active, int numActive)
+	{
+		Measure m = markLive(slots, numSlots, active, numActive, _plannedLive);
+
+		_running = true;
+		_snapshotSlots = numSlots;
+		_runs.clear();
+		_nextRun = 0;
+		_runOffset = 0;
+		_moved = 0;
+		_keptSlots = 0;
+		_dstGaussians = 0;
+		_remap.assign(numSlots, -1);
+		_dstStart.assign(numSlots, -1);
+
+		for (int s = 0; s < numSlots; s++)
+		{
+			if (_plannedLive[s])
+				place(slots[s], s, _runs);
+		}
+		_planned = _dstGaussians;
+
+		return m;
+	}
+
+	bool Compactor::nextSlice(int maxGaussians, int maxRuns, std::vector<Run>& runs)
+	{
+		runs.clear();
+		int budget = std::max(1, maxGaussians);
+		int maxCount = std::max(1, maxRuns);
+		while (budget > 0 && int(runs.size()) < maxCount && _nextRun < _runs.size())
+		{
+			const Run& r = _runs[_nextRun];
+			int n = std::min(budget, r.count - _runOffset);
+			runs.push_back({ r.src + _runOffset, r.dst + _runOffset, n });
+			_runOffset += n;
+			_moved += n;
+			budget -= n;
+			if (_runOffset == r.count)
+			{
+				_nextRun++;
+				_runOffset = 0;
+			}
+		}
+		return _nextRun < _runs.size();
+	}
+
+	void Compactor::finish(const Slot* slots, int numSlots, const int* active, int numActive, std::vector<Run>& tailRuns)
+	{
+		tailRuns.clear();
+
+		// Whatever was not handed out yet has to be moved now.
+		while (nextSlice(std::numeric_limits<int>::max(), std::numeric_limits<int>::max(), _rest))
+			tailRuns.insert(tailRuns.end(), _rest.begin(), _rest.end());
+		tailRuns.insert(tailRuns.end(), _rest.begin(), _rest.end());
+
+		// Slots appended since begin() are kept as long as their parent is,
+		// slots from the snapshot are kept if planned or live again.
+		markLive(slots, numSlots, active, numActive, _live);
+		_remap.resize(numSlots, -1);
+		_dstStart.resize(numSlots, -1);
+		for (int s = 0; s < numSlots; s++)
+		{
+			if (_remap[s] != -1)
+				continue;
+
+			bool candidate = s >= _snapshotSlots || _live[s];
+			int parent = slots[s].parent;
+			bool parentKept = parent < 0 || _remap[parent] != -1;
+			if (candidate && parentKept)
+				place(slots[s], s, tailRuns);
+		}
+
+		_newSlots.resize(_keptSlots);
+		for (int s = 0; s < numSlots; s++)
+		{
+			int n = _remap[s];
+			if (n == -1)
+				continue;
+
+			Slot slot = slots[s];
+			slot.parent = slot.parent < 0 ? -1 : _remap[slot.parent];
+			slot.start = _dstStart[s];
+			if (slot.start_children >= 0)
+				slot.start_children = slot.start_children < numSlots ? _remap[slot.start_children] : -1;
+			_newSlots[n] = slot;
+		}
+
+		_running = false;
+	}
+
+	void HostStore::copyRuns(const HostStore& src, const std::vector<Run>& runs)
+	{
+		for (const Run& r : runs)
+		{
+			std::memcpy(payload.data() + size_t(r.dst) * stride,
+				src.payload.data() + size_t(r.src) * stride,
+				sizeof(float) * size_t(r.count) * stride);
+		}
+	}
+
+	int HostStore::compactFrom(const HostStore& src, std::vector<int>& active, const Policy& policy)
+	{
+		stride = src.stride;
+		payload.resize(src.payload.size());
+
+		Compactor compactor;
+		compactor.begin(src.slots.data(), int(src.slots.size()), active.data(), int(active.size()));
+
+		int steps = 0;
+		std::vector<Run> runs;
+		bool more = true;
+		while (more)
+		{
+			more = compactor.nextSlice(policy.sliceGaussians, policy.sliceRuns, runs);
+			copyRuns(src, runs);
+			steps++;
+		}
+
+		compactor.finish(src.slots.data(), int(src.slots.size()), active.data(), int(active.size()), runs);
+		copyRuns(src, runs);
+
+		slots = compactor.slots();
+		payload.resize(size_t(compactor.gaussianCount()) * stride);
+		for (int& a : active)
+			a = compactor.remap()[a];
+
+		return steps;
+	}
+
+}
+}
@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+
+#pragma once
+
+# include "Config.hpp"
+# include <vector>
+# include <cstdint>
+# include <cstddef>
+
+struct CUstream_st;
+
+namespace sibr {
+
+	/**
+	 * Incremental compaction of the resident (VRAM) part of the hierarchy.
+	 *
+	 * Resident nodes live in slots that are appended to by the maintenance
+	 * thread. When the cut moves, slots whose nodes are neither active nor
+	 * an ancestor of an active node become dead. Compaction copies the live
+	 * slots to the other MemSet so that the used range becomes dense again.
+	 *
+	 * The Gaussian payload (the bulk of the bytes) is immutable once uploaded,
+	 * so it can be moved in bounded slices over several maintenance steps.
+	 * Node records are small and are rebuilt in one go when the compaction
+	 * finishes, at which point slots appended or revived in the meantime are
+	 * picked up as well.
+	 *
+	 * Everything here runs on the host. The GPU path only executes the
+	 * returned copies with copyRunsDevice; HostStore gives a complete CPU
+	 * reference.
+	 */
+	namespace Compaction {
+
+		/** Host mirror of one resident slot. */
+		struct Slot
+		{
+			int cpu;            ///< Index of the node in the full host hierarchy.
+			int parent;         ///< Slot of the parent, -1 for the root.
+			int start;          ///< First resident Gaussian of this node.
+			int count;          ///< Number of resident Gaussians of this node.
+			int start_children; ///< Slot of the first child, -1 if children are not resident.
+		};
+
+		/** A contiguous run of Gaussians to move from the current to the other store. */
+		struct Run
+		{
+			int src;
+			int dst;
+			int count;
+		};
+
+		/** One payload array of a store, `floats` values per Gaussian. */
+		struct Attribute
+		{
+			const float* src;
+			float* dst;
+			int floats;
+		};
+
+		/** Most attributes copyRunsDevice moves at once. */
+		constexpr int kMaxAttributes = 8;
+
+		/**
+		 * Copy the runs of every attribute with a single kernel.
+		 * \param runs device copy of the runs, sorted by dst and not overlapping
+		 * \param numRuns number of runs
+		 * \param dstBegin dst of the first run
+		 * \param dstEnd end of the last run
+		 * \param attributes arrays to copy, at most kMaxAttributes
+		 * \param numAttributes number of attributes
+		 * \param stream stream the copy is queued on
+		 */
+		SIBR_EXP_ULR_EXPORT void copyRunsDevice(const Run* runs, int numRuns, int dstBegin, int dstEnd,
+			const Attribute* attributes, int numAttributes, CUstream_st* stream);
+
+		/** When and how much to compact. */
+		struct Policy
+		{
+			float triggerFragmentation = 0.2f; ///< Dead fraction of the used Gaussian range that starts a compaction.
+			int minDeadNodes = 10000;          ///< Do not bother below this many dead slots.
+			int sliceGaussians = 500000;       ///< Gaussians moved per maintenance step while compacting.
+			int sliceRuns = 2048;              ///< Copy runs issued per maintenance step while compacting.
+		};
+
+		/** Fragmentation measured from the live set. */
+		struct Measure
+		{
+			int usedSlots = 0;
+			int liveSlots = 0;
+			int usedGaussians = 0;
+			int liveGaussians = 0;
+
+			/** \return the dead fraction of the used Gaussian range. */
+			float fragmentation() const
+			{
+				return usedGaussians > 0 ? 1.0f - float(liveGaussians) / float(usedGaussians) : 0.0f;
+			}
+		};
+
+		/** Flag every slot that is active or an ancestor of an active slot.
+		 * \param slots resident slots
+		 * \param numSlots number of used slots
+		 * \param active active slots
+		 * \param numActive number of active slots
+		 * \param live output flags, resized to numSlots
+		 * \return the fragmentation of the current store
+		 */
+		SIBR_EXP_ULR_EXPORT Measure markLive(const Slot* slots, int numSlots, const int* active, int numActive, std::vector<char>& live);
+
+		/** \return true if the measured store should be compacted under the given policy. */
+		SIBR_EXP_ULR_EXPORT bool shouldCompact(const Policy& policy, const Measure& measure);
+
+		/**
+		 * Plans one compaction and hands out the payload copies in slices.
+		 * Usage: begin(), nextSlice() until it returns false, finish().
+		 */
+		class SIBR_EXP_ULR_EXPORT Compactor
+		{
+		public:
+
+			/** \return true between begin() and finish(). */
+			bool running() const { return _running; }
+
+			/** Snapshot the live set and plan the payload moves.
+			 * \return the fragmentation measured for the snapshot
+			 */
+			Measure begin(const Slot* slots, int numSlots, const int* active, int numActive);
+
+			/** Get the next payload runs, moving at most maxGaussians in at most maxRuns runs.
+			 * Runs are split when they do not fit the Gaussian budget. All runs of a
+			 * compaction are handed out in increasing dst order.
+			 * \param runs output, cleared first
+			 * \return false once all planned runs have been handed out
+			 */
+			bool nextSlice(int maxGaussians, int maxRuns, std::vector<Run>& runs);
+
+			/** Complete the compaction against the current state of the store.
+			 * Slots that were appended or revived since begin() are placed after
+			 * the planned ones and their payload is returned in tailRuns. Planned
+			 * runs that were not handed out yet are appended to tailRuns as well.
+			 * \param slots current resident slots
+			 * \param numSlots current number of used slots
+			 * \param active current active slots
+			 * \param numActive number of current active slots
+			 * \param tailRuns payload still to be moved before the new store is usable
+			 */
+			void finish(const Slot* slots, int numSlots, const int* active, int numActive, std::vector<Run>& tailRuns);
+
+			/** \return old slot to new slot, -1 for dropped slots (valid after finish()). */
+			const std::vector<int>& remap() const { return _remap; }
+
+			/** \return the slot records of the compacted store (valid after finish()). */
+			const std::vector<Slot>& slots() const { return _newSlots; }
+
+			/** \return the Gaussian count of the compacted store (valid after finish()). */
+			int gaussianCount() const { return _dstGaussians; }
+
+			/** \return the number of Gaussians handed out so far in this compaction. */
+			int movedGaussians() const { return _moved; }
+
+			/** \return the number of Gaussians planned at begin(). */
+			int plannedGaussians() const { return _planned; }
+
+		private:
+
+			/** Assign a destination to slot s and queue its payload. */
+			void place(const Slot& s, int oldSlot, std::vector<Run>& runs);
+
+			bool _running = false;
+			int _snapshotSlots = 0;
+			std::vector<char> _plannedLive;
+			std::vector<char> _live;
+			std::vector<Run> _runs;
+			std::vector<Run> _rest;
+			size_t _nextRun = 0;
+			int _runOffset = 0;
+			int _moved = 0;
+			int _planned = 0;
+			int _dstGaussians = 0;
+			int _keptSlots = 0;
+			std::vector<int> _remap;
+			std::vector<int> _dstStart;
+			std::vector<Slot> _newSlots;
+		};
+
+		/**
+		 * CPU reference of the resident store: slot records plus a flat payload
+		 * of `stride` floats per Gaussian. Used to exercise Compactor without a GPU.
+		 */
+		struct SIBR_EXP_ULR_EXPORT HostStore
+		{
+			int stride = 1;
+			std::vector<Slot> slots;
+			std::vector<float> payload;
+
+			/** Copy the runs' payload from src into this store. */
+			void copyRuns(const HostStore& src, const std::vector<Run>& runs);
+
+			/** Run a full compaction from src into this store, slicing as the policy says.
+			 * \param active active slots of src, remapped in place
+			 * \return the number of slices it took
+			 */
+			int compactFrom(const HostStore& src, std::vector<int>& active, const Policy& policy);
+		};
+	}
+
+}
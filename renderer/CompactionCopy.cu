@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "Compaction.hpp"
+
+#include <cuda_runtime.h>
+#include <algorithm>
+
+namespace sibr {
+namespace Compaction {
+
+	namespace {
+
+		struct Attributes
+		{
+			Attribute attributes[kMaxAttributes];
+			int count;
+		};
+
+		/** Last run starting at or before g. */
+		__device__ int findRun(const Run* __restrict__ runs, int numRuns, int g)
+		{
+			int lo = 0, hi = numRuns - 1;
+			while (lo < hi)
+			{
+				const int mid = (lo + hi + 1) / 2;
+				if (runs[mid].dst <= g)
+					lo = mid;
+				else
+					hi = mid - 1;
+			}
+			return lo;
+		}
+
+		// One thread per copied float, attribute after attribute, so that
+		// neighbouring threads write neighbouring values.
+		__global__ void copyRuns(const Run* __restrict__ runs, int numRuns, int dstBegin, long long span, Attributes attributes, long long total)
+		{
+			for (long long t = blockIdx.x * (long long)blockDim.x + threadIdx.x; t < total; t += (long long)gridDim.x * blockDim.x)
+			{
+				long long local = t;
+				int a = 0;
+				while (local >= span * attributes.attributes[a].floats)
+				{
+					local -= span * attributes.attributes[a].floats;
+					a++;
+				}
+				const Attribute& attribute = attributes.attributes[a];
+				const int g = dstBegin + int(local / attribute.floats);
+				const int j = int(local % attribute.floats);
+
+				const Run& r = runs[findRun(runs, numRuns, g)];
+				if (g >= r.dst + r.count)
+					continue;
+				const long long src = r.src + (g - r.dst);
+				attribute.dst[(long long)g * attribute.floats + j] = attribute.src[src * attribute.floats + j];
+			}
+		}
+
+	}
+
+	void copyRunsDevice(const Run* runs, int numRuns, int dstBegin, int dstEnd, const Attribute* attributes, int numAttributes, CUstream_st* stream)
+	{
+		if (numRuns <= 0 || dstEnd <= dstBegin)
+			return;
+
+		Attributes packed;
+		packed.count = std::min(numAttributes, kMaxAttributes);
+		long long floats = 0;
+		for (int a = 0; a < packed.count; a++)
+		{
+			packed.attributes[a] = attributes[a];
+			floats += attributes[a].floats;
+		}
+
+		const long long span = dstEnd - dstBegin;
+		const long long total = span * floats;
+		const int block = 256;
+		const int grid = (int)std::min<long long>((total + block - 1) / block, 65536);
+		copyRuns<<<grid, block, 0, stream>>>(runs, numRuns, dstBegin, span, packed, total);
+	}
+
+}
+}
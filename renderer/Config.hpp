@@ -56,6 +56,35 @@ namespace sibr {
 		Arg<int> budget = { "budget", 16000, "Hierarchy memory budget (MB)" };
 		Arg<std::string> imagesPath = { "images-path", "", "path to images" };
 		Arg<bool> tcpEnabled = {"tcpEnabled", "Enable camera controls on tcp socket 4444"};
+		Arg<bool> cpuCut = { "cpu-cut", "select the hierarchy cut on the CPU" };
+		Arg<bool> cpuRaster = { "cpu-raster", "render on the CPU, no CUDA device needed" };
+		Arg<std::string> displayFormat = { "display-format", "float", "layout of the display buffer read by the copy pass: float, half or rgba8" };
+		Arg<float> dynamicResolution = { "dynamic-resolution", 0.0f, "target render time in milliseconds, the render resolution drops while it is exceeded (0 disables)" };
+		Arg<float> dynamicMinScale = { "dynamic-min-scale", 0.5f, "lowest per-axis render scale of the dynamic resolution" };
+		Arg<float> foveation = { "foveation", 0.0f, "foveated LOD: growth of the size limit per radian away from the focus point, implies cpu-cut (0 disables)" };
+		Arg<float> foveaRadius = { "fovea-radius", 10.0f, "degrees around the focus point rendered at the full size limit" };
+		Arg<float> foveaMax = { "fovea-max", 8.0f, "coarsest foveated size limit, as a multiple of the full one" };
+		Arg<std::string> upscaleFilter = { "upscale-filter", "bicubic", "filter of the copy pass below full resolution: nearest, bilinear or bicubic" };
+		Arg<bool> idleSkip = { "idle-skip", "show the last image again while the camera, the settings and the cut are unchanged" };
+		Arg<bool> headless = { "headless", "render without window or GL context, frames are written to outPath" };
+		Arg<int> headlessFrames = { "frames", 0, "number of frames to render in headless mode, 0 for no limit" };
+		Arg<int> statsInterval = { "stats-interval", 1, "seconds between two frame rate and pose channel reports" };
+		Arg<bool> poseLog = { "pose-log", "log received poses, at most one line per second" };
+		Arg<std::string> poseShm = { "pose-shm", "", "read poses from this POSIX shared memory slot instead of the UDP socket" };
+		Arg<bool> poseShmSpin = { "pose-shm-spin", "busy-poll the shared memory pose slot instead of sleeping on its futex" };
+		Arg<bool> predictPoses = { "predict-poses", "extrapolate received poses to the expected display time of the frame" };
+		Arg<std::string> frameRing = { "frame-ring", "", "name of a POSIX shared memory ring receiving every rendered frame" };
+		Arg<int> frameRingSlots = { "frame-ring-slots", 4, "number of frames kept in the shared memory ring" };
+		Arg<std::string> encode = { "encode", "png", "headless: format of the frames written to outPath, rgb8, lz4, png or jpeg" };
+		Arg<int> encodeWorkers = { "encode-workers", 2, "threads encoding the written frames" };
+		Arg<int> encodeQueue = { "encode-queue", 8, "frames waiting for the encoder at most, later ones are dropped" };
+		Arg<int> encodeQuality = { "encode-quality", 90, "jpeg quality" };
+		Arg<bool> encodeBlock = { "encode-block", "wait for the encoder instead of dropping frames (always on when rendering a path)" };
+		Arg<bool> lockstep = { "lockstep", "headless: render every pose carrying a frame id, in order, and reply to its sender once done" };
+		Arg<int> lockstepDepth = { "lockstep-depth", 4, "lockstep requests allowed in flight, more are dropped" };
+		Arg<int> sensors = { "sensors", 1, "lockstep: cameras per request at most (up to 8), above 1 the shared cut is selected on the CPU" };
+		Arg<float> displayLatency = { "display-latency", 0.0f, "milliseconds from buffer swap to scan-out, added to the prediction target" };
+		Arg<std::string> latencyCsv = { "latency-csv", "", "write the per-stage latency of every pose to this CSV file, and the histograms next to it on exit" };
 	};
 
 }
@@ -0,0 +1,463 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "CpuRasterizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#define BLOCK_X 16
+#define BLOCK_Y 16
+#define BLOCK_SIZE (BLOCK_X * BLOCK_Y)
+
+namespace CpuRasterizer {
+
+	namespace {
+
+		const float SH_C0 = 0.28209479177387814f;
+		const float SH_C1 = 0.4886025119029199f;
+		const float SH_C2[] = { 1.0925484305920792f, -1.0925484305920792f, 0.31539156525252005f, -1.0925484305920792f, 0.5462742152960396f };
+		const float SH_C3[] = { -0.5900435899266435f, 2.890611442640554f, -0.4570457994644658f, 0.3731763325901154f, -0.4570457994644658f, 1.445305721320277f, -0.5900435899266435f };
+
+		/** Coefficient j of channel c in the hierarchy SH layout. */
+		inline float shCoeff(const float* sh, int j, int c)
+		{
+			return j == 0 ? sh[c] : sh[3 + c * 15 + (j - 1)];
+		}
+
+		void computeColorFromSH(const float* p, const Point& campos, const float* sh, float* rgb)
+		{
+			float x = p[0] - campos.xyz[0];
+			float y = p[1] - campos.xyz[1];
+			float z = p[2] - campos.xyz[2];
+			float len = std::sqrt(x * x + y * y + z * z);
+			if (len > 0.0f)
+			{
+				x /= len; y /= len; z /= len;
+			}
+			float xx = x * x, yy = y * y, zz = z * z;
+			float xy = x * y, yz = y * z, xz = x * z;
+
+			float basis[16] = {
+				SH_C0,
+				-SH_C1 * y, SH_C1 * z, -SH_C1 * x,
+				SH_C2[0] * xy, SH_C2[1] * yz, SH_C2[2] * (2.0f * zz - xx - yy), SH_C2[3] * xz, SH_C2[4] * (xx - yy),
+				SH_C3[0] * y * (3.0f * xx - yy), SH_C3[1] * xy * z, SH_C3[2] * y * (4.0f * zz - xx - yy),
+				SH_C3[3] * z * (2.0f * zz - 3.0f * xx - 3.0f * yy), SH_C3[4] * x * (4.0f * zz - xx - yy),
+				SH_C3[5] * z * (xx - yy), SH_C3[6] * x * (xx - 3.0f * yy)
+			};
+
+			for (int c = 0; c < 3; c++)
+			{
+				float v = 0.5f;
+				for (int j = 0; j < 16; j++)
+					v += basis[j] * shCoeff(sh, j, c);
+				rgb[c] = std::max(v, 0.0f);
+			}
+		}
+
+		inline void transformPoint4x3(const float* m, const float* p, float* out)
+		{
+			out[0] = m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12];
+			out[1] = m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13];
+			out[2] = m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14];
+		}
+
+		inline void transformPoint4x4(const float* m, const float* p, float* out)
+		{
+			transformPoint4x3(m, p, out);
+			out[3] = m[3] * p[0] + m[7] * p[1] + m[11] * p[2] + m[15];
+		}
+
+		inline float ndc2Pix(float v, int S)
+		{
+			return ((v + 1.0f) * S - 1.0f) * 0.5f;
+		}
+
+		const float kNear = 0.2f;
+
+		/** Upper triangle of the 3D covariance from scale and rotation, xx xy xz yy yz zz. */
+		void covariance3D(const float* r, const float* s, float scale_modifier, float* cov)
+		{
+			float qr = r[0], qx = r[1], qy = r[2], qz = r[3];
+			float qn = std::sqrt(qr * qr + qx * qx + qy * qy + qz * qz);
+			if (qn > 0.0f)
+			{
+				qr /= qn; qx /= qn; qy /= qn; qz /= qn;
+			}
+			float R[3][3] = {
+				{ 1.f - 2.f * (qy * qy + qz * qz), 2.f * (qx * qy - qr * qz), 2.f * (qx * qz + qr * qy) },
+				{ 2.f * (qx * qy + qr * qz), 1.f - 2.f * (qx * qx + qz * qz), 2.f * (qy * qz - qr * qx) },
+				{ 2.f * (qx * qz - qr * qy), 2.f * (qy * qz + qr * qx), 1.f - 2.f * (qx * qx + qy * qy) }
+			};
+			float M[3][3];
+			for (int row = 0; row < 3; row++)
+				for (int col = 0; col < 3; col++)
+					M[row][col] = R[row][col] * scale_modifier * s[col];
+			int k = 0;
+			for (int row = 0; row < 3; row++)
+				for (int col = row; col < 3; col++)
+					cov[k++] = M[row][0] * M[col][0] + M[row][1] * M[col][1] + M[row][2] * M[col][2];
+		}
+
+		/** Attributes of one Gaussian, pointing into the splats or into a Blend. */
+		struct Gaussian
+		{
+			const float* p;
+			const float* r;
+			const float* s;
+			float a;
+			const float* sh;
+		};
+
+		/** Storage of a Gaussian blended towards its parent. */
+		struct Blend
+		{
+			float p[3], r[4], s[3], sh[48];
+		};
+
+		inline Gaussian splat(const Splats& splats, int id)
+		{
+			return { splats.pos + 3 * id, splats.rot + 4 * id, splats.scale + 3 * id, splats.alpha[id], splats.shs + 48 * id };
+		}
+
+		/** Rendered Gaussian k, blended into scratch towards its parent if it has one. */
+		Gaussian cutGaussian(const Splats& splats, int k, const int* indices, const int* parent_indices, const float* ts, const int* kids, Blend& scratch)
+		{
+			const Gaussian g = splat(splats, indices[k]);
+			int parent = parent_indices ? parent_indices[k] : -1;
+			if (parent < 0)
+				return g;
+
+			// Blend towards the parent, its opacity being shared among its children.
+			const Gaussian pg = splat(splats, parent);
+			float t = ts[k];
+			float u = 1.0f - t;
+			float dot = g.r[0] * pg.r[0] + g.r[1] * pg.r[1] + g.r[2] * pg.r[2] + g.r[3] * pg.r[3];
+			float sign = dot < 0.0f ? -1.0f : 1.0f;
+			for (int c = 0; c < 3; c++)
+			{
+				scratch.p[c] = t * g.p[c] + u * pg.p[c];
+				scratch.s[c] = t * g.s[c] + u * pg.s[c];
+			}
+			for (int c = 0; c < 4; c++)
+				scratch.r[c] = t * g.r[c] + u * sign * pg.r[c];
+			for (int c = 0; c < 48; c++)
+				scratch.sh[c] = t * g.sh[c] + u * pg.sh[c];
+			float share = 1.0f - std::pow(1.0f - std::min(pg.a, 0.9999f), 1.0f / std::max(1, kids[k]));
+			return { scratch.p, scratch.r, scratch.s, t * g.a + u * share, scratch.sh };
+		}
+
+	}
+
+	bool Rasterizer::project(int i, const float* p, const float* cov, float a, const View& view)
+	{
+		float t[3];
+		transformPoint4x3(view.viewmatrix, p, t);
+		if (t[2] <= kNear)
+			return false;
+
+		float ph[4];
+		transformPoint4x4(view.projmatrix, p, ph);
+		float w = 1.0f / (ph[3] + 0.0000001f);
+		float px = ndc2Pix(ph[0] * w, view.width);
+		float py = ndc2Pix(ph[1] * w, view.height);
+
+		float Sigma[3][3] = {
+			{ cov[0], cov[1], cov[2] },
+			{ cov[1], cov[3], cov[4] },
+			{ cov[2], cov[4], cov[5] }
+		};
+
+		// EWA splatting: 2D covariance through the affine approximation of the projection.
+		float focal_x = view.width / (2.0f * view.tan_fovx);
+		float focal_y = view.height / (2.0f * view.tan_fovy);
+		float limx = 1.3f * view.tan_fovx;
+		float limy = 1.3f * view.tan_fovy;
+		float tx = std::min(limx, std::max(-limx, t[0] / t[2])) * t[2];
+		float ty = std::min(limy, std::max(-limy, t[1] / t[2])) * t[2];
+		float tz = t[2];
+
+		const float* vm = view.viewmatrix;
+		float J[2][3] = {
+			{ focal_x / tz, 0.0f, -(focal_x * tx) / (tz * tz) },
+			{ 0.0f, focal_y / tz, -(focal_y * ty) / (tz * tz) }
+		};
+		float T[2][3];
+		for (int row = 0; row < 2; row++)
+			for (int col = 0; col < 3; col++)
+				T[row][col] = J[row][0] * vm[col * 4 + 0] + J[row][1] * vm[col * 4 + 1] + J[row][2] * vm[col * 4 + 2];
+
+		float TS[2][3];
+		for (int row = 0; row < 2; row++)
+			for (int col = 0; col < 3; col++)
+				TS[row][col] = T[row][0] * Sigma[0][col] + T[row][1] * Sigma[1][col] + T[row][2] * Sigma[2][col];
+
+		float ca = TS[0][0] * T[0][0] + TS[0][1] * T[0][1] + TS[0][2] * T[0][2] + 0.3f;
+		float cb = TS[0][0] * T[1][0] + TS[0][1] * T[1][1] + TS[0][2] * T[1][2];
+		float cc = TS[1][0] * T[1][0] + TS[1][1] * T[1][1] + TS[1][2] * T[1][2] + 0.3f;
+
+		float det = ca * cc - cb * cb;
+		if (det == 0.0f)
+			return false;
+		float det_inv = 1.0f / det;
+
+		float mid = 0.5f * (ca + cc);
+		float lambda1 = mid + std::sqrt(std::max(0.1f, mid * mid - det));
+		int radius = (int)std::ceil(3.0f * std::sqrt(lambda1));
+
+		int rx0 = std::min(_tilesX, std::max(0, (int)((px - radius) / BLOCK_X)));
+		int ry0 = std::min(_tilesY, std::max(0, (int)((py - radius) / BLOCK_Y)));
+		int rx1 = std::min(_tilesX, std::max(0, (int)((px + radius + BLOCK_X - 1) / BLOCK_X)));
+		int ry1 = std::min(_tilesY, std::max(0, (int)((py + radius + BLOCK_Y - 1) / BLOCK_Y)));
+		if ((rx1 - rx0) * (ry1 - ry0) == 0)
+			return false;
+
+		_meanX[i] = px;
+		_meanY[i] = py;
+		_conicA[i] = cc * det_inv;
+		_conicB[i] = -cb * det_inv;
+		_conicC[i] = ca * det_inv;
+		_opacity[i] = a;
+		_depth[i] = tz;
+		_rect[4 * i + 0] = rx0;
+		_rect[4 * i + 1] = ry0;
+		_rect[4 * i + 2] = rx1;
+		_rect[4 * i + 3] = ry1;
+		return true;
+	}
+
+	bool Rasterizer::preprocess(int i, const float* p, const float* r, const float* s, float a, const float* sh,
+		float scale_modifier, const View& view)
+	{
+		float cov[6];
+		covariance3D(r, s, scale_modifier, cov);
+		if (!project(i, p, cov, a, view))
+			return false;
+		computeColorFromSH(p, view.campos, sh, &_rgb[3 * i]);
+		return true;
+	}
+
+	void Rasterizer::resize(int N, const View& view)
+	{
+		_tilesX = (view.width + BLOCK_X - 1) / BLOCK_X;
+		_tilesY = (view.height + BLOCK_Y - 1) / BLOCK_Y;
+
+		_meanX.resize(N); _meanY.resize(N);
+		_conicA.resize(N); _conicB.resize(N); _conicC.resize(N);
+		_opacity.resize(N);
+		_depth.resize(N);
+		_rect.resize(4 * N);
+		_visible.resize(N);
+	}
+
+	int Rasterizer::forward(
+		const Splats& splats,
+		int P,
+		const int* indices,
+		const int* parent_indices,
+		const float* ts,
+		const int* kids,
+		const Splats& sky,
+		int S,
+		float scale_modifier,
+		const View& view,
+		const float* background,
+		float* out_color)
+	{
+		const int N = P + S;
+		resize(N, view);
+		_rgb.resize(3 * N);
+
+		// Preprocess, skybox first as in the CUDA rasterizer.
+#pragma omp parallel for schedule(dynamic, 1024)
+		for (int i = 0; i < N; i++)
+		{
+			Blend scratch;
+			const Gaussian g = i < S ? splat(sky, i) : cutGaussian(splats, i - S, indices, parent_indices, ts, kids, scratch);
+			_visible[i] = preprocess(i, g.p, g.r, g.s, g.a, g.sh, scale_modifier, view);
+		}
+
+		return blend(N, _rgb.data(), view, background, out_color);
+	}
+
+	void Rasterizer::prepare(
+		const Splats& splats,
+		int P,
+		const int* indices,
+		const int* parent_indices,
+		const float* ts,
+		const int* kids,
+		const Splats& sky,
+		int S,
+		float scale_modifier,
+		const Point& colorPos,
+		const Point& zdir,
+		float margin)
+	{
+		const int N = P + S;
+		_prepared = N;
+		_prepPos.resize(3 * N);
+		_prepCov.resize(6 * N);
+		_prepOpacity.resize(N);
+		_prepRgb.resize(3 * N);
+		_prepLive.resize(N);
+
+#pragma omp parallel for schedule(dynamic, 1024)
+		for (int i = 0; i < N; i++)
+		{
+			Blend scratch;
+			const Gaussian g = i < S ? splat(sky, i) : cutGaussian(splats, i - S, indices, parent_indices, ts, kids, scratch);
+
+			// Behind every view, whose near planes are at most margin closer than the one of colorPos.
+			const float depth = (g.p[0] - colorPos.xyz[0]) * zdir.xyz[0] + (g.p[1] - colorPos.xyz[1]) * zdir.xyz[1] + (g.p[2] - colorPos.xyz[2]) * zdir.xyz[2];
+			_prepLive[i] = depth > kNear - margin;
+			if (!_prepLive[i])
+				continue;
+
+			for (int c = 0; c < 3; c++)
+				_prepPos[3 * i + c] = g.p[c];
+			covariance3D(g.r, g.s, scale_modifier, &_prepCov[6 * i]);
+			_prepOpacity[i] = g.a;
+			computeColorFromSH(g.p, colorPos, g.sh, &_prepRgb[3 * i]);
+		}
+	}
+
+	int Rasterizer::render(const View& view, const float* background, float* out_color)
+	{
+		const int N = _prepared;
+		resize(N, view);
+
+#pragma omp parallel for schedule(dynamic, 1024)
+		for (int i = 0; i < N; i++)
+			_visible[i] = _prepLive[i] && project(i, &_prepPos[3 * i], &_prepCov[6 * i], _prepOpacity[i], view);
+
+		return blend(N, _prepRgb.data(), view, background, out_color);
+	}
+
+	int Rasterizer::blend(int N, const float* rgb, const View& view, const float* background, float* out_color)
+	{
+		const int W = view.width;
+		const int H = view.height;
+		const int numTiles = _tilesX * _tilesY;
+
+		// Binning: count, prefix sum, scatter.
+		_tileCounts.assign(numTiles, 0);
+		_tileStarts.resize(numTiles + 1);
+		for (int i = 0; i < N; i++)
+		{
+			if (!_visible[i])
+				continue;
+			const int* rc = &_rect[4 * i];
+			for (int y = rc[1]; y < rc[3]; y++)
+				for (int x = rc[0]; x < rc[2]; x++)
+					_tileCounts[y * _tilesX + x]++;
+		}
+		_tileStarts[0] = 0;
+		for (int t = 0; t < numTiles; t++)
+			_tileStarts[t + 1] = _tileStarts[t] + _tileCounts[t];
+		_entries.resize(_tileStarts[numTiles]);
+		for (int t = 0; t < numTiles; t++)
+			_tileCounts[t] = _tileStarts[t];
+
+		int rendered = 0;
+		for (int i = 0; i < N; i++)
+		{
+			if (!_visible[i])
+				continue;
+			rendered++;
+			const int* rc = &_rect[4 * i];
+			for (int y = rc[1]; y < rc[3]; y++)
+				for (int x = rc[0]; x < rc[2]; x++)
+					_entries[_tileCounts[y * _tilesX + x]++] = { _depth[i], i };
+		}
+
+		const int HW = H * W;
+
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int tile = 0; tile < numTiles; tile++)
+		{
+			TileEntry* begin = _entries.data() + _tileStarts[tile];
+			TileEntry* end = _entries.data() + _tileStarts[tile + 1];
+			std::sort(begin, end, [](const TileEntry& a, const TileEntry& b) {
+				return a.depth < b.depth || (a.depth == b.depth && a.id < b.id);
+			});
+
+			const int tx = tile % _tilesX;
+			const int ty = tile / _tilesX;
+
+			alignas(64) float pixX[BLOCK_SIZE], pixY[BLOCK_SIZE];
+			alignas(64) float T[BLOCK_SIZE], live[BLOCK_SIZE];
+			alignas(64) float C[3][BLOCK_SIZE];
+			for (int p = 0; p < BLOCK_SIZE; p++)
+			{
+				pixX[p] = float(tx * BLOCK_X + p % BLOCK_X);
+				pixY[p] = float(ty * BLOCK_Y + p / BLOCK_X);
+				T[p] = 1.0f;
+				live[p] = 1.0f;
+				C[0][p] = C[1][p] = C[2][p] = 0.0f;
+			}
+
+			int n = 0;
+			for (TileEntry* e = begin; e != end; ++e, ++n)
+			{
+				const int g = e->id;
+				const float mx = _meanX[g], my = _meanY[g];
+				const float ca = _conicA[g], cb = _conicB[g], cc = _conicC[g];
+				const float op = _opacity[g];
+				const float r = rgb[3 * g + 0], gr = rgb[3 * g + 1], b = rgb[3 * g + 2];
+
+#pragma omp simd
+				for (int p = 0; p < BLOCK_SIZE; p++)
+				{
+					float dx = mx - pixX[p];
+					float dy = my - pixY[p];
+					float power = -0.5f * (ca * dx * dx + cc * dy * dy) - cb * dx * dy;
+					float alpha = std::min(0.99f, op * std::exp(power));
+					alpha = (power > 0.0f || alpha < 1.0f / 255.0f) ? 0.0f : alpha;
+
+					float test_T = T[p] * (1.0f - alpha);
+					bool terminate = live[p] > 0.0f && alpha > 0.0f && test_T < 0.0001f;
+					float weight = terminate ? 0.0f : alpha * T[p] * live[p];
+					C[0][p] += r * weight;
+					C[1][p] += gr * weight;
+					C[2][p] += b * weight;
+					T[p] = (live[p] > 0.0f && !terminate) ? test_T : T[p];
+					live[p] = terminate ? 0.0f : live[p];
+				}
+
+				// Leave the tile once every pixel is saturated.
+				if ((n & 31) == 31)
+				{
+					float anyLive = 0.0f;
+					for (int p = 0; p < BLOCK_SIZE; p++)
+						anyLive += live[p] * T[p];
+					if (anyLive < 0.0001f)
+						break;
+				}
+			}
+
+			for (int p = 0; p < BLOCK_SIZE; p++)
+			{
+				int x = tx * BLOCK_X + p % BLOCK_X;
+				int y = ty * BLOCK_Y + p / BLOCK_X;
+				if (x >= W || y >= H)
+					continue;
+				int pix = y * W + x;
+				for (int ch = 0; ch < 3; ch++)
+					out_color[ch * HW + pix] = C[ch][p] + T[p] * background[ch];
+			}
+		}
+
+		return rendered;
+	}
+
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+
+#pragma once
+
+# include "Config.hpp"
+# include "common.h"
+# include <vector>
+# include <cstdint>
+
+namespace CpuRasterizer {
+
+	/** Host Gaussian attributes, one entry per Gaussian with tightly packed floats. */
+	struct Splats
+	{
+		const float* pos = nullptr;   ///< 3 floats
+		const float* rot = nullptr;   ///< 4 floats, real part first
+		const float* scale = nullptr; ///< 3 floats, activated
+		const float* alpha = nullptr; ///< 1 float, activated
+		const float* shs = nullptr;   ///< 48 floats, DC rgb then 15 coefficients per channel
+	};
+
+	/** Camera as handed to CudaRasterizer::Rasterizer::forward. */
+	struct View
+	{
+		const float* viewmatrix = nullptr; ///< column major world to view
+		const float* projmatrix = nullptr; ///< column major world to clip
+		Point campos;
+		float tan_fovx;
+		float tan_fovy;
+		int width;
+		int height;
+	};
+
+	/**
+	 * Host counterpart of CudaRasterizer::Rasterizer: preprocesses the
+	 * Gaussians, bins them into 16x16 tiles, sorts every tile by depth and
+	 * alpha blends front to back with early termination. Tiles are processed
+	 * in parallel and pixels of a tile in SIMD lanes. Buffers are kept
+	 * between calls.
+	 */
+	class SIBR_EXP_ULR_EXPORT Rasterizer
+	{
+	public:
+
+		/**
+		 * Render the Gaussians into a planar RGB float image (the layout copy.frag reads).
+		 * \param splats host Gaussians of the hierarchy
+		 * \param P number of Gaussians to render
+		 * \param indices Gaussians to render
+		 * \param parent_indices parent Gaussian of every rendered one, nullptr to disable interpolation
+		 * \param ts interpolation weight towards the child (1 = child only)
+		 * \param kids number of siblings sharing the parent
+		 * \param sky skybox Gaussians, always rendered
+		 * \param S number of skybox Gaussians
+		 * \param scale_modifier scale multiplier
+		 * \param view camera
+		 * \param background rgb background
+		 * \param out_color output, 3 * width * height floats
+		 * \return the number of Gaussians that survived culling
+		 */
+		int forward(
+			const Splats& splats,
+			int P,
+			const int* indices,
+			const int* parent_indices,
+			const float* ts,
+			const int* kids,
+			const Splats& sky,
+			int S,
+			float scale_modifier,
+			const View& view,
+			const float* background,
+			float* out_color);
+
+		/**
+		 * View-independent half of forward, shared by close views such as the
+		 * eyes of a stereo pair: interpolates the Gaussians and computes their 3D
+		 * covariance, opacity and color as seen from colorPos. Gaussians closer
+		 * than the near plane minus margin along zdir from colorPos are dropped,
+		 * margin being the largest distance of a view to colorPos.
+		 */
+		void prepare(
+			const Splats& splats,
+			int P,
+			const int* indices,
+			const int* parent_indices,
+			const float* ts,
+			const int* kids,
+			const Splats& sky,
+			int S,
+			float scale_modifier,
+			const Point& colorPos,
+			const Point& zdir,
+			float margin);
+
+		/**
+		 * Render the Gaussians of the last prepare from view, only the projection,
+		 * binning and blending are done.
+		 * \return the number of Gaussians that survived culling
+		 */
+		int render(const View& view, const float* background, float* out_color);
+
+	private:
+
+		/** Preprocess one Gaussian into slot i, return false if culled. */
+		bool preprocess(int i, const float* p, const float* r, const float* s, float a, const float* sh,
+			float scale_modifier, const View& view);
+
+		/** Project a Gaussian with 3D covariance cov (xx xy xz yy yz zz) into slot i, return false if culled. */
+		bool project(int i, const float* p, const float* cov, float a, const View& view);
+
+		/** Size the tile grid and the buffers of N Gaussians. */
+		void resize(int N, const View& view);
+
+		/** Bin, sort and blend the N projected Gaussians with colors rgb. */
+		int blend(int N, const float* rgb, const View& view, const float* background, float* out_color);
+
+		struct TileEntry
+		{
+			float depth;
+			int id;
+		};
+
+		int _tilesX = 0, _tilesY = 0;
+
+		std::vector<float> _meanX, _meanY;
+		std::vector<float> _conicA, _conicB, _conicC;
+		std::vector<float> _opacity;
+		std::vector<float> _rgb;
+		std::vector<float> _depth;
+		std::vector<int> _rect;
+		std::vector<char> _visible;
+
+		std::vector<int> _tileCounts;
+		std::vector<int> _tileStarts;
+		std::vector<TileEntry> _entries;
+
+		int _prepared = 0;
+		std::vector<float> _prepPos;
+		std::vector<float> _prepCov;
+		std::vector<float> _prepOpacity;
+		std::vector<float> _prepRgb;
+		std::vector<char> _prepLive;
+	};
+
+}
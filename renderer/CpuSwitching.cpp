@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "CpuSwitching.hpp"
+#include "LodMath.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace sibr {
+namespace CpuSwitching {
+
+	namespace {
+
+		inline int gaussianCount(const Node& node)
+		{
+			return node.count_leafs + node.count_merged;
+		}
+
+		/** Largest size first, lowest node first among equal sizes. */
+		inline bool smallerCandidate(const std::pair<float, int>& a, const std::pair<float, int>& b)
+		{
+			return a.first < b.first || (a.first == b.first && a.second > b.second);
+		}
+
+		/**
+		 * Refine from the root, admitting expansions one by one, largest
+		 * projected size first, as long as the cut stays within budget.
+		 * Expansions that do not fit are skipped and smaller ones still tried.
+		 */
+		void selectGreedy(
+			const std::vector<Node>& nodes,
+			const std::vector<Box>& boxes,
+			const Lod::Viewpoint* views,
+			int count,
+			const Lod::Band& band,
+			int budget,
+			State& state,
+			Cut& cut)
+		{
+			cut.active_nodes.clear();
+			cut.nodes_to_expand.clear();
+			state.newExpanded.clear();
+			state.candidates.clear();
+
+			auto consider = [&](int id) {
+				const Node& node = nodes[id];
+				float size = Lod::computeSize(boxes[id], views, count);
+				if (node.count_children > 0 && band.decide(size, state.expanded[id] != 0))
+				{
+					state.candidates.push_back({ size, id });
+					std::push_heap(state.candidates.begin(), state.candidates.end(), smallerCandidate);
+				}
+				else
+					cut.active_nodes.push_back(id);
+			};
+
+			int64_t cutGaussians = gaussianCount(nodes[0]);
+			consider(0);
+			while (!state.candidates.empty())
+			{
+				std::pop_heap(state.candidates.begin(), state.candidates.end(), smallerCandidate);
+				const int id = state.candidates.back().second;
+				state.candidates.pop_back();
+
+				const Node& node = nodes[id];
+				int64_t grow = -gaussianCount(node);
+				for (int c = 0; c < node.count_children; c++)
+					grow += gaussianCount(nodes[node.start_children + c]);
+
+				if (cutGaussians + grow > budget)
+				{
+					cut.active_nodes.push_back(id);
+					cut.nodes_to_expand.push_back(id);
+					continue;
+				}
+
+				cutGaussians += grow;
+				state.newExpanded.push_back(id);
+				for (int c = 0; c < node.count_children; c++)
+					consider(node.start_children + c);
+			}
+
+			std::sort(cut.active_nodes.begin(), cut.active_nodes.end());
+		}
+
+	}
+
+	void selectCut(
+		const std::vector<Node>& nodes,
+		const std::vector<Box>& boxes,
+		const Point& viewpoint,
+		const Point& zdir,
+		const Lod::Band& band,
+		int budget,
+		State& state,
+		Cut& cut)
+	{
+		Lod::Viewpoint view;
+		view.position = viewpoint;
+		view.zdir = zdir;
+		selectCut(nodes, boxes, &view, 1, band, budget, state, cut);
+	}
+
+	void selectCut(
+		const std::vector<Node>& nodes,
+		const std::vector<Box>& boxes,
+		const Lod::Viewpoint* views,
+		int count,
+		const Lod::Band& band,
+		int budget,
+		State& state,
+		Cut& cut)
+	{
+		if (state.expanded.size() != nodes.size())
+			state.resize(nodes.size());
+
+		cut.active_nodes.clear();
+		cut.nodes_to_expand.clear();
+		state.frontier.clear();
+		state.next.clear();
+		state.newExpanded.clear();
+
+		if (!nodes.empty())
+			state.frontier.push_back(0);
+
+		// Breadth first and in parallel while the whole refined cut fits, greedily once it does not.
+		int64_t cutGaussians = 0;
+		bool fitsAll = true;
+		while (!state.frontier.empty())
+		{
+			const int nf = (int)state.frontier.size();
+			state.want.resize(nf);
+
+			int64_t stay = 0, grow = 0;
+#pragma omp parallel for schedule(static) reduction(+:stay, grow)
+			for (int i = 0; i < nf; i++)
+			{
+				int id = state.frontier[i];
+				const Node& node = nodes[id];
+				bool want = node.count_children > 0 &&
+					band.decide(Lod::computeSize(boxes[id], views, count), state.expanded[id] != 0);
+				state.want[i] = want;
+				if (want)
+				{
+					for (int c = 0; c < node.count_children; c++)
+						grow += gaussianCount(nodes[node.start_children + c]);
+				}
+				else
+				{
+					stay += gaussianCount(node);
+				}
+			}
+
+			if (cutGaussians + stay + grow > budget)
+			{
+				fitsAll = false;
+				break;
+			}
+
+			for (int i = 0; i < nf; i++)
+			{
+				int id = state.frontier[i];
+				if (!state.want[i])
+				{
+					cut.active_nodes.push_back(id);
+					continue;
+				}
+
+				const Node& node = nodes[id];
+				state.newExpanded.push_back(id);
+				for (int c = 0; c < node.count_children; c++)
+					state.next.push_back(node.start_children + c);
+			}
+
+			cutGaussians += stay;
+			std::swap(state.frontier, state.next);
+			state.next.clear();
+		}
+
+		if (!fitsAll)
+			selectGreedy(nodes, boxes, views, count, band, budget, state, cut);
+
+		for (int id : state.expandedList)
+			state.expanded[id] = 0;
+		for (int id : state.newExpanded)
+			state.expanded[id] = 1;
+		std::swap(state.expandedList, state.newExpanded);
+
+		// Lay out the Gaussians of the cut like the GPU LightSet.
+		const int na = (int)cut.active_nodes.size();
+		state.offsets.resize(na + 1);
+		state.offsets[0] = 0;
+		for (int i = 0; i < na; i++)
+			state.offsets[i + 1] = state.offsets[i] + gaussianCount(nodes[cut.active_nodes[i]]);
+
+		const int total = state.offsets[na];
+		cut.render_indices.resize(total);
+		cut.parent_indices.resize(total);
+		cut.nodes_of_render_indices.resize(total);
+
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < na; i++)
+		{
+			int id = cut.active_nodes[i];
+			const Node& node = nodes[id];
+			int parent = node.parent >= 0 ? nodes[node.parent].start : -1;
+			int dst = state.offsets[i];
+			int count = gaussianCount(node);
+			for (int j = 0; j < count; j++)
+			{
+				cut.render_indices[dst + j] = node.start + j;
+				cut.parent_indices[dst + j] = parent;
+				cut.nodes_of_render_indices[dst + j] = id;
+			}
+		}
+	}
+
+	void getTsIndexed(
+		int N,
+		const int* nodes_of_render_indices,
+		float size_limit,
+		const std::vector<Node>& nodes,
+		const std::vector<Box>& boxes,
+		const Point& viewpoint,
+		const Point& zdir,
+		float* ts,
+		int* kids)
+	{
+		Lod::Viewpoint view;
+		view.position = viewpoint;
+		view.zdir = zdir;
+		getTsIndexed(N, nodes_of_render_indices, size_limit, nodes, boxes, view, ts, kids);
+	}
+
+	void getTsIndexed(
+		int N,
+		const int* nodes_of_render_indices,
+		float size_limit,
+		const std::vector<Node>& nodes,
+		const std::vector<Box>& boxes,
+		const Lod::Viewpoint& view,
+		float* ts,
+		int* kids)
+	{
+		// Gaussians of a node are contiguous, so consecutive iterations mostly hit the same boxes.
+#pragma omp parallel for simd schedule(static)
+		for (int i = 0; i < N; i++)
+		{
+			const Node& node = nodes[nodes_of_render_indices[i]];
+			float t = 1.0f;
+			int k = 1;
+			if (node.parent >= 0)
+			{
+				const Node& parent = nodes[node.parent];
+				k = parent.count_children;
+
+				float parentsize = Lod::computeSize(boxes[node.parent], &view, 1);
+				if (parentsize <= 2.0f * size_limit)
+				{
+					float size = Lod::computeSize(boxes[nodes_of_render_indices[i]], &view, 1);
+					float start = std::fmax(0.5f * parentsize, size);
+					float diff = parentsize - start;
+					if (diff > 0.0f)
+						t = 1.0f - std::fmax(0.0f, size_limit - start) / diff;
+				}
+			}
+			ts[i] = std::fmin(1.0f, std::fmax(0.0f, t));
+			kids[i] = k;
+		}
+	}
+
+	bool sameNodes(const Cut& a, const Cut& b)
+	{
+		return a.active_nodes == b.active_nodes;
+	}
+
+}
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+
+#pragma once
+
+# include "Config.hpp"
+# include "common.h"
+# include "LodHysteresis.hpp"
+# include "LodMath.hpp"
+# include <types.h>
+# include <vector>
+# include <utility>
+# include <cstdint>
+
+namespace sibr {
+
+	/**
+	 * Host counterpart of Switching: selects the cut of the full hierarchy
+	 * held in host memory. All indices are indices into the host arrays
+	 * (nodes, boxes and the Gaussian attributes), so the result can be
+	 * rendered directly by a host rasterizer or gathered for upload.
+	 */
+	namespace CpuSwitching {
+
+		/** Result of one cut selection, laid out like a LightSet. */
+		struct Cut
+		{
+			std::vector<int> active_nodes;            ///< Nodes of the cut.
+			std::vector<int> render_indices;          ///< Gaussians to render.
+			std::vector<int> parent_indices;          ///< First Gaussian of the parent node, -1 at the root.
+			std::vector<int> nodes_of_render_indices; ///< Node of every rendered Gaussian.
+			std::vector<int> nodes_to_expand;         ///< Nodes that want to expand but did not fit the budget.
+			bool parents_uploaded = false;            ///< Set by the caller when the parent Gaussians went to the device with the cut.
+
+			/** \return the number of Gaussians to render. */
+			int to_render() const { return (int)render_indices.size(); }
+		};
+
+		/** Expansion state kept between selections for the hysteresis band, plus reusable scratch. */
+		struct State
+		{
+			std::vector<char> expanded;
+			std::vector<int> expandedList;
+
+			std::vector<int> frontier;
+			std::vector<int> next;
+			std::vector<char> want;
+			std::vector<int> newExpanded;
+			std::vector<int> offsets;
+			std::vector<std::pair<float, int>> candidates;
+
+			/** Size the state for a hierarchy of nodeCount nodes. */
+			void resize(size_t nodeCount) { expanded.assign(nodeCount, 0); expandedList.clear(); }
+		};
+
+		/**
+		 * Select the cut seen from viewpoint. If the refined cut fits in budget
+		 * Gaussians, levels are processed breadth first and in parallel. If it
+		 * does not, expansions are admitted one by one from the root, largest
+		 * projected size first, until the budget is used; the ones that did not
+		 * fit end up in nodes_to_expand.
+		 * \param nodes full hierarchy
+		 * \param boxes node bounds
+		 * \param viewpoint camera position
+		 * \param zdir camera viewing direction
+		 * \param band expand / collapse thresholds
+		 * \param budget maximum number of Gaussians in the cut
+		 * \param state expansion state of the previous selection, updated
+		 * \param cut output, buffers are reused
+		 */
+		SIBR_EXP_ULR_EXPORT void selectCut(
+			const std::vector<Node>& nodes,
+			const std::vector<Box>& boxes,
+			const Point& viewpoint,
+			const Point& zdir,
+			const Lod::Band& band,
+			int budget,
+			State& state,
+			Cut& cut);
+
+		/**
+		 * Select one cut satisfying count cameras at once: a node is judged by
+		 * its largest projected size over all of them, so every camera can be
+		 * rendered from the same set of Gaussians.
+		 */
+		SIBR_EXP_ULR_EXPORT void selectCut(
+			const std::vector<Node>& nodes,
+			const std::vector<Box>& boxes,
+			const Lod::Viewpoint* views,
+			int count,
+			const Lod::Band& band,
+			int budget,
+			State& state,
+			Cut& cut);
+
+		/**
+		 * Host version of Switching::getTsIndexed: interpolation weight towards
+		 * the node (1) or its parent (0) for every rendered Gaussian, and the
+		 * number of children of the parent that share its opacity.
+		 * \param N number of rendered Gaussians
+		 * \param nodes_of_render_indices node of every rendered Gaussian
+		 * \param size_limit target size
+		 * \param nodes full hierarchy
+		 * \param boxes node bounds
+		 * \param viewpoint camera position
+		 * \param zdir camera viewing direction
+		 * \param ts output weights, N floats
+		 * \param kids output child counts, N ints
+		 */
+		SIBR_EXP_ULR_EXPORT void getTsIndexed(
+			int N,
+			const int* nodes_of_render_indices,
+			float size_limit,
+			const std::vector<Node>& nodes,
+			const std::vector<Box>& boxes,
+			const Point& viewpoint,
+			const Point& zdir,
+			float* ts,
+			int* kids);
+
+		/** getTsIndexed for one camera with its field of view scale and foveation. */
+		SIBR_EXP_ULR_EXPORT void getTsIndexed(
+			int N,
+			const int* nodes_of_render_indices,
+			float size_limit,
+			const std::vector<Node>& nodes,
+			const std::vector<Box>& boxes,
+			const Lod::Viewpoint& view,
+			float* ts,
+			int* kids);
+
+		/** \return true if both cuts contain the same nodes in the same order. */
+		SIBR_EXP_ULR_EXPORT bool sameNodes(const Cut& a, const Cut& b);
+
+	}
+
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "DeviceArena.hpp"
+
+#include <cuda_runtime.h>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace sibr {
+
+	const char* deviceMemoryName(DeviceMemory category)
+	{
+		switch (category)
+		{
+		case DeviceMemory::Scene: return "scene";
+		case DeviceMemory::Cut: return "cut";
+		case DeviceMemory::Switching: return "switching";
+		case DeviceMemory::Raster: return "raster";
+		case DeviceMemory::Image: return "image";
+		case DeviceMemory::Scratch: return "scratch";
+		default: return "?";
+		}
+	}
+
+	DeviceArena::DeviceArena(size_t chunkBytes) :
+		_chunkBytes(chunkBytes)
+	{
+	}
+
+	DeviceArena::~DeviceArena()
+	{
+		for (Chunk& chunk : _chunks)
+		{
+			if (chunk.base)
+				cudaFree(chunk.base);
+		}
+		for (void* ptr : _hostBlocks)
+			cudaFreeHost(ptr);
+	}
+
+	size_t DeviceArena::addChunk(size_t bytes)
+	{
+		bytes = ArenaPlacement::aligned(bytes, 256);
+		char* base = nullptr;
+		if (cudaMalloc((void**)&base, bytes) != cudaSuccess)
+			throw std::runtime_error("Out of device memory, could not allocate " + std::to_string(bytes) + " bytes");
+
+		// Blocks refer to their chunk by index, released chunks leave a hole to fill.
+		for (size_t chunk = 1; chunk < _chunks.size(); chunk++)
+		{
+			if (!_chunks[chunk].base)
+			{
+				_chunks[chunk] = { base, ArenaPlacement(bytes) };
+				return chunk;
+			}
+		}
+		_chunks.push_back({ base, ArenaPlacement(bytes) });
+		return _chunks.size() - 1;
+	}
+
+	void DeviceArena::reserve(size_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		addChunk(bytes);
+	}
+
+	void* DeviceArena::alloc(size_t bytes, DeviceMemory category)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		size_t chunk = 0;
+		size_t offset = ArenaPlacement::kNoSpace;
+		while (chunk < _chunks.size() && (!_chunks[chunk].base || (offset = _chunks[chunk].placement.place(bytes)) == ArenaPlacement::kNoSpace))
+			chunk++;
+		if (offset == ArenaPlacement::kNoSpace)
+		{
+			chunk = addChunk(std::max(bytes, _chunkBytes));
+			offset = _chunks[chunk].placement.place(bytes);
+		}
+
+		void* ptr = _chunks[chunk].base + offset;
+		_blocks[ptr] = { chunk, offset, category };
+
+		const size_t c = size_t(category);
+		_live[c] += _chunks[chunk].placement.blockSize(offset);
+		_peak[c] = std::max(_peak[c], _live[c]);
+		return ptr;
+	}
+
+	void DeviceArena::free(void* ptr)
+	{
+		if (!ptr)
+			return;
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto block = _blocks.find(ptr);
+		if (block == _blocks.end())
+			throw std::runtime_error("Freeing memory that is not from the arena");
+
+		Chunk& chunk = _chunks[block->second.chunk];
+		_live[size_t(block->second.category)] -= chunk.placement.blockSize(block->second.offset);
+		chunk.placement.release(block->second.offset);
+
+		// Chunks added on demand go back to the device once empty, the first one is kept.
+		if (block->second.chunk != 0 && chunk.placement.used() == 0)
+		{
+			cudaFree(chunk.base);
+			chunk = { nullptr, ArenaPlacement() };
+		}
+		_blocks.erase(block);
+	}
+
+	void* DeviceArena::allocHost(size_t bytes)
+	{
+		void* ptr = nullptr;
+		if (cudaHostAlloc(&ptr, bytes, 0) != cudaSuccess)
+			throw std::runtime_error("Could not allocate " + std::to_string(bytes) + " bytes of pinned host memory");
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_hostBlocks.push_back(ptr);
+		_pinned += bytes;
+		return ptr;
+	}
+
+	void DeviceArena::setExternal(DeviceMemory category, size_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		const size_t c = size_t(category);
+		_live[c] = _live[c] - _external[c] + bytes;
+		_external[c] = bytes;
+		_peak[c] = std::max(_peak[c], _live[c]);
+	}
+
+	size_t DeviceArena::live(DeviceMemory category) const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _live[size_t(category)];
+	}
+
+	size_t DeviceArena::peak(DeviceMemory category) const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _peak[size_t(category)];
+	}
+
+	size_t DeviceArena::reserved() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		size_t bytes = 0;
+		for (const Chunk& chunk : _chunks)
+			bytes += chunk.placement.capacity();
+		for (size_t external : _external)
+			bytes += external;
+		return bytes;
+	}
+
+	void DeviceArena::report(std::ostream& out) const
+	{
+		const size_t held = reserved();
+		std::lock_guard<std::mutex> lock(_mutex);
+		size_t live = 0;
+		for (size_t c = 0; c < size_t(DeviceMemory::Count); c++)
+			live += _live[c];
+		size_t chunks = 0;
+		for (const Chunk& chunk : _chunks)
+			chunks += chunk.base != nullptr;
+
+		out << "[memory] " << live << " bytes live, " << held << " reserved in " << chunks << " chunks";
+		for (size_t c = 0; c < size_t(DeviceMemory::Count); c++)
+			out << ", " << deviceMemoryName(DeviceMemory(c)) << " " << _live[c];
+		out << ", pinned host " << _pinned << std::endl;
+	}
+
+}
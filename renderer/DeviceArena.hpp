@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+
+#pragma once
+
+# include "Config.hpp"
+# include "ArenaPlacement.hpp"
+# include <cstddef>
+# include <cstdint>
+# include <mutex>
+# include <ostream>
+# include <unordered_map>
+# include <vector>
+
+namespace sibr {
+
+	/** What device memory is used for, accounted separately. */
+	enum class DeviceMemory
+	{
+		Scene,     ///< Resident Gaussians and their nodes and boxes (MemSet).
+		Cut,       ///< Render, parent and node indices of a cut (LightSet).
+		Switching, ///< Work arrays of the maintenance step.
+		Raster,    ///< Interpolation weights, per-Gaussian and per-pixel rasterizer buffers.
+		Image,     ///< Device images before they are packed or downloaded.
+		Scratch,   ///< Scratch space grown by the switching kernels themselves, only accounted.
+		Count
+	};
+
+	SIBR_EXP_ULR_EXPORT const char* deviceMemoryName(DeviceMemory category);
+
+	/**
+	 * Owner of the device memory of a view. Blocks are sub-allocated from a
+	 * few large cudaMalloc chunks through ArenaPlacement, the first one sized
+	 * by reserve() for everything allocated up front, later ones added when a
+	 * block does not fit and freed again once their last block is. Live
+	 * bytes are counted per category and everything, pinned host buffers
+	 * included, is freed with the arena.
+	 */
+	class SIBR_EXP_ULR_EXPORT DeviceArena
+	{
+	public:
+
+		/** \param chunkBytes smallest chunk added when a block does not fit */
+		explicit DeviceArena(size_t chunkBytes = size_t(64) << 20);
+		~DeviceArena();
+
+		DeviceArena(const DeviceArena&) = delete;
+		DeviceArena& operator=(const DeviceArena&) = delete;
+
+		/** Add a chunk of bytes, to be called before the first alloc so the fixed buffers share it. */
+		void reserve(size_t bytes);
+
+		/** \return device memory of bytes, throws if the device has none left. */
+		void* alloc(size_t bytes, DeviceMemory category);
+
+		template<typename T>
+		void alloc(T** ptr, size_t bytes, DeviceMemory category) { *ptr = static_cast<T*>(alloc(bytes, category)); }
+
+		/** Give back a block of alloc, nullptr is ignored. */
+		void free(void* ptr);
+
+		/** \return pinned host memory of bytes, freed with the arena. */
+		void* allocHost(size_t bytes);
+
+		template<typename T>
+		void allocHost(T** ptr, size_t bytes) { *ptr = static_cast<T*>(allocHost(bytes)); }
+
+		/** Account memory allocated outside of the arena, replacing the previous figure of the category. */
+		void setExternal(DeviceMemory category, size_t bytes);
+
+		/** \return the bytes currently allocated for category. */
+		size_t live(DeviceMemory category) const;
+
+		/** \return the most bytes ever allocated for category at once. */
+		size_t peak(DeviceMemory category) const;
+
+		/** \return the device memory held in chunks, used or not, plus the external figures. */
+		size_t reserved() const;
+
+		size_t pinnedHost() const { return _pinned; }
+
+		void report(std::ostream& out) const;
+
+	private:
+
+		struct Chunk
+		{
+			char* base; ///< nullptr once released.
+			ArenaPlacement placement;
+		};
+
+		struct Block
+		{
+			size_t chunk;
+			size_t offset;
+			DeviceMemory category;
+		};
+
+		size_t _chunkBytes;
+		std::vector<Chunk> _chunks;
+		std::unordered_map<void*, Block> _blocks;
+		std::vector<void*> _hostBlocks;
+		size_t _pinned = 0;
+		size_t _live[size_t(DeviceMemory::Count)] = {};
+		size_t _peak[size_t(DeviceMemory::Count)] = {};
+		size_t _external[size_t(DeviceMemory::Count)] = {};
+		mutable std::mutex _mutex;
+
+		/** \return the index of the new chunk. */
+		size_t addChunk(size_t bytes);
+	};
+
+}
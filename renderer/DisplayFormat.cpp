@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "DisplayFormat.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace sibr {
+
+	namespace {
+
+		uint32_t unorm8(float v)
+		{
+			return (uint32_t)(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f);
+		}
+
+	}
+
+	bool parseDisplayFormat(const std::string& name, DisplayFormat& format)
+	{
+		if (name == "float")
+			format = DisplayFormat::Float;
+		else if (name == "half")
+			format = DisplayFormat::Half;
+		else if (name == "rgba8")
+			format = DisplayFormat::RGBA8;
+		else
+			return false;
+		return true;
+	}
+
+	const char* displayFormatName(DisplayFormat format)
+	{
+		switch (format)
+		{
+		case DisplayFormat::Half: return "half";
+		case DisplayFormat::RGBA8: return "rgba8";
+		default: return "float";
+		}
+	}
+
+	size_t displayBytes(DisplayFormat format, uint32_t width, uint32_t height)
+	{
+		const size_t pixels = size_t(width) * height;
+		switch (format)
+		{
+		case DisplayFormat::Half: return pixels * 4 * sizeof(uint16_t);
+		case DisplayFormat::RGBA8: return pixels * sizeof(uint32_t);
+		default: return pixels * 3 * sizeof(float);
+		}
+	}
+
+	uint16_t floatToHalf(float value)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		const uint32_t sign = (bits >> 16) & 0x8000u;
+		const uint32_t magnitude = bits & 0x7FFFFFFFu;
+
+		if (magnitude >= 0x7F800000u)
+			return uint16_t(sign | 0x7C00u | (magnitude > 0x7F800000u ? 0x200u : 0u));
+
+		uint32_t half, rest, halfway;
+		if (magnitude < 0x38800000u)
+		{
+			// Subnormal half: the mantissa in units of 2^-24, below 2^-25 rounds to zero.
+			if (magnitude < 0x33000000u)
+				return uint16_t(sign);
+			const uint32_t mantissa = (magnitude & 0x7FFFFFu) | 0x800000u;
+			const uint32_t shift = 126u - (magnitude >> 23);
+			half = mantissa >> shift;
+			rest = mantissa & ((1u << shift) - 1u);
+			halfway = 1u << (shift - 1u);
+		}
+		else
+		{
+			// Rebias the exponent from 127 to 15, a carry out of the mantissa rounds up to the next exponent or infinity.
+			const uint32_t rebiased = magnitude - 0x38000000u;
+			half = rebiased >> 13;
+			rest = rebiased & 0x1FFFu;
+			halfway = 0x1000u;
+		}
+		if (rest > halfway || (rest == halfway && (half & 1u)))
+			half++;
+		return uint16_t(sign | std::min(half, 0x7C00u));
+	}
+
+	void packDisplay(DisplayFormat format, const float* planar, uint32_t width, uint32_t height, void* out)
+	{
+		const int pixels = int(width * height);
+		const float* r = planar;
+		const float* g = planar + pixels;
+		const float* b = planar + 2 * pixels;
+
+		switch (format)
+		{
+		case DisplayFormat::Float:
+			std::memcpy(out, planar, displayBytes(format, width, height));
+			break;
+		case DisplayFormat::Half:
+		{
+			uint16_t* dst = static_cast<uint16_t*>(out);
+#pragma omp parallel for
+			for (int i = 0; i < pixels; i++)
+			{
+				dst[4 * i + 0] = floatToHalf(r[i]);
+				dst[4 * i + 1] = floatToHalf(g[i]);
+				dst[4 * i + 2] = floatToHalf(b[i]);
+				dst[4 * i + 3] = 0;
+			}
+			break;
+		}
+		case DisplayFormat::RGBA8:
+		{
+			uint32_t* dst = static_cast<uint32_t*>(out);
+#pragma omp parallel for
+			for (int i = 0; i < pixels; i++)
+				dst[i] = unorm8(r[i]) | (unorm8(g[i]) << 8) | (unorm8(b[i]) << 16) | 0xFF000000u;
+			break;
+		}
+		}
+	}
+
+}
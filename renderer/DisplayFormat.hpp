@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+
+#pragma once
+
+# include "Config.hpp"
+# include <cstddef>
+# include <cstdint>
+# include <string>
+
+struct CUstream_st;
+
+namespace sibr {
+
+	/**
+	 * Layout of the buffer the copy pass reads to put a frame on screen. The
+	 * rasterizers always produce planar float RGB; the compact layouts are
+	 * packed from it, interleaved, rows in the same order.
+	 */
+	enum class DisplayFormat
+	{
+		Float, ///< Planar float RGB, written directly by the rasterizer. 12 bytes per pixel.
+		Half,  ///< Interleaved half RGB plus one unused half, two uints per pixel. 8 bytes per pixel.
+		RGBA8, ///< Interleaved 8 bit RGBA, red in the low byte, clamped to [0, 1]. 4 bytes per pixel.
+	};
+
+	/** Parse "float", "half" or "rgba8". */
+	SIBR_EXP_ULR_EXPORT bool parseDisplayFormat(const std::string& name, DisplayFormat& format);
+
+	SIBR_EXP_ULR_EXPORT const char* displayFormatName(DisplayFormat format);
+
+	/** \return the size of the display buffer of a width x height frame. */
+	SIBR_EXP_ULR_EXPORT size_t displayBytes(DisplayFormat format, uint32_t width, uint32_t height);
+
+	/** Round to the nearest IEEE half, infinities and NaN preserved. */
+	SIBR_EXP_ULR_EXPORT uint16_t floatToHalf(float value);
+
+	/**
+	 * Host writer: pack a planar float RGB frame into format.
+	 * \param out displayBytes(format, width, height) bytes, 4 byte aligned
+	 */
+	SIBR_EXP_ULR_EXPORT void packDisplay(DisplayFormat format, const float* planar, uint32_t width, uint32_t height, void* out);
+
+	/** Device writer, the same packing as packDisplay queued on stream. Both pointers are device memory. */
+	SIBR_EXP_ULR_EXPORT void packDisplayDevice(DisplayFormat format, const float* planar, uint32_t width, uint32_t height, void* out, CUstream_st* stream);
+
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "DisplayFormat.hpp"
+
+#include <cuda_runtime.h>
+#include <cuda_fp16.h>
+
+namespace sibr {
+
+	namespace {
+
+		__device__ unsigned int unorm8(float v)
+		{
+			return (unsigned int)(__saturatef(v) * 255.0f + 0.5f);
+		}
+
+		__global__ void packHalf(const float* __restrict__ planar, int pixels, uint2* __restrict__ out)
+		{
+			const int i = blockIdx.x * blockDim.x + threadIdx.x;
+			if (i >= pixels)
+				return;
+			const unsigned int r = __half_as_ushort(__float2half_rn(planar[i]));
+			const unsigned int g = __half_as_ushort(__float2half_rn(planar[pixels + i]));
+			const unsigned int b = __half_as_ushort(__float2half_rn(planar[2 * pixels + i]));
+			out[i] = make_uint2(r | (g << 16), b);
+		}
+
+		__global__ void packRGBA8(const float* __restrict__ planar, int pixels, unsigned int* __restrict__ out)
+		{
+			const int i = blockIdx.x * blockDim.x + threadIdx.x;
+			if (i >= pixels)
+				return;
+			out[i] = unorm8(planar[i]) | (unorm8(planar[pixels + i]) << 8) | (unorm8(planar[2 * pixels + i]) << 16) | 0xFF000000u;
+		}
+
+	}
+
+	void packDisplayDevice(DisplayFormat format, const float* planar, uint32_t width, uint32_t height, void* out, CUstream_st* stream)
+	{
+		const int pixels = int(width * height);
+		const int block = 256;
+		const int grid = (pixels + block - 1) / block;
+
+		switch (format)
+		{
+		case DisplayFormat::Float:
+			cudaMemcpyAsync(out, planar, displayBytes(format, width, height), cudaMemcpyDeviceToDevice, stream);
+			break;
+		case DisplayFormat::Half:
+			packHalf<<<grid, block, 0, stream>>>(planar, pixels, static_cast<uint2*>(out));
+			break;
+		case DisplayFormat::RGBA8:
+			packRGBA8<<<grid, block, 0, stream>>>(planar, pixels, static_cast<unsigned int*>(out));
+			break;
+		}
+	}
+
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "DynamicResolution.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace sibr {
+
+	bool parseUpscaleFilter(const std::string& name, UpscaleFilter& filter)
+	{
+		if (name == "nearest")
+			filter = UpscaleFilter::Nearest;
+		else if (name == "bilinear")
+			filter = UpscaleFilter::Bilinear;
+		else if (name == "bicubic")
+			filter = UpscaleFilter::Bicubic;
+		else
+			return false;
+		return true;
+	}
+
+	bool DynamicResolution::update(float renderMs)
+	{
+		if (!(renderMs > 0.0f))
+			return false;
+
+		_smoothedMs = _smoothedMs == 0.0f ? renderMs : _smoothedMs + _options.smoothing * (renderMs - _smoothedMs);
+		if (++_sinceChange < _options.settleFrames)
+			return false;
+
+		const float minScale = std::min(std::max(_options.minScale, 1.0f / kSteps), 1.0f);
+		const float target = std::max(_options.targetMs, 0.1f);
+		float next = _scale;
+		if (_smoothedMs > target)
+			next = _scale * std::sqrt(target / _smoothedMs);
+		else if (_scale < 1.0f && _smoothedMs < _options.headroom * target)
+			next = _scale * std::min(std::sqrt(_options.headroom * target / _smoothedMs), _options.maxGrowth);
+
+		// Round towards the current scale, so a change is only made when a whole step is warranted.
+		next = std::min(std::max(next, minScale), 1.0f);
+		next = next < _scale ? std::ceil(next * kSteps) / kSteps : std::floor(next * kSteps) / kSteps;
+		next = std::min(std::max(next, minScale), 1.0f);
+		if (next == _scale)
+			return false;
+
+		// Expect the cost of the new pixel count until frames rendered at it come in.
+		_smoothedMs *= (next * next) / (_scale * _scale);
+		_scale = next;
+		_sinceChange = 0;
+		_changes++;
+		return true;
+	}
+
+	void DynamicResolution::reset()
+	{
+		_scale = 1.0f;
+		_smoothedMs = 0.0f;
+		_sinceChange = 0;
+	}
+
+	uint32_t DynamicResolution::scaled(uint32_t full, float scale)
+	{
+		const uint32_t size = (uint32_t)std::lround(full * scale);
+		return std::min(full, std::max(size, 16u));
+	}
+
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+
+#pragma once
+
+# include "Config.hpp"
+# include <cstdint>
+# include <string>
+
+namespace sibr {
+
+	/** Filter of the copy pass when the render resolution is below the display resolution. */
+	enum class UpscaleFilter
+	{
+		Nearest,
+		Bilinear,
+		Bicubic, ///< Catmull-Rom, 16 taps.
+	};
+
+	/** Parse "nearest", "bilinear" or "bicubic". */
+	SIBR_EXP_ULR_EXPORT bool parseUpscaleFilter(const std::string& name, UpscaleFilter& filter);
+
+	/**
+	 * Render scale controller. Fed the render time of every frame, it lowers
+	 * the per-axis scale when the smoothed time goes over the target, assuming
+	 * the cost is proportional to the pixel count, and raises it in small steps
+	 * while the time stays below headroom * target. Changes are quantized and
+	 * at least settleFrames apart so the image does not pump.
+	 */
+	class SIBR_EXP_ULR_EXPORT DynamicResolution
+	{
+	public:
+
+		struct Options
+		{
+			float targetMs = 16.0f;
+			float minScale = 0.5f;
+			float headroom = 0.75f;  ///< Grow only below this fraction of the target.
+			float maxGrowth = 1.1f;  ///< Largest scale increase of one step.
+			float smoothing = 0.2f;  ///< Weight of the newest frame in the moving average.
+			int settleFrames = 10;   ///< Frames between two changes.
+		};
+
+		DynamicResolution() = default;
+		explicit DynamicResolution(const Options& options) : _options(options) {}
+
+		/**
+		 * Record the render time of a frame rendered at scale().
+		 * \return true if scale() changed
+		 */
+		bool update(float renderMs);
+
+		/** Back to full resolution, forgetting the history. */
+		void reset();
+
+		float scale() const { return _scale; }
+		float smoothedMs() const { return _smoothedMs; }
+		uint64_t changes() const { return _changes; }
+
+		Options& options() { return _options; }
+
+		/** \return full scaled and rounded, at least 16. */
+		static uint32_t scaled(uint32_t full, float scale);
+
+		/** Scale steps, every change is a multiple of 1 / kSteps. */
+		static constexpr int kSteps = 64;
+
+	private:
+
+		Options _options;
+		float _scale = 1.0f;
+		float _smoothedMs = 0.0f;
+		int _sinceChange = 0;
+		uint64_t _changes = 0;
+	};
+
+}
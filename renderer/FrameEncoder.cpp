@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "FrameEncoder.hpp"
+
+#include <opencv2/imgcodecs.hpp>
+#ifdef HIERARCHY_HAS_LZ4
+#include <lz4.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+namespace sibr {
+
+	FrameEncoder::FrameEncoder(uint32_t width, uint32_t height, const Options& options, Sink sink) :
+		_width(width),
+		_height(height),
+		_options(options),
+		_sink(std::move(sink))
+	{
+		const int depth = std::max(1, options.queueDepth);
+		const size_t pixels = size_t(width) * height;
+
+		_jobs.resize(depth);
+		for (Job& job : _jobs)
+		{
+			job.image.resize(pixels * 3);
+			job.rgb.resize(pixels * 3);
+		}
+
+		_free.resize(depth);
+		for (int i = 0; i < depth; i++)
+			_free[i] = depth - 1 - i;
+		_pending.resize(depth);
+
+		const int workers = std::max(1, options.workers);
+		for (int i = 0; i < workers; i++)
+			_workers.emplace_back(&FrameEncoder::workerLoop, this);
+	}
+
+	FrameEncoder::~FrameEncoder()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+		_workCv.notify_all();
+		for (std::thread& worker : _workers)
+			worker.join();
+	}
+
+	bool FrameEncoder::supported(FrameCodec codec)
+	{
+#ifndef HIERARCHY_HAS_LZ4
+		if (codec == FrameCodec::LZ4)
+			return false;
+#endif
+		return true;
+	}
+
+	bool FrameEncoder::parseCodec(const std::string& name, FrameCodec& codec)
+	{
+		if (name == "rgb8")
+			codec = FrameCodec::RGB8;
+		else if (name == "lz4")
+			codec = FrameCodec::LZ4;
+		else if (name == "png")
+			codec = FrameCodec::PNG;
+		else if (name == "jpeg" || name == "jpg")
+			codec = FrameCodec::JPEG;
+		else
+			return false;
+		return true;
+	}
+
+	const char* FrameEncoder::extension(FrameCodec codec)
+	{
+		switch (codec)
+		{
+		case FrameCodec::RGB8: return "rgb";
+		case FrameCodec::LZ4: return "lz4";
+		case FrameCodec::PNG: return "png";
+		case FrameCodec::JPEG: return "jpg";
+		}
+		return "";
+	}
+
+	bool FrameEncoder::submit(const float* image, const FrameTag& tag, uint64_t index)
+	{
+		int slot;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			if (_free.empty())
+			{
+				if (!_options.block)
+				{
+					_dropped.fetch_add(1, std::memory_order_relaxed);
+					return false;
+				}
+				_slotCv.wait(lock, [this] { return !_free.empty(); });
+			}
+			slot = _free.back();
+			_free.pop_back();
+		}
+
+		// The copy runs outside the lock, the slot is ours until it is queued.
+		Job& job = _jobs[slot];
+		std::memcpy(job.image.data(), image, sizeof(float) * job.image.size());
+		job.tag = tag;
+		job.index = index;
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			job.order = _submitted++;
+			_pending[(_head + _count) % _pending.size()] = slot;
+			_count++;
+		}
+		_workCv.notify_one();
+		return true;
+	}
+
+	void FrameEncoder::flush()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		const uint64_t target = _submitted;
+		_deliverCv.wait(lock, [this, target] { return _delivered >= target; });
+	}
+
+	void FrameEncoder::workerLoop()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		while (true)
+		{
+			_workCv.wait(lock, [this] { return _count > 0 || _stop; });
+			if (_count == 0)
+				return;
+
+			const int slot = _pending[_head];
+			_head = (_head + 1) % _pending.size();
+			_count--;
+			Job& job = _jobs[slot];
+
+			lock.unlock();
+			const std::vector<unsigned char>& bytes = encode(job);
+			EncodedFrame frame = { job.index, job.tag, _options.codec, bytes.data(), bytes.size() };
+			lock.lock();
+
+			// Frames encoded out of order wait for their predecessors. Only one
+			// worker is in the sink at a time, submit is never held up by it.
+			_deliverCv.wait(lock, [this, &job] { return _delivered == job.order; });
+			lock.unlock();
+			_sink(frame);
+			_encoded.fetch_add(1, std::memory_order_relaxed);
+			_encodedBytes.fetch_add(frame.size, std::memory_order_relaxed);
+			lock.lock();
+
+			_delivered++;
+			_free.push_back(slot);
+			_deliverCv.notify_all();
+			_slotCv.notify_one();
+		}
+	}
+
+	const std::vector<unsigned char>& FrameEncoder::encode(Job& job)
+	{
+		const size_t plane = size_t(_width) * _height;
+		const float* r = job.image.data();
+		const float* g = r + plane;
+		const float* b = g + plane;
+
+		// OpenCV expects BGR.
+		const bool bgr = _options.codec == FrameCodec::PNG || _options.codec == FrameCodec::JPEG;
+		unsigned char* out = job.rgb.data();
+		for (size_t i = 0; i < plane; i++)
+		{
+			unsigned char cr = (unsigned char)(std::min(std::max(r[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+			unsigned char cg = (unsigned char)(std::min(std::max(g[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+			unsigned char cb = (unsigned char)(std::min(std::max(b[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+			out[3 * i + 0] = bgr ? cb : cr;
+			out[3 * i + 1] = cg;
+			out[3 * i + 2] = bgr ? cr : cb;
+		}
+
+		switch (_options.codec)
+		{
+		case FrameCodec::RGB8:
+			return job.rgb;
+		case FrameCodec::LZ4:
+		{
+#ifdef HIERARCHY_HAS_LZ4
+			const int size = (int)job.rgb.size();
+			job.out.resize(LZ4_compressBound(size));
+			const int written = LZ4_compress_default((const char*)job.rgb.data(), (char*)job.out.data(), size, (int)job.out.size());
+			job.out.resize(std::max(0, written));
+			return job.out;
+#else
+			return job.rgb;
+#endif
+		}
+		case FrameCodec::PNG:
+		case FrameCodec::JPEG:
+		{
+			cv::Mat mat((int)_height, (int)_width, CV_8UC3, job.rgb.data());
+			if (_options.codec == FrameCodec::PNG)
+				cv::imencode(".png", mat, job.out, { cv::IMWRITE_PNG_COMPRESSION, std::min(std::max(_options.compression, 0), 9) });
+			else
+				cv::imencode(".jpg", mat, job.out, { cv::IMWRITE_JPEG_QUALITY, std::min(std::max(_options.quality, 0), 100) });
+			return job.out;
+		}
+		}
+		return job.rgb;
+	}
+
+}
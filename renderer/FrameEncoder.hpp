@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+
+#pragma once
+
+# include "Config.hpp"
+# include "FrameRing.hpp"
+# include <atomic>
+# include <condition_variable>
+# include <cstdint>
+# include <functional>
+# include <mutex>
+# include <string>
+# include <thread>
+# include <vector>
+
+namespace sibr {
+
+	/** Output format of the FrameEncoder, from cheapest to smallest. */
+	enum class FrameCodec
+	{
+		RGB8, ///< Interleaved 8 bit RGB, rows top to bottom.
+		LZ4,  ///< RGB8 compressed as one LZ4 block, only if built with liblz4.
+		PNG,  ///< Lossless, through OpenCV.
+		JPEG, ///< Lossy, through OpenCV.
+	};
+
+	/** One frame as handed to the sink. */
+	struct EncodedFrame
+	{
+		uint64_t index;             ///< Caller-chosen key given to submit, e.g. the frame id.
+		FrameTag tag;
+		FrameCodec codec;
+		const unsigned char* data;  ///< Valid for the duration of the sink call.
+		size_t size;
+	};
+
+	/**
+	 * Converts planar float RGB frames (the layout of renderOffscreen) to 8 bit
+	 * and compresses them on worker threads. submit only copies the frame into
+	 * one of a fixed number of slots; when all of them are busy the frame is
+	 * dropped, or, if block is set, submit waits for a slot (backpressure for
+	 * offline recording). Encoded frames reach the sink in submission order.
+	 */
+	class SIBR_EXP_ULR_EXPORT FrameEncoder
+	{
+	public:
+
+		typedef std::function<void(const EncodedFrame&)> Sink;
+
+		struct Options
+		{
+			FrameCodec codec = FrameCodec::PNG;
+			int workers = 2;     ///< Encoding threads.
+			int queueDepth = 8;  ///< Frames waiting or being encoded at most.
+			int quality = 90;    ///< JPEG quality, 0 to 100.
+			int compression = 3; ///< PNG compression level, 0 to 9.
+			bool block = false;  ///< Wait for a free slot instead of dropping the frame.
+		};
+
+		FrameEncoder(uint32_t width, uint32_t height, const Options& options, Sink sink);
+		FrameEncoder(const FrameEncoder&) = delete;
+		FrameEncoder& operator=(const FrameEncoder&) = delete;
+
+		/** Encode and deliver all frames submitted so far, then stop the workers. */
+		~FrameEncoder();
+
+		/** \return false if codec is not available in this build. */
+		static bool supported(FrameCodec codec);
+
+		/** Parse "rgb8", "lz4", "png" or "jpeg". */
+		static bool parseCodec(const std::string& name, FrameCodec& codec);
+
+		/** \return the file extension of codec, without the dot. */
+		static const char* extension(FrameCodec codec);
+
+		/**
+		 * Queue a frame for encoding.
+		 * \param image 3 * width * height floats, copied before returning
+		 * \param tag pose identification handed to the sink
+		 * \param index key handed to the sink
+		 * \return false if the frame was dropped because the queue is full
+		 */
+		bool submit(const float* image, const FrameTag& tag, uint64_t index);
+
+		/** Wait until every submitted frame went through the sink. */
+		void flush();
+
+		uint64_t encoded() const { return _encoded.load(std::memory_order_relaxed); }
+		uint64_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+		uint64_t encodedBytes() const { return _encodedBytes.load(std::memory_order_relaxed); }
+
+	private:
+
+		struct Job
+		{
+			std::vector<float> image;
+			std::vector<unsigned char> rgb;
+			std::vector<unsigned char> out;
+			FrameTag tag;
+			uint64_t index = 0;
+			uint64_t order = 0;
+		};
+
+		void workerLoop();
+
+		/** Quantize job.image to job.rgb and compress it to job.out. \return the encoded bytes */
+		const std::vector<unsigned char>& encode(Job& job);
+
+		const uint32_t _width, _height;
+		const Options _options;
+		Sink _sink;
+
+		std::vector<Job> _jobs;
+		std::vector<int> _free;     ///< Slots not in use.
+		std::vector<int> _pending;  ///< Ring of submitted slots, oldest at _head.
+		size_t _head = 0, _count = 0;
+		uint64_t _submitted = 0;
+		uint64_t _delivered = 0;
+		bool _stop = false;
+
+		std::mutex _mutex;
+		std::condition_variable _workCv;     ///< A frame was submitted or the encoder stops.
+		std::condition_variable _slotCv;     ///< A slot was freed.
+		std::condition_variable _deliverCv;  ///< A frame went through the sink.
+
+		std::vector<std::thread> _workers;
+
+		std::atomic<uint64_t> _encoded = { 0 };
+		std::atomic<uint64_t> _dropped = { 0 };
+		std::atomic<uint64_t> _encodedBytes = { 0 };
+	};
+
+}
@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "FrameRing.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <new>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace sibr {
+
+	static_assert(std::atomic<uint64_t>::is_always_lock_free, "frame ring needs address free 64 bit atomics");
+
+	namespace {
+
+		size_t roundUp(size_t value, size_t alignment)
+		{
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+	}
+
+	FrameRing::~FrameRing()
+	{
+#ifndef _WIN32
+		if (_mapping)
+		{
+			munmap(_mapping, _size);
+			shm_unlink(_name.c_str());
+		}
+#endif
+	}
+
+	bool FrameRing::create(const std::string& name, uint32_t slotCount, uint32_t width, uint32_t height, FrameFormat format, size_t frameBytes)
+	{
+#ifdef _WIN32
+		return false;
+#else
+		if (_mapping || slotCount == 0)
+			return false;
+
+		const size_t stride = roundUp(kFramePayloadOffset + frameBytes, 4096);
+		const size_t size = kFrameRingHeaderSize + stride * slotCount;
+
+		shm_unlink(name.c_str());
+		int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (fd < 0)
+			return false;
+		if (ftruncate(fd, (off_t)size) != 0)
+		{
+			close(fd);
+			shm_unlink(name.c_str());
+			return false;
+		}
+		void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (mapping == MAP_FAILED)
+		{
+			shm_unlink(name.c_str());
+			return false;
+		}
+
+		// ftruncate zero fills, so every slot starts out as "never written".
+		_header = new (mapping) FrameRingHeader();
+		_header->version = kFrameRingVersion;
+		_header->slotCount = slotCount;
+		_header->width = width;
+		_header->height = height;
+		_header->format = (uint32_t)format;
+		_header->frameBytes = frameBytes;
+		_header->slotStride = stride;
+		_header->latest.store(0, std::memory_order_relaxed);
+		_header->readers.store(0, std::memory_order_relaxed);
+		for (uint32_t i = 0; i < slotCount; i++)
+			new (static_cast<char*>(mapping) + kFrameRingHeaderSize + stride * i) FrameSlotHeader();
+
+		// Readers check the magic last.
+		std::atomic_thread_fence(std::memory_order_release);
+		_header->magic = kFrameRingMagic;
+
+		_name = name;
+		_mapping = mapping;
+		_size = size;
+		_slotCount = slotCount;
+		_slotStride = stride;
+		_frameBytes = frameBytes;
+		return true;
+#endif
+	}
+
+	FrameSlotHeader* FrameRing::slot(uint64_t frame) const
+	{
+		char* base = static_cast<char*>(_mapping) + kFrameRingHeaderSize;
+		return reinterpret_cast<FrameSlotHeader*>(base + _slotStride * (frame % _slotCount));
+	}
+
+	void* FrameRing::beginWrite()
+	{
+		_writing = _frame + 1;
+		FrameSlotHeader* s = slot(_writing);
+		s->sequence.store(2 * _writing - 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		return reinterpret_cast<char*>(s) + kFramePayloadOffset;
+	}
+
+	void FrameRing::endWrite(const FrameTag& tag)
+	{
+		FrameSlotHeader* s = slot(_writing);
+		s->poseSequence = tag.poseSequence;
+		s->frameId = tag.frameId;
+		s->poseTimestamp = tag.poseTimestamp;
+		s->sensor = tag.sensor;
+		s->renderedAt = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+		s->sequence.store(2 * _writing, std::memory_order_release);
+		_header->latest.store(_writing, std::memory_order_release);
+		_frame = _writing;
+	}
+
+	FrameRingReader::~FrameRingReader()
+	{
+#ifndef _WIN32
+		if (_control)
+		{
+			_control->readers.fetch_sub(1, std::memory_order_release);
+			munmap(_control, kFrameRingHeaderSize);
+		}
+		if (_mapping)
+			munmap(const_cast<void*>(_mapping), _size);
+#endif
+	}
+
+	bool FrameRingReader::open(const std::string& name)
+	{
+#ifdef _WIN32
+		return false;
+#else
+		if (_mapping)
+			return false;
+
+		int fd = shm_open(name.c_str(), O_RDWR, 0);
+		if (fd < 0)
+			return false;
+		off_t size = lseek(fd, 0, SEEK_END);
+		if (size < (off_t)kFrameRingHeaderSize)
+		{
+			close(fd);
+			return false;
+		}
+		void* mapping = mmap(nullptr, (size_t)size, PROT_READ, MAP_SHARED, fd, 0);
+		void* control = mmap(nullptr, kFrameRingHeaderSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (mapping == MAP_FAILED || control == MAP_FAILED)
+		{
+			if (mapping != MAP_FAILED)
+				munmap(mapping, (size_t)size);
+			if (control != MAP_FAILED)
+				munmap(control, kFrameRingHeaderSize);
+			return false;
+		}
+
+		const FrameRingHeader* header = static_cast<const FrameRingHeader*>(mapping);
+		const uint32_t slotCount = header->slotCount;
+		const size_t slotStride = (size_t)header->slotStride;
+		const size_t frameBytes = (size_t)header->frameBytes;
+		if (header->magic != kFrameRingMagic || header->version != kFrameRingVersion || slotCount == 0 ||
+			kFramePayloadOffset + frameBytes > slotStride ||
+			kFrameRingHeaderSize + slotStride * slotCount > (size_t)size)
+		{
+			munmap(mapping, (size_t)size);
+			munmap(control, kFrameRingHeaderSize);
+			return false;
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		// From now on the writer publishes frames.
+		_control = static_cast<FrameRingHeader*>(control);
+		_control->readers.fetch_add(1, std::memory_order_release);
+
+		_mapping = mapping;
+		_size = (size_t)size;
+		_header = header;
+		_slotCount = slotCount;
+		_slotStride = slotStride;
+		_frameBytes = frameBytes;
+		return true;
+#endif
+	}
+
+	const FrameSlotHeader* FrameRingReader::slot(uint64_t frame) const
+	{
+		const char* base = static_cast<const char*>(_mapping) + kFrameRingHeaderSize;
+		return reinterpret_cast<const FrameSlotHeader*>(base + _slotStride * (frame % _slotCount));
+	}
+
+	uint64_t FrameRingReader::latest() const
+	{
+		return _header ? _header->latest.load(std::memory_order_acquire) : 0;
+	}
+
+	bool FrameRingReader::read(uint64_t frame, void* out, FrameTag& tag) const
+	{
+		if (!_header || frame == 0)
+			return false;
+
+		const FrameSlotHeader* s = slot(frame);
+		const uint64_t before = s->sequence.load(std::memory_order_acquire);
+		if (before != 2 * frame)
+			return false;
+
+		FrameTag copy;
+		copy.poseSequence = s->poseSequence;
+		copy.frameId = s->frameId;
+		copy.poseTimestamp = s->poseTimestamp;
+		copy.sensor = s->sensor;
+		std::memcpy(out, reinterpret_cast<const char*>(s) + kFramePayloadOffset, _frameBytes);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (s->sequence.load(std::memory_order_relaxed) != before)
+			return false;
+
+		tag = copy;
+		return true;
+	}
+
+}
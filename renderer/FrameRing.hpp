@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+
+#pragma once
+
+# include "Config.hpp"
+# include <atomic>
+# include <cstddef>
+# include <cstdint>
+# include <string>
+
+namespace sibr {
+
+	/** Pixel layout of the frames in a ring. */
+	enum class FrameFormat : uint32_t
+	{
+		RGB32FPlanar = 0, ///< Three float planes, rows top to bottom.
+	};
+
+	/** Identifies the pose a frame was rendered from. */
+	struct FrameTag
+	{
+		uint64_t poseSequence = 0;  ///< Sequence number of the pose, as sent by the client.
+		int64_t frameId = -1;       ///< Frame id of the pose, -1 if the client sent none.
+		uint64_t poseTimestamp = 0; ///< Sender timestamp of the pose in microseconds.
+		uint32_t sensor = 0;        ///< Camera of a multi-sensor request, 0 otherwise.
+		uint64_t receivedAt = 0;    ///< Local arrival time of the pose (PoseTelemetry::now), not published.
+		uint64_t appliedAt = 0;     ///< Time the render loop fetched it, not published.
+	};
+
+	/**
+	 * Shared memory layout, all fields native endian. The header is followed by
+	 * slotCount slots of slotStride bytes: a FrameSlotHeader, then the pixels at
+	 * offset kFramePayloadOffset.
+	 */
+	struct FrameRingHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t slotCount;
+		uint32_t width;
+		uint32_t height;
+		uint32_t format;                ///< FrameFormat
+		uint64_t frameBytes;
+		uint64_t slotStride;
+		std::atomic<uint64_t> latest;   ///< Number of the newest complete frame, 0 if none yet.
+		std::atomic<uint32_t> readers;  ///< Attached FrameRingReaders, the writer skips frames while 0.
+	};
+
+	struct FrameSlotHeader
+	{
+		std::atomic<uint64_t> sequence; ///< 2n - 1 while frame n is written, 2n once it is complete.
+		uint64_t poseSequence;
+		int64_t frameId;
+		uint64_t poseTimestamp;
+		uint64_t renderedAt;            ///< Steady clock microseconds when the frame was published.
+		uint32_t sensor;
+	};
+
+	constexpr uint32_t kFrameRingMagic = 0x52465648; // "HVFR"
+	constexpr uint32_t kFrameRingVersion = 3;
+	constexpr size_t kFrameRingHeaderSize = 128;
+	constexpr size_t kFramePayloadOffset = 64;
+
+	static_assert(sizeof(FrameRingHeader) <= kFrameRingHeaderSize, "frame ring header too large");
+	static_assert(sizeof(FrameSlotHeader) <= kFramePayloadOffset, "frame slot header too large");
+
+	/**
+	 * Writer side of a ring of frame slots in POSIX shared memory. Frame n goes
+	 * to slot n % slotCount; every slot is guarded by its own sequence number so
+	 * readers can detect a slot overwritten while they copied it. The writer
+	 * never waits for readers, and only publishes while at least one is
+	 * attached. The object is private to the user that created it.
+	 * Unavailable (create fails) on non-POSIX systems.
+	 */
+	class SIBR_EXP_ULR_EXPORT FrameRing
+	{
+	public:
+
+		FrameRing() = default;
+		FrameRing(const FrameRing&) = delete;
+		FrameRing& operator=(const FrameRing&) = delete;
+		~FrameRing();
+
+		/**
+		 * Create (or replace) the shared memory object name.
+		 * \return false if it could not be created or mapped
+		 */
+		bool create(const std::string& name, uint32_t slotCount, uint32_t width, uint32_t height, FrameFormat format, size_t frameBytes);
+
+		/** \return the payload of the next frame, to be filled before endWrite. */
+		void* beginWrite();
+
+		/** Publish the frame started by beginWrite. */
+		void endWrite(const FrameTag& tag);
+
+		/** \return the whole mapping, e.g. to register it with the GPU. */
+		void* mapping() const { return _mapping; }
+		size_t mappingSize() const { return _size; }
+		size_t frameBytes() const { return _frameBytes; }
+		uint64_t published() const { return _frame; }
+		bool valid() const { return _header != nullptr; }
+
+		/** \return true if a reader is attached. A reader that crashed stays counted. */
+		bool hasReaders() const { return _header && _header->readers.load(std::memory_order_acquire) > 0; }
+
+	private:
+
+		FrameSlotHeader* slot(uint64_t frame) const;
+
+		std::string _name;
+		void* _mapping = nullptr;
+		size_t _size = 0;
+		FrameRingHeader* _header = nullptr;
+		uint64_t _frame = 0;
+		uint64_t _writing = 0;
+
+		// Readers can write the shared header, so the geometry is only read from these copies.
+		uint32_t _slotCount = 0;
+		size_t _slotStride = 0;
+		size_t _frameBytes = 0;
+	};
+
+	/** Client of a FrameRing, usable from another process of the same user. Frames are mapped read-only. */
+	class SIBR_EXP_ULR_EXPORT FrameRingReader
+	{
+	public:
+
+		FrameRingReader() = default;
+		FrameRingReader(const FrameRingReader&) = delete;
+		FrameRingReader& operator=(const FrameRingReader&) = delete;
+		~FrameRingReader();
+
+		/** Map an existing ring and attach to it until destruction. */
+		bool open(const std::string& name);
+
+		const FrameRingHeader* header() const { return _header; }
+
+		/** \return the number of the newest complete frame, 0 if none. */
+		uint64_t latest() const;
+
+		/**
+		 * Copy frame n if it is still in the ring.
+		 * \param out frameBytes bytes
+		 * \return false if the frame was not written yet or overwritten meanwhile
+		 */
+		bool read(uint64_t frame, void* out, FrameTag& tag) const;
+
+	private:
+
+		const FrameSlotHeader* slot(uint64_t frame) const;
+
+		const void* _mapping = nullptr;
+		size_t _size = 0;
+		const FrameRingHeader* _header = nullptr;
+		FrameRingHeader* _control = nullptr; ///< Writable mapping of the header, for the reader count.
+
+		// Geometry validated at open(), other readers could change the shared header afterwards.
+		uint32_t _slotCount = 0;
+		size_t _slotStride = 0;
+		size_t _frameBytes = 0;
+	};
+
+}
@@ -10,6 +10,7 @@
  */
 
 #include <projects/hierarchyviewer/renderer/HierarchyView.hpp>
+#include <projects/hierarchyviewer/renderer/LodMath.hpp>
 #include <core/graphics/GUI.hpp>
 #include <thread>
 #include <boost/asio.hpp>
@@ -20,6 +21,9 @@
 #include <cuda_rasterizer/rasterizer.h>
 
 #include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
 
 #include <Eigen/Dense>
 #include <Eigen/Eigenvalues>
@@ -27,6 +31,14 @@
 
 namespace sibr
 {
+	/** \return the copy fragment shader for buffers whose pixels are read by the fetch in fetchFile:
+	the shared upscaling pass with that fetch appended. */
+	static std::string copyFragmentSource(const char* fetchFile)
+	{
+		const std::string directory = sibr::getShadersDirectory("hierarchyviewer");
+		return sibr::loadFile(directory + "/copy_upscale.frag") + "\n" + sibr::loadFile(directory + fetchFile);
+	}
+
 	/** Copy the content of an input texture to another rendertarget or to the window.
 	If you need a basic copy, prefer using blit.
 	\sa sibr::blit
@@ -41,17 +53,38 @@ namespace sibr
 		\param vertFile pah to the vertex shader file
 		\param fragFile pah to the fragment shader file
 		*/
-		BufferCopyRenderer()
+		BufferCopyRenderer(DisplayFormat format = DisplayFormat::Float) :
+			_format(format)
 		{
+			const char* fetch = format == DisplayFormat::Half ? "/copy_half.frag" : format == DisplayFormat::RGBA8 ? "/copy2.frag" : "/copy.frag";
 			_shader.init("CopyShader",
 				sibr::loadFile(sibr::getShadersDirectory("hierarchyviewer") + "/copy.vert"),
-				sibr::loadFile(sibr::getShadersDirectory("hierarchyviewer") + "/copy.frag"));
+				copyFragmentSource(fetch));
 
 			_flip.init(_shader, "flip");
 			_width.init(_shader, "width");
 			_height.init(_shader, "height");
+			_upscale.init(_shader, "upscale");
+		}
+
+		/** Pick the display format for a width x height buffer: requested if the
+		shader storage block of the context can hold it, else the next more compact one.
+		*/
+		static DisplayFormat negotiate(DisplayFormat requested, int width, int height)
+		{
+			GLint64 maxBlock = 0;
+			glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &maxBlock);
+
+			DisplayFormat format = requested;
+			while (format != DisplayFormat::RGBA8 && maxBlock > 0 && displayBytes(format, width, height) > size_t(maxBlock))
+				format = format == DisplayFormat::Float ? DisplayFormat::Half : DisplayFormat::RGBA8;
+			if (format != requested)
+				SIBR_WRG << "Display buffer " << displayFormatName(requested) << " exceeds the shader storage limit, using " << displayFormatName(format) << std::endl;
+			return format;
 		}
 
+		DisplayFormat format() const { return _format; }
+
 		/** Copy input texture to the output texture, copy also the input alpha into depth.
 		\param textureID the texture to copy
 		\param dst the destination
@@ -68,6 +101,7 @@ namespace sibr
 			_flip.send();
 			_width.send();
 			_height.send();
+			_upscale.send();
 
 			dst.clear();
 			dst.bind();
@@ -99,16 +133,22 @@ namespace sibr
 		/** \return option to flip the texture when copying. */
 		bool& flip() { return _flip.get(); }
 
+		/** Size of the source image, the target may be larger. */
 		int& width() { return _width.get(); }
 
 		int& height() { return _height.get(); }
 
+		/** UpscaleFilter used when the source is smaller than the target. */
+		int& upscale() { return _upscale.get(); }
+
 	private:
 
+		DisplayFormat		_format; ///< Layout of the buffers processed.
 		GLShader			_shader; ///< Copy shader.
 		GLuniform<bool>		_flip = false; ///< Flip the texture when copying.
 		GLuniform<int>		_width = 1000;
 		GLuniform<int>		_height = 800;
+		GLuniform<int>		_upscale = 0;
 	};
 
 	/** Copy the content of an input texture to another rendertarget or to the window.
@@ -129,7 +169,7 @@ namespace sibr
 		{
 			_shader.init("CopyShader",
 				sibr::loadFile(sibr::getShadersDirectory("hierarchyviewer") + "/copy2.vert"),
-				sibr::loadFile(sibr::getShadersDirectory("hierarchyviewer") + "/copy2.frag"));
+				copyFragmentSource("/copy2.frag"));
 
 			_flip.init(_shader, "flip");
 			_width.init(_shader, "width");
@@ -373,6 +413,7 @@ bool sibr::HierarchyView::addNodePackage(
 		boxes_to_copy[i] = boxes[id];
 
 		cuda2cpu[cuda_nodes_offset + i] = id;
+		resident[cuda_nodes_offset + i] = { id, parent, node.start, count, -1 };
 
 		copied_gaussians += count;
 	}
@@ -404,20 +445,37 @@ int sibr::HierarchyView::createNodePackage(
 	const int* indices_to_expand_cuda,
 	std::vector<int>& node_indices,
 	std::vector<int>& cuda_parent_indices,
-	int* cuda_parent_starts)
+	int* cuda_parent_starts,
+	const Point& viewpoint,
+	const Point& zdir)
 {
 	cudaMemcpyAsync(need_children, nodes_to_expand_cuda, sizeof(int) * num_to_expand, cudaMemcpyDeviceToHost, maintenanceStream);
 	cudaStreamSynchronize(maintenanceStream);
 
+	// The kernels only see the collapse threshold, uploads for nodes still inside the band are held back here.
+	// Nodes whose children are already resident are switched by the kernels and get no band.
+	bool filter = hysteresis > 0.0f;
+
 	int num_get_children = 0;
 	int node_package_count = 0;
 	for (int i = 0; i < num_to_expand; i++)
 	{
 		int cuda_id = need_children[i];
 		int node_id = cuda2cpu[cuda_id];
+		if (filter && !lodBand.decide(Lod::computeSize(boxes[node_id], viewpoint, zdir), false))
+		{
+			flips.held();
+			continue;
+		}
 		node_package_count += nodes[node_id].count_children;
 		
-		num_get_children++;
+		need_children[num_get_children++] = cuda_id;
+	}
+
+	if (num_get_children != num_to_expand && num_get_children > 0)
+	{
+		cudaMemcpyAsync(nodes_to_expand_cuda, need_children, sizeof(int) * num_get_children, cudaMemcpyHostToDevice, maintenanceStream);
+		cudaStreamSynchronize(maintenanceStream);
 	}
 
 	node_indices.resize(node_package_count);
@@ -441,23 +499,14 @@ int sibr::HierarchyView::createNodePackage(
 	return num_get_children;
 }
 
-size_t totalAlloc = 0;
-template<typename T>
-void allocTracked(T** t, size_t Size)
-{
-	totalAlloc += Size;
-	cudaMalloc(t, Size);
-}
-
-std::function<char* (size_t N)> resizeFunctional(void** ptr, size_t& S) {
-	auto lambda = [ptr, &S](size_t N) {
+std::function<char* (size_t N)> resizeFunctional(sibr::DeviceArena& arena, void** ptr, size_t& S) {
+	auto lambda = [&arena, ptr, &S](size_t N) {
 		if (N > S)
 		{
-			if (*ptr)
-				cudaFree(*ptr);
+			arena.free(*ptr);
 
 			S = 1.15f * N;
-			cudaMalloc(ptr, S);
+			*ptr = arena.alloc(S, sibr::DeviceMemory::Raster);
 		}
 		return reinterpret_cast<char*>(*ptr);
 	};
@@ -484,20 +533,29 @@ int64_t per_gauss_cost()
 		(7 + 8) * 4 * 2 +
 		(1 + 1 + 1) * 4 * 2 +
 		(1 + 1 + 1 + 1) * 4 +
-		(1 + 1 + 1 + 1 + 1) * 4 +
+		(1 + 1 + 1) * 4 +
 		(2 + 1) * 4 +
 		((1 + 1 + 1 + 1) * 4 + 1);
 }
 
-sibr::HierarchyView::HierarchyView(const sibr::BasicIBRScene::Ptr& ibrScene, uint render_w, uint render_h, const char* file, const char* scaffoldfile, int64_t budget) :
+sibr::HierarchyView::HierarchyView(const sibr::BasicIBRScene::Ptr& ibrScene, uint render_w, uint render_h, const char* file, const char* scaffoldfile, int64_t budget, bool useCpu, bool cpuRaster, bool headless, DisplayFormat displayFormat) :
 	_scene(ibrScene),
-	sibr::ViewBase(render_w, render_h)
+	sibr::ViewBase(render_w, render_h),
+	m_use_cpu(useCpu || cpuRaster),
+	m_cpu_raster(cpuRaster),
+	m_headless(headless)
 {
-	_pointbasedrenderer.reset(new PointBasedRenderer());
-	_copyRenderer = new BufferCopyRenderer();
-	_copyRenderer->flip() = true;
-	_copyRenderer->width() = render_w;
-	_copyRenderer->height() = render_h;
+	_renderSize = sibr::Vector2u(render_w, render_h);
+	if (!m_headless)
+	{
+		_pointbasedrenderer.reset(new PointBasedRenderer());
+		_requestedFormat = displayFormat;
+		_displayFormat = BufferCopyRenderer::negotiate(displayFormat, render_w, render_h);
+		_copyRenderer.reset(new BufferCopyRenderer(_displayFormat));
+		_copyRenderer->flip() = true;
+		_copyRenderer->width() = render_w;
+		_copyRenderer->height() = render_h;
+	}
 
 
 	// Tell the scene we are a priori using all active cameras.
@@ -533,12 +591,6 @@ sibr::HierarchyView::HierarchyView(const sibr::BasicIBRScene::Ptr& ibrScene, uin
 		scale[i] = eigenscale[i];
 	}
 
-	std::vector<sibr::Vector3f> skyboxpos;
-	std::vector<sibr::Vector4f> skyboxrot;
-	std::vector<SHs> skyboxsh;
-	std::vector<float> skyboxalpha;
-	std::vector<sibr::Vector3f> skyboxscale;
-
 	if (strlen(scaffoldfile))
 	{
 		skyboxnum = loadScaffold(scaffoldfile,
@@ -557,27 +609,74 @@ sibr::HierarchyView::HierarchyView(const sibr::BasicIBRScene::Ptr& ibrScene, uin
 
 	GAUSS_MEMLIMIT = std::min(GAUSS_MEMLIMIT, std::max((int)pos.size(), (int)nodes.size()));
 
+	flips.resize(nodes.size());
+	cpuState.resize(nodes.size());
+	hostSlot.assign(nodes.size(), -1);
+	hostSlotCount.assign(nodes.size(), 0);
+	hostNeed.assign(nodes.size(), 0);
+	hostNeedStamp.assign(nodes.size(), 0);
+
 	SIBR_LOG << "Allowing up to " << GAUSS_MEMLIMIT << " Gaussians in VRAM" << std::endl;
 
+	if (m_cpu_raster)
+		initHost(render_w, render_h);
+	else
+		initDevice(render_w, render_h);
+
+	maintenanceThread = std::thread(&sibr::HierarchyView::maintenanceLoop, this);
+}
+
+void sibr::HierarchyView::initHost(uint render_w, uint render_h)
+{
+	// Nothing here touches CUDA, the cut, the weights and the image are all computed on the host.
+	cam_pos = &hostCamPos;
+	cam_pos_old = &hostCamPosOld;
+	view_mat_ptr = &hostView;
+	proj_mat_ptr = &hostProj;
+
+	for (int i = 0; i < 2; i++)
+	{
+		lights[i] = {};
+		lights[i].to_render = &hostToRender[i];
+		*lights[i].to_render = 0;
+	}
+
+	currSet = &lights[0];
+	otherSet = &lights[1];
+
+	currMem = &mems[0];
+	otherMem = &mems[1];
+
+	for (int i = 0; i < 100; i++)
+		usage_vals[i] = 0;
+
+	useImageSize(sibr::Vector2u(render_w, render_h));
+}
+
+void sibr::HierarchyView::initDevice(uint render_w, uint render_h)
+{
 	splits = std::vector<int>(GAUSS_MEMLIMIT, 0);
 
 	int ALLGAUSS = (GAUSS_MEMLIMIT + skyboxnum);
 
+	// Everything sized by the memory model shares one chunk, with room for the alignment of every buffer.
+	deviceArena.reserve(basecost(skyboxnum) + int64_t(GAUSS_MEMLIMIT) * per_gauss_cost() + 64 * 256);
+
 	for (int i = 0; i < 2; i++)
 	{
 		sibr::Vector3f *allPos, *allScales;
 		SHs* allSHs;
 		float* allAlpha;
 		sibr::Vector4f* allRot;
-		CUDA_SAFE(allocTracked((void**)&allPos, sizeof(sibr::Vector3f) * ALLGAUSS));
+		deviceArena.alloc(&allPos, sizeof(sibr::Vector3f) * ALLGAUSS, DeviceMemory::Scene);
 		cudaMemcpy(allPos, skyboxpos.data(), sizeof(sibr::Vector3f) * skyboxnum, cudaMemcpyHostToDevice);
-		CUDA_SAFE(allocTracked((void**)&allSHs, sizeof(SHs) * ALLGAUSS));
+		deviceArena.alloc(&allSHs, sizeof(SHs) * ALLGAUSS, DeviceMemory::Scene);
 		cudaMemcpy(allSHs, skyboxsh.data(), sizeof(SHs) * skyboxnum, cudaMemcpyHostToDevice);
-		CUDA_SAFE(allocTracked((void**)&allAlpha, sizeof(float) * ALLGAUSS));
+		deviceArena.alloc(&allAlpha, sizeof(float) * ALLGAUSS, DeviceMemory::Scene);
 		cudaMemcpy(allAlpha, skyboxalpha.data(), sizeof(float) * skyboxnum, cudaMemcpyHostToDevice);
-		CUDA_SAFE(allocTracked((void**)&allScales, sizeof(sibr::Vector3f) * ALLGAUSS));
+		deviceArena.alloc(&allScales, sizeof(sibr::Vector3f) * ALLGAUSS, DeviceMemory::Scene);
 		cudaMemcpy(allScales, skyboxscale.data(), sizeof(sibr::Vector3f) * skyboxnum, cudaMemcpyHostToDevice);
-		CUDA_SAFE(allocTracked((void**)&allRot, sizeof(sibr::Vector4f) * ALLGAUSS));
+		deviceArena.alloc(&allRot, sizeof(sibr::Vector4f) * ALLGAUSS, DeviceMemory::Scene);
 		cudaMemcpy(allRot, skyboxrot.data(), sizeof(sibr::Vector4f) * skyboxnum, cudaMemcpyHostToDevice);
 		mems[i].pos_cuda = allPos + skyboxnum;
 		mems[i].shs_cuda = allSHs + skyboxnum;
@@ -585,52 +684,49 @@ sibr::HierarchyView::HierarchyView(const sibr::BasicIBRScene::Ptr& ibrScene, uin
 		mems[i].scale_cuda = allScales + skyboxnum;
 		mems[i].rot_cuda = allRot + skyboxnum;
 
-		CUDA_SAFE(allocTracked((void**)&mems[i].nodes_cuda, sizeof(Node) * GAUSS_MEMLIMIT));
-		CUDA_SAFE(allocTracked((void**)&mems[i].boxes_cuda, sizeof(Box) * GAUSS_MEMLIMIT));
+		deviceArena.alloc(&mems[i].nodes_cuda, sizeof(Node) * GAUSS_MEMLIMIT, DeviceMemory::Scene);
+		deviceArena.alloc(&mems[i].boxes_cuda, sizeof(Box) * GAUSS_MEMLIMIT, DeviceMemory::Scene);
 	}
 
-	cudaHostAlloc((void**)&nodes_to_copy, sizeof(Node) * GAUSS_MEMLIMIT, 0);
-	cudaHostAlloc((void**)&boxes_to_copy, sizeof(Box) * GAUSS_MEMLIMIT, 0);
-	cudaHostAlloc((void**)&pos_to_copy, sizeof(sibr::Vector3f) * GAUSS_MEMLIMIT, 0);
-	cudaHostAlloc((void**)&rot_to_copy, sizeof(sibr::Vector4f) * GAUSS_MEMLIMIT, 0);
-	cudaHostAlloc((void**)&shs_to_copy, sizeof(SHs) * GAUSS_MEMLIMIT, 0);
-	cudaHostAlloc((void**)&alpha_to_copy, sizeof(float) * GAUSS_MEMLIMIT, 0);
-	cudaHostAlloc((void**)&scale_to_copy, sizeof(sibr::Vector3f) * GAUSS_MEMLIMIT, 0);
-
-	cudaHostAlloc((void**)&cam_pos, sizeof(Point), 0);
-	cudaHostAlloc((void**)&cam_pos_old, sizeof(Point), 0);
+	deviceArena.allocHost(&nodes_to_copy, sizeof(Node) * GAUSS_MEMLIMIT);
+	deviceArena.allocHost(&boxes_to_copy, sizeof(Box) * GAUSS_MEMLIMIT);
+	deviceArena.allocHost(&pos_to_copy, sizeof(sibr::Vector3f) * GAUSS_MEMLIMIT);
+	deviceArena.allocHost(&rot_to_copy, sizeof(sibr::Vector4f) * GAUSS_MEMLIMIT);
+	deviceArena.allocHost(&shs_to_copy, sizeof(SHs) * GAUSS_MEMLIMIT);
+	deviceArena.allocHost(&alpha_to_copy, sizeof(float) * GAUSS_MEMLIMIT);
+	deviceArena.allocHost(&scale_to_copy, sizeof(sibr::Vector3f) * GAUSS_MEMLIMIT);
 
-	cudaHostAlloc((void**)&new_node_count, sizeof(int), 0);
-	cudaHostAlloc((void**)&new_gauss_count, sizeof(int), 0);
+	deviceArena.allocHost(&cam_pos, sizeof(Point));
+	deviceArena.allocHost(&cam_pos_old, sizeof(Point));
 
-	cudaHostAlloc((void**)&newN, sizeof(int), 0);
-	cudaHostAlloc((void**)&newG, sizeof(int), 0);
-	cudaHostAlloc((void**)&newE, sizeof(int), 0);
-	cudaHostAlloc((void**)&renderhelper, sizeof(int), 0);
-	cudaHostAlloc((void**)&view_mat_ptr, sizeof(sibr::Matrix4f), 0);
-	cudaHostAlloc((void**)&proj_mat_ptr, sizeof(sibr::Matrix4f), 0);
+	deviceArena.allocHost(&newN, sizeof(int));
+	deviceArena.allocHost(&newG, sizeof(int));
+	deviceArena.allocHost(&newE, sizeof(int));
+	deviceArena.allocHost(&renderhelper, sizeof(int));
+	deviceArena.allocHost(&view_mat_ptr, sizeof(sibr::Matrix4f));
+	deviceArena.allocHost(&proj_mat_ptr, sizeof(sibr::Matrix4f));
 
-	cudaHostAlloc((void**)&cuda2cpu, sizeof(int) * GAUSS_MEMLIMIT, 0);
-	cudaHostAlloc((void**)&package_parent_cuda_starts, sizeof(int) * GAUSS_MEMLIMIT, 0);
-	cudaHostAlloc((void**)&need_children, sizeof(int) * GAUSS_MEMLIMIT, 0);
+	deviceArena.allocHost(&cuda2cpu, sizeof(int) * GAUSS_MEMLIMIT);
+	deviceArena.allocHost(&package_parent_cuda_starts, sizeof(int) * GAUSS_MEMLIMIT);
+	deviceArena.allocHost(&need_children, sizeof(int) * GAUSS_MEMLIMIT);
 
 	for (int i = 0; i < 2; i++)
 	{
-		cudaHostAlloc((void**)&lights[i].to_render, sizeof(int), 0);
-		CUDA_SAFE(allocTracked((void**)&lights[i].render_indices, sizeof(int) * GAUSS_MEMLIMIT));
-		CUDA_SAFE(allocTracked((void**)&lights[i].parent_indices, sizeof(int) * GAUSS_MEMLIMIT));
-		CUDA_SAFE(allocTracked((void**)&lights[i].nodes_of_render_indices, sizeof(int) * GAUSS_MEMLIMIT));
+		deviceArena.allocHost(&lights[i].to_render, sizeof(int));
+		deviceArena.alloc(&lights[i].render_indices, sizeof(int) * GAUSS_MEMLIMIT, DeviceMemory::Cut);
+		deviceArena.alloc(&lights[i].parent_indices, sizeof(int) * GAUSS_MEMLIMIT, DeviceMemory::Cut);
+		deviceArena.alloc(&lights[i].nodes_of_render_indices, sizeof(int) * GAUSS_MEMLIMIT, DeviceMemory::Cut);
 	}
 
-	cudaHostAlloc((void**)&num_active_nodes_gpu, sizeof(int), 0);
-	cudaHostAlloc((void**)&num_need_children, sizeof(int), 0);
+	deviceArena.allocHost(&num_active_nodes_gpu, sizeof(int));
+	deviceArena.allocHost(&num_need_children, sizeof(int));
 
-	CUDA_SAFE(allocTracked((void**)&splits1_cuda, sizeof(int) * GAUSS_MEMLIMIT));
+	deviceArena.alloc(&splits1_cuda, sizeof(int) * GAUSS_MEMLIMIT, DeviceMemory::Switching);
 	CUDA_SAFE(cudaMemcpy(splits1_cuda, splits.data(), sizeof(int), cudaMemcpyHostToDevice));
-	CUDA_SAFE(allocTracked((void**)&splits2_cuda, sizeof(int) * GAUSS_MEMLIMIT));
+	deviceArena.alloc(&splits2_cuda, sizeof(int) * GAUSS_MEMLIMIT, DeviceMemory::Switching);
 	CUDA_SAFE(cudaMemcpy(splits2_cuda, splits.data(), sizeof(int), cudaMemcpyHostToDevice));
-	CUDA_SAFE(allocTracked((void**)&activenodes1_cuda, sizeof(int) * GAUSS_MEMLIMIT));
-	CUDA_SAFE(allocTracked((void**)&activenodes2_cuda, sizeof(int) * GAUSS_MEMLIMIT));
+	deviceArena.alloc(&activenodes1_cuda, sizeof(int) * GAUSS_MEMLIMIT, DeviceMemory::Switching);
+	deviceArena.alloc(&activenodes2_cuda, sizeof(int) * GAUSS_MEMLIMIT, DeviceMemory::Switching);
 
 	currSet = &lights[0];
 	otherSet = &lights[1];
@@ -642,13 +738,18 @@ sibr::HierarchyView::HierarchyView(const sibr::BasicIBRScene::Ptr& ibrScene, uin
 	activenodes2.resize(GAUSS_MEMLIMIT);
 	render_indices.resize(GAUSS_MEMLIMIT);
 
-	CUDA_SAFE(allocTracked(&cuda2cpu1_cuda, sizeof(int) * GAUSS_MEMLIMIT));
-	CUDA_SAFE(allocTracked(&cuda2cpu2_cuda, sizeof(int) * GAUSS_MEMLIMIT));
-	CUDA_SAFE(allocTracked((void**)&nodes_to_expand_cuda, sizeof(int) * GAUSS_MEMLIMIT));
-	CUDA_SAFE(allocTracked((void**)&ts_cuda, sizeof(float) * GAUSS_MEMLIMIT));
-	CUDA_SAFE(allocTracked((void**)&kids_cuda, sizeof(int) * GAUSS_MEMLIMIT));
-	CUDA_SAFE(allocTracked((void**)&rect_cuda, 2 * sizeof(int) * ALLGAUSS));
-	CUDA_SAFE(allocTracked((void**)&radii_cuda, sizeof(int) * ALLGAUSS));
+	resident.resize(GAUSS_MEMLIMIT);
+	activeHost.reserve(GAUSS_MEMLIMIT);
+	packageIndices.reserve(GAUSS_MEMLIMIT);
+	packageParentCudaIndices.reserve(GAUSS_MEMLIMIT);
+	splitsHost.resize(GAUSS_MEMLIMIT);
+	splitsRemapped.resize(GAUSS_MEMLIMIT);
+
+	deviceArena.alloc(&nodes_to_expand_cuda, sizeof(int) * GAUSS_MEMLIMIT, DeviceMemory::Switching);
+	deviceArena.alloc(&ts_cuda, sizeof(float) * GAUSS_MEMLIMIT, DeviceMemory::Raster);
+	deviceArena.alloc(&kids_cuda, sizeof(int) * GAUSS_MEMLIMIT, DeviceMemory::Raster);
+	deviceArena.alloc(&rect_cuda, 2 * sizeof(int) * ALLGAUSS, DeviceMemory::Raster);
+	deviceArena.alloc(&radii_cuda, sizeof(int) * ALLGAUSS, DeviceMemory::Raster);
 
 	activenodes1[0] = 0;
 	num_active_nodes_cpu = 1;
@@ -656,6 +757,14 @@ sibr::HierarchyView::HierarchyView(const sibr::BasicIBRScene::Ptr& ibrScene, uin
 
 	CUDA_SAFE(cudaMemcpy(activenodes1_cuda, activenodes1.data(), sizeof(int), cudaMemcpyHostToDevice));
 
+	if (m_use_cpu)
+	{
+		hostResident.reserve(nodes.size());
+		hostNeeded.reserve(nodes.size());
+		hostParents.reserve(GAUSS_MEMLIMIT);
+		compactionRuns.reserve(nodes.size());
+	}
+
 	cudaStreamCreate(&renderStream);
 	cudaStreamCreate(&maintenanceStream);
 
@@ -664,31 +773,29 @@ sibr::HierarchyView::HierarchyView(const sibr::BasicIBRScene::Ptr& ibrScene, uin
 	for (int i = 0; i < 100; i++)
 		usage_vals[i] = 0;
 
-	CUDA_SAFE(allocTracked((void**)&view_cuda, sizeof(sibr::Matrix4f)));
-	CUDA_SAFE(allocTracked((void**)&proj_cuda, sizeof(sibr::Matrix4f)));
-	CUDA_SAFE(allocTracked((void**)&cam_pos_cuda, 3 * sizeof(float)));
-	CUDA_SAFE(allocTracked((void**)&cam_pos_cuda_old, 3 * sizeof(float)));
+	deviceArena.alloc(&view_cuda, sizeof(sibr::Matrix4f), DeviceMemory::Raster);
+	deviceArena.alloc(&proj_cuda, sizeof(sibr::Matrix4f), DeviceMemory::Raster);
+	deviceArena.alloc(&cam_pos_cuda, 3 * sizeof(float), DeviceMemory::Raster);
+	deviceArena.alloc(&cam_pos_cuda_old, 3 * sizeof(float), DeviceMemory::Raster);
 
-	CUDA_SAFE(glCreateBuffers(1, &imageBuffer));
-	CUDA_SAFE(glNamedBufferStorage(imageBuffer, render_w * render_h * 3 * sizeof(float), nullptr, GL_DYNAMIC_STORAGE_BIT));
-	CUDA_SAFE(cudaGraphicsGLRegisterBuffer(&imageBufferCuda, imageBuffer, cudaGraphicsRegisterFlagsWriteDiscard));
+	CUDA_SAFE(useImageSize(sibr::Vector2u(render_w, render_h)));
 
-	geomBufferFunc = resizeFunctional(&geomPtr, allocdGeom);
-	binningBufferFunc = resizeFunctional(&binningPtr, allocdBinning);
-	imgBufferFunc = resizeFunctional(&imgPtr, allocdImg);
+	geomBufferFunc = resizeFunctional(deviceArena, &geomPtr, allocdGeom);
+	binningBufferFunc = resizeFunctional(deviceArena, &binningPtr, allocdBinning);
+	imgBufferFunc = resizeFunctional(deviceArena, &imgPtr, allocdImg);
 
-	allocTracked((void**)&background_cuda, 3 * sizeof(float));
+	deviceArena.alloc(&background_cuda, 3 * sizeof(float), DeviceMemory::Raster);
 	float bg[3] = { 0.0f, 0.0f, 0.0f };
 	cudaMemcpy(background_cuda, bg, 3 * sizeof(float), cudaMemcpyHostToDevice);
 
-	allocTracked(&NsrcI, sizeof(int) * GAUSS_MEMLIMIT);
-	allocTracked(&NdstI, sizeof(int) * GAUSS_MEMLIMIT);
-	allocTracked(&NsrcI2, sizeof(int)* GAUSS_MEMLIMIT);
-	allocTracked(&NdstI2, sizeof(int)* GAUSS_MEMLIMIT);
-	allocTracked(&NsrcC, sizeof(char)* GAUSS_MEMLIMIT);
-	allocTracked(&numI, sizeof(int));
+	deviceArena.alloc(&NsrcI, sizeof(int) * GAUSS_MEMLIMIT, DeviceMemory::Switching);
+	deviceArena.alloc(&NdstI, sizeof(int) * GAUSS_MEMLIMIT, DeviceMemory::Switching);
+	deviceArena.alloc(&NsrcI2, sizeof(int)* GAUSS_MEMLIMIT, DeviceMemory::Switching);
+	deviceArena.alloc(&NdstI2, sizeof(int)* GAUSS_MEMLIMIT, DeviceMemory::Switching);
+	deviceArena.alloc(&NsrcC, sizeof(char)* GAUSS_MEMLIMIT, DeviceMemory::Switching);
+	deviceArena.alloc(&numI, sizeof(int), DeviceMemory::Switching);
 
-	std::cout << "Using " << totalAlloc << " bytes for scene" << std::endl;
+	deviceArena.report(std::cout);
 }
 
 void sibr::HierarchyView::setScene(const sibr::BasicIBRScene::Ptr& newScene) {
@@ -705,16 +812,334 @@ void sibr::HierarchyView::setScene(const sibr::BasicIBRScene::Ptr& newScene) {
 	_scene->cameras()->debugFlagCameraAsUsed(imgs_ulr);
 }
 
-std::tuple<sibr::HierarchyView::MemSet*, int, int> sibr::HierarchyView::asyncTask(Point* campos, Point zdir, bool cleanup)
+std::tuple<sibr::HierarchyView::MemSet*, int, int> sibr::HierarchyView::cpuTask(const Lod::Viewpoint* views, int count)
 {
-	cudaMemcpyAsync(cam_pos_cuda_old, campos, sizeof(Point), cudaMemcpyHostToDevice, maintenanceStream);
+	maintenanceStep++;
+	lodBand = Lod::Band::make(sizeLimit, hysteresis);
 
+	CpuSwitching::selectCut(nodes, boxes, views, count, lodBand, GAUSS_MEMLIMIT, cpuState, *otherCut);
+
+	if (!otherCut->nodes_to_expand.empty())
+	{
+		if (tau == 0)
+			tau = 1.0f;
+		tau *= 1.05f;
+	}
+
+	*otherSet->to_render = otherCut->to_render();
+
+	const bool same = CpuSwitching::sameNodes(*otherCut, *currCut);
+	maintenanceCutChanged = !same || !otherCut->nodes_to_expand.empty();
+
+	if (m_cpu_raster)
+	{
+		cuda_gaussians_offset = otherCut->to_render();
+		return std::make_tuple(currMem, 0, 0);
+	}
+
+	if (same)
+	{
+		otherCut->parents_uploaded = currCut->parents_uploaded;
+		cudaMemcpyAsync(otherSet->render_indices, currSet->render_indices, sizeof(int) * otherCut->to_render(), cudaMemcpyDeviceToDevice, maintenanceStream);
+		if (otherCut->parents_uploaded)
+			cudaMemcpyAsync(otherSet->parent_indices, currSet->parent_indices, sizeof(int) * otherCut->to_render(), cudaMemcpyDeviceToDevice, maintenanceStream);
+		cudaStreamSynchronize(maintenanceStream);
+		return std::make_tuple(currMem, 0, 0);
+	}
+
+	int uploaded = 0;
+	MemSet* useMem = uploadCut(*otherCut, otherSet, uploaded);
+	return std::make_tuple(useMem, 0, uploaded);
+}
+
+sibr::HierarchyView::MemSet* sibr::HierarchyView::uploadCut(CpuSwitching::Cut& cut, LightSet* useSet, int& uploaded)
+{
+	const int count = cut.to_render();
+	hostStamp++;
+
+	// What the cut needs resident: every Gaussian of an active node, the first one of a parent node.
+	hostNeeded.clear();
+	for (int id : cut.active_nodes)
+	{
+		hostNeedStamp[id] = hostStamp;
+		hostNeed[id] = nodes[id].count_leafs + nodes[id].count_merged;
+		hostNeeded.push_back(id);
+	}
+	for (int id : cut.active_nodes)
+	{
+		const int parent = nodes[id].parent;
+		if (parent < 0 || hostNeedStamp[parent] == hostStamp)
+			continue;
+		hostNeedStamp[parent] = hostStamp;
+		hostNeed[parent] = -1;
+		hostNeeded.push_back(parent);
+	}
+
+	// Nodes that left the cut, or are now active where only their first Gaussian was resident, leave dead space.
+	size_t keep = 0;
+	int64_t kept[2] = { 0, 0 }; // Active and parent-only Gaussians.
+	for (int id : hostResident)
+	{
+		const int need = hostNeedStamp[id] == hostStamp ? std::abs(hostNeed[id]) : INT_MAX;
+		if (hostSlotCount[id] < need)
+		{
+			hostSlot[id] = -1;
+			continue;
+		}
+		hostResident[keep++] = id;
+		kept[hostNeed[id] < 0] += hostSlotCount[id];
+	}
+	hostResident.resize(keep);
+
+	int64_t incoming[2] = { 0, 0 };
+	for (int id : hostNeeded)
+	{
+		if (hostSlot[id] < 0)
+			incoming[hostNeed[id] < 0] += std::abs(hostNeed[id]);
+	}
+
+	// New Gaussians are appended after everything the current frame may read. When the
+	// store is full, the kept ones move to the other MemSet with the compaction kernel,
+	// leaving the parents out if even that does not fit.
 	MemSet* useMem = currMem;
+	bool parents = true;
+	int tail = cuda_gaussians_offset;
+	if (tail + incoming[0] + incoming[1] > GAUSS_MEMLIMIT)
+	{
+		parents = kept[0] + kept[1] + incoming[0] + incoming[1] <= GAUSS_MEMLIMIT;
+
+		compactionRuns.clear();
+		tail = 0;
+		keep = 0;
+		for (int id : hostResident)
+		{
+			if (!parents && hostNeed[id] < 0)
+			{
+				hostSlot[id] = -1;
+				continue;
+			}
+			const int n = hostSlotCount[id];
+			Compaction::Run* last = compactionRuns.empty() ? nullptr : &compactionRuns.back();
+			if (last && last->src + last->count == hostSlot[id])
+				last->count += n;
+			else if (n > 0)
+				compactionRuns.push_back({ hostSlot[id], tail, n });
+			hostSlot[id] = tail;
+			tail += n;
+			hostResident[keep++] = id;
+		}
+		hostResident.resize(keep);
+		copyRuns(compactionRuns, currMem, otherMem);
+		useMem = otherMem;
+	}
+
+	int staged = 0;
+	for (int id : hostNeeded)
+	{
+		if (hostSlot[id] >= 0 || (!parents && hostNeed[id] < 0))
+			continue;
+		const int n = std::abs(hostNeed[id]);
+		for (int j = 0; j < n; j++)
+		{
+			const int src = nodes[id].start + j;
+			pos_to_copy[staged + j] = pos[src];
+			rot_to_copy[staged + j] = rot[src];
+			shs_to_copy[staged + j] = shs[src];
+			alpha_to_copy[staged + j] = alpha[src];
+			scale_to_copy[staged + j] = scale[src];
+		}
+		hostSlot[id] = tail + staged;
+		hostSlotCount[id] = n;
+		hostResident.push_back(id);
+		staged += n;
+	}
+
+	cudaMemcpyAsync(useMem->pos_cuda + tail, pos_to_copy, sizeof(sibr::Vector3f) * staged, cudaMemcpyHostToDevice, maintenanceStream);
+	cudaMemcpyAsync(useMem->rot_cuda + tail, rot_to_copy, sizeof(sibr::Vector4f) * staged, cudaMemcpyHostToDevice, maintenanceStream);
+	cudaMemcpyAsync(useMem->shs_cuda + tail, shs_to_copy, sizeof(SHs) * staged, cudaMemcpyHostToDevice, maintenanceStream);
+	cudaMemcpyAsync(useMem->alpha_cuda + tail, alpha_to_copy, sizeof(float) * staged, cudaMemcpyHostToDevice, maintenanceStream);
+	cudaMemcpyAsync(useMem->scale_cuda + tail, scale_to_copy, sizeof(sibr::Vector3f) * staged, cudaMemcpyHostToDevice, maintenanceStream);
+	cuda_gaussians_offset = tail + staged;
+	uploaded = staged;
+
+	// Only the indices of the cut are uploaded in full.
+	hostParents.resize(count);
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < count; i++)
+	{
+		const int id = cut.nodes_of_render_indices[i];
+		render_indices[i] = hostSlot[id] + (cut.render_indices[i] - nodes[id].start);
+		hostParents[i] = cut.parent_indices[i] < 0 || !parents ? -1 : hostSlot[nodes[id].parent];
+	}
+	cut.parents_uploaded = parents;
+
+	cudaMemcpyAsync(useSet->render_indices, render_indices.data(), sizeof(int) * count, cudaMemcpyHostToDevice, maintenanceStream);
+	if (parents)
+		cudaMemcpyAsync(useSet->parent_indices, hostParents.data(), sizeof(int) * count, cudaMemcpyHostToDevice, maintenanceStream);
+	cudaStreamSynchronize(maintenanceStream);
+
+	return useMem;
+}
+
+void sibr::HierarchyView::computeHostTs(const Lod::Viewpoint& view, float limit)
+{
+	const int count = currCut->to_render();
+	hostTs.resize(count);
+	hostKids.resize(count);
+	CpuSwitching::getTsIndexed(
+		count,
+		currCut->nodes_of_render_indices.data(),
+		limit,
+		nodes,
+		boxes,
+		view,
+		hostTs.data(),
+		hostKids.data());
+}
+
+void sibr::HierarchyView::fetchActiveNodes()
+{
+	activeHost.resize(*num_active_nodes_gpu);
+	cudaMemcpyAsync(activeHost.data(), activenodes1_cuda, sizeof(int) * activeHost.size(), cudaMemcpyDeviceToHost, maintenanceStream);
+	cudaStreamSynchronize(maintenanceStream);
+}
+
+void sibr::HierarchyView::copyRuns(const std::vector<Compaction::Run>& runs, MemSet* from, MemSet* to)
+{
+	if (runs.empty())
+		return;
+
+	// Earlier copies read the old list on the same stream, so it can be replaced right away.
+	if (runs.size() > compactionRunsCapacity)
+	{
+		deviceArena.free(compactionRuns_cuda);
+		compactionRunsCapacity = size_t(1.15f * runs.size());
+		deviceArena.alloc(&compactionRuns_cuda, sizeof(Compaction::Run) * compactionRunsCapacity, DeviceMemory::Switching);
+	}
+	cudaMemcpyAsync(compactionRuns_cuda, runs.data(), sizeof(Compaction::Run) * runs.size(), cudaMemcpyHostToDevice, maintenanceStream);
+
+	const Compaction::Attribute attributes[] = {
+		{ (const float*)from->pos_cuda, (float*)to->pos_cuda, int(sizeof(sibr::Vector3f) / sizeof(float)) },
+		{ (const float*)from->rot_cuda, (float*)to->rot_cuda, int(sizeof(sibr::Vector4f) / sizeof(float)) },
+		{ (const float*)from->shs_cuda, (float*)to->shs_cuda, int(sizeof(SHs) / sizeof(float)) },
+		{ from->alpha_cuda, to->alpha_cuda, 1 },
+		{ (const float*)from->scale_cuda, (float*)to->scale_cuda, int(sizeof(sibr::Vector3f) / sizeof(float)) },
+	};
+	Compaction::copyRunsDevice(compactionRuns_cuda, (int)runs.size(), runs.front().dst, runs.back().dst + runs.back().count,
+		attributes, int(sizeof(attributes) / sizeof(attributes[0])), maintenanceStream);
+}
+
+sibr::HierarchyView::MemSet* sibr::HierarchyView::finishCompaction(Point zdir)
+{
+	int old_nodes = cuda_nodes_offset;
+
+	fetchActiveNodes();
+	compactor.finish(resident.data(), old_nodes, activeHost.data(), (int)activeHost.size(), compactionRuns);
+	copyRuns(compactionRuns, currMem, otherMem);
+
+	// Node records are rebuilt from the host hierarchy with their new slots.
+	const std::vector<Compaction::Slot>& slots = compactor.slots();
+	const std::vector<int>& remap = compactor.remap();
+	int new_nodes = (int)slots.size();
+	for (int i = 0; i < new_nodes; i++)
+	{
+		const Compaction::Slot& slot = slots[i];
+		Node node = nodes[slot.cpu];
+		node.start = slot.start;
+		node.parent = slot.parent;
+		node.start_children = slot.start_children;
+		nodes_to_copy[i] = node;
+		boxes_to_copy[i] = boxes[slot.cpu];
+		cuda2cpu[i] = slot.cpu;
+		resident[i] = slot;
+	}
+	cudaMemcpyAsync(otherMem->nodes_cuda, nodes_to_copy, sizeof(Node) * new_nodes, cudaMemcpyHostToDevice, maintenanceStream);
+	cudaMemcpyAsync(otherMem->boxes_cuda, boxes_to_copy, sizeof(Box) * new_nodes, cudaMemcpyHostToDevice, maintenanceStream);
+
+	for (int& a : activeHost)
+		a = remap[a];
+	cudaMemcpyAsync(activenodes1_cuda, activeHost.data(), sizeof(int) * activeHost.size(), cudaMemcpyHostToDevice, maintenanceStream);
+
+	cudaMemcpyAsync(splitsHost.data(), splits1_cuda, sizeof(int) * old_nodes, cudaMemcpyDeviceToHost, maintenanceStream);
+	cudaStreamSynchronize(maintenanceStream);
+	for (int i = 0; i < old_nodes; i++)
+	{
+		if (remap[i] != -1)
+			splitsRemapped[remap[i]] = splitsHost[i];
+	}
+	cudaMemcpyAsync(splits2_cuda, splitsRemapped.data(), sizeof(int) * new_nodes, cudaMemcpyHostToDevice, maintenanceStream);
+	cudaStreamSynchronize(maintenanceStream);
+	std::swap(splits1_cuda, splits2_cuda);
+
+	MemSet* useMem = otherMem;
+
+	cuda_nodes_offset = new_nodes;
+	cuda_gaussians_offset = compactor.gaussianCount();
+
+	ran_out = false;
+	compactionDrained = false;
+
+	int add_success;
+	Switching::changeToSizeStep(
+		lodBand.collapse,
+		*num_active_nodes_gpu,
+		activenodes1_cuda,
+		activenodes2_cuda,
+		(int*)useMem->nodes_cuda,
+		(float*)useMem->boxes_cuda,
+		cam_pos_cuda_old,
+		zdir.xyz[0], zdir.xyz[1], zdir.xyz[2],
+		splits1_cuda,
+		otherSet->render_indices,
+		otherSet->parent_indices,
+		otherSet->nodes_of_render_indices,
+		nodes_to_expand_cuda,
+		nullptr,
+		scratchspace,
+		scratchspacesize,
+		NsrcI,
+		NdstI,
+		NsrcC,
+		numI,
+		GAUSS_MEMLIMIT,
+		add_success,
+		num_active_nodes_gpu,
+		otherSet->to_render,
+		num_need_children,
+		maintenanceStream
+	);
+
+	cudaStreamSynchronize(maintenanceStream);
+	deviceArena.setExternal(DeviceMemory::Scratch, scratchspacesize);
+
+	if (add_success != 1)
+		throw std::runtime_error("Doing a step didn't work");
+
+	std::swap(activenodes1_cuda, activenodes2_cuda);
+
+	return useMem;
+}
+
+std::tuple<sibr::HierarchyView::MemSet*, int, int> sibr::HierarchyView::asyncTask(const Lod::Viewpoint* views, int count, bool measure)
+{
+	if (m_use_cpu)
+		return cpuTask(views, count);
+
+	// The switching kernels see a single camera.
+	Point viewpoint = views[0].position;
+	Point zdir = views[0].zdir;
+	cudaMemcpyAsync(cam_pos_cuda_old, &viewpoint, sizeof(Point), cudaMemcpyHostToDevice, maintenanceStream);
+
+	maintenanceStep++;
+	lodBand = Lod::Band::make(sizeLimit, hysteresis);
+
+	MemSet* useMem = currMem;
+	const int activeBefore = *num_active_nodes_gpu;
 
 	int add_success;
 
 	Switching::changeToSizeStep(
-		sizeLimit,
+		lodBand.collapse,
 		*num_active_nodes_gpu,
 		activenodes1_cuda,
 		activenodes2_cuda,
@@ -743,6 +1168,7 @@ std::tuple<sibr::HierarchyView::MemSet*, int, int> sibr::HierarchyView::asyncTas
 	);
 
 	cudaStreamSynchronize(maintenanceStream);
+	deviceArena.setExternal(DeviceMemory::Scratch, scratchspacesize);
 
 	bool success = add_success == 1;
 
@@ -751,28 +1177,42 @@ std::tuple<sibr::HierarchyView::MemSet*, int, int> sibr::HierarchyView::asyncTas
 
 	std::swap(activenodes1_cuda, activenodes2_cuda);
 
+	// Finish a running compaction once all its payload is out, or right away if we hit the budget.
+	bool finishing = compactor.running() && (ran_out || compactionDrained);
+	if (!compactor.running() && ran_out)
+	{
+		fetchActiveNodes();
+		lastMeasure = compactor.begin(resident.data(), cuda_nodes_offset, activeHost.data(), (int)activeHost.size());
+		finishing = true;
+	}
+
 	int num_get_children = 0;
 	int num_transferred = 0;
-	if (!cleanup && *num_need_children > 0)
+	if (!finishing && *num_need_children > 0)
 	{
 		if (!ran_out)
 		{
-			std::vector<int> package_indices;
-			std::vector<int> package_parent_cuda_indices;
-
 			int num_new_parents = createNodePackage(
 				*num_need_children,
 				nodes_to_expand_cuda,
-				package_indices,
-				package_parent_cuda_indices,
-				package_parent_cuda_starts);
+				packageIndices,
+				packageParentCudaIndices,
+				package_parent_cuda_starts,
+				viewpoint,
+				zdir);
 
-			if (addNodePackage(package_indices, package_parent_cuda_indices, useMem))
+			if (addNodePackage(packageIndices, packageParentCudaIndices, useMem))
 			{
 				cudaMemcpyAsync(NsrcI, package_parent_cuda_starts, sizeof(int) * num_new_parents, cudaMemcpyHostToDevice, maintenanceStream);
 				cudaStreamSynchronize(maintenanceStream);
-				num_transferred = package_indices.size();
+				num_transferred = packageIndices.size();
 				num_get_children = num_new_parents;
+
+				for (int k = 0; k < num_new_parents; k++)
+				{
+					resident[need_children[k]].start_children = package_parent_cuda_starts[k];
+					flips.expanded(cuda2cpu[need_children[k]], maintenanceStep);
+				}
 			}
 			else
 			{
@@ -781,175 +1221,565 @@ std::tuple<sibr::HierarchyView::MemSet*, int, int> sibr::HierarchyView::asyncTas
 		}
 	}
 
-	if(cleanup || ran_out)
-	{
-		Maintenance::compactPart1(
-			cuda_nodes_offset,
-			*num_active_nodes_gpu,
-			activenodes1_cuda,
-			activenodes2_cuda,
-			(int*)currMem->nodes_cuda,
-			(float*)currMem->boxes_cuda,
-			(float*)currMem->pos_cuda,
-			(float*)currMem->rot_cuda,
-			(float*)currMem->shs_cuda,
-			currMem->alpha_cuda,
-			(float*)currMem->scale_cuda,
-			splits1_cuda,
-			(int*)otherMem->nodes_cuda,
-			(float*)otherMem->boxes_cuda,
-			(float*)otherMem->pos_cuda,
-			(float*)otherMem->rot_cuda,
-			(float*)otherMem->shs_cuda,
-			otherMem->alpha_cuda,
-			(float*)otherMem->scale_cuda,
-			splits2_cuda,
-			cuda2cpu1_cuda,
-			cuda2cpu2_cuda,
-			NsrcI,
-			NsrcI2,
-			NdstI,
-			NdstI2,
-			scratchspace,
-			scratchspacesize,
-			maintenanceStream,
-			new_node_count
-		);
-
-		if (cuda_nodes_offset - *new_node_count > 10000 || ran_out) // not gonna bother otherwise
+	// The same active nodes give the same render set, payload moves count as changes.
+	maintenanceCutChanged = *num_active_nodes_gpu != activeBefore
+		|| *otherSet->to_render != *currSet->to_render
+		|| num_get_children > 0
+		|| finishing
+		|| compactor.running();
+
+	if (finishing)
+	{
+		useMem = finishCompaction(zdir);
+	}
+	else if (compactor.running())
+	{
+		compactionDrained = !compactor.nextSlice(compactionPolicy.sliceGaussians, compactionPolicy.sliceRuns, compactionRuns);
+		copyRuns(compactionRuns, currMem, otherMem);
+		cudaStreamSynchronize(maintenanceStream);
+	}
+	else if (measure)
+	{
+		flips.nextPeriod();
+		fetchActiveNodes();
+		lastMeasure = Compaction::markLive(resident.data(), cuda_nodes_offset, activeHost.data(), (int)activeHost.size(), liveHost);
+		if (Compaction::shouldCompact(compactionPolicy, lastMeasure))
 		{
-			cudaMemcpyAsync(cuda2cpu1_cuda, cuda2cpu, sizeof(int) * cuda_nodes_offset, cudaMemcpyHostToDevice, maintenanceStream);
+			compactor.begin(resident.data(), cuda_nodes_offset, activeHost.data(), (int)activeHost.size());
+			compactionDrained = false;
+		}
+	}
 
-			Maintenance::compactPart2(
-				cuda_nodes_offset,
-				*num_active_nodes_gpu,
-				activenodes1_cuda,
-				activenodes2_cuda,
-				(int*)currMem->nodes_cuda,
-				(float*)currMem->boxes_cuda,
-				(float*)currMem->pos_cuda,
-				(float*)currMem->rot_cuda,
-				(float*)currMem->shs_cuda,
-				currMem->alpha_cuda,
-				(float*)currMem->scale_cuda,
-				splits1_cuda,
-				(int*)otherMem->nodes_cuda,
-				(float*)otherMem->boxes_cuda,
-				(float*)otherMem->pos_cuda,
-				(float*)otherMem->rot_cuda,
-				(float*)otherMem->shs_cuda,
-				otherMem->alpha_cuda,
-				(float*)otherMem->scale_cuda,
-				splits2_cuda,
-				cuda2cpu1_cuda,
-				cuda2cpu2_cuda,
-				NsrcI,
-				NsrcI2,
-				NdstI,
-				NdstI2,
-				scratchspace,
-				scratchspacesize,
-				maintenanceStream,
-				new_gauss_count
-			);
-			cudaStreamSynchronize(maintenanceStream);
-			cudaMemcpyAsync(cuda2cpu, cuda2cpu2_cuda, sizeof(int)* *num_active_nodes_gpu, cudaMemcpyDeviceToHost, maintenanceStream);
-			cudaStreamSynchronize(maintenanceStream);
-
-			std::swap(cuda2cpu1_cuda, cuda2cpu2_cuda);
-			std::swap(activenodes1_cuda, activenodes2_cuda);
-			std::swap(splits1_cuda, splits2_cuda);
-			useMem = otherMem;
-
-			cuda_nodes_offset = *new_node_count;
-			cuda_gaussians_offset = *new_gauss_count;
-
-			ran_out = false;
-
-			Switching::changeToSizeStep(
-				sizeLimit,
-				*num_active_nodes_gpu,
-				activenodes1_cuda,
-				activenodes2_cuda,
-				(int*)useMem->nodes_cuda,
-				(float*)useMem->boxes_cuda,
-				cam_pos_cuda_old,
-				zdir.xyz[0], zdir.xyz[1], zdir.xyz[2],
-				splits1_cuda,
-				otherSet->render_indices,
-				otherSet->parent_indices,
-				otherSet->nodes_of_render_indices,
-				nodes_to_expand_cuda,
-				nullptr,
-				scratchspace,
-				scratchspacesize,
-				NsrcI,
-				NdstI,
-				NsrcC,
-				numI,
-				GAUSS_MEMLIMIT,
-				add_success,
-				num_active_nodes_gpu,
-				otherSet->to_render,
-				num_need_children,
-				maintenanceStream
-			);
+	return std::make_tuple(useMem, num_get_children, num_transferred);
+}
 
-			cudaStreamSynchronize(maintenanceStream);
+void sibr::HierarchyView::postMaintenance(const Lod::Viewpoint* views, int count, bool measure)
+{
+	{
+		std::lock_guard<std::mutex> lock(maintenanceMutex);
+		std::copy(views, views + count, maintenanceViews);
+		maintenanceViewCount = count;
+		maintenanceMeasure = measure;
+		maintenanceDone = false;
+		maintenancePending = true;
+	}
+	maintenanceCv.notify_all();
+	maintenanceRunning = true;
+}
 
-			bool success = add_success == 1;
+bool sibr::HierarchyView::maintenanceReady()
+{
+	std::lock_guard<std::mutex> lock(maintenanceMutex);
+	return maintenanceDone;
+}
 
-			if (!success)
-				throw std::runtime_error("Doing a step didn't work");
+std::tuple<sibr::HierarchyView::MemSet*, int, int> sibr::HierarchyView::waitMaintenance()
+{
+	std::unique_lock<std::mutex> lock(maintenanceMutex);
+	maintenanceCv.wait(lock, [this] { return maintenanceDone; });
+	maintenanceDone = false;
+	maintenanceRunning = false;
+	if (maintenanceError)
+	{
+		std::exception_ptr error = maintenanceError;
+		maintenanceError = nullptr;
+		std::rethrow_exception(error);
+	}
+	return maintenanceResult;
+}
 
-			std::swap(activenodes1_cuda, activenodes2_cuda);
+void sibr::HierarchyView::maintenanceLoop()
+{
+	std::unique_lock<std::mutex> lock(maintenanceMutex);
+	while (true)
+	{
+		maintenanceCv.wait(lock, [this] { return maintenancePending || maintenanceStop; });
+		if (maintenanceStop)
+			return;
+		maintenancePending = false;
+		Lod::Viewpoint views[kMaxSensors];
+		int count = maintenanceViewCount;
+		std::copy(maintenanceViews, maintenanceViews + count, views);
+		bool measure = maintenanceMeasure;
+
+		lock.unlock();
+		std::tuple<MemSet*, int, int> result;
+		std::exception_ptr error;
+		try
+		{
+			result = asyncTask(views, count, measure);
 		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+		lock.lock();
+
+		maintenanceResult = result;
+		maintenanceError = error;
+		maintenanceDone = true;
+		maintenanceCv.notify_all();
 	}
+}
 
-	return std::make_tuple(useMem, num_get_children, num_transferred);
+void sibr::HierarchyView::setFrameTag(const FrameTag& tag)
+{
+	_frameTag = tag;
+	_frameStamps = LatencyStamps();
+	_frameStamps.arrival = tag.receivedAt;
+	_frameStamps.applied = tag.appliedAt;
+}
+
+void sibr::HierarchyView::stampRender(bool begin)
+{
+	const uint64_t t = PoseTelemetry::now();
+	if (!begin)
+		_frameStamps.renderEnd = t;
+	else if (_frameStamps.renderBegin == 0)
+		_frameStamps.renderBegin = t;
 }
 
 void sibr::HierarchyView::onRenderIBR(sibr::IRenderTarget& dst, const sibr::Camera& eye)
 {
+	stampRender(true);
+	const bool secondEye = _stereo && _secondEye;
+	const sibr::Vector2u target(dst.w(), dst.h());
+	if (target != _resolution && !secondEye)
+		resizeView(target);
+	// Both eyes of a pair have the same size.
+	if (_dynamicEnabled && !secondEye)
+		updateRenderSize();
+	if (_stereo)
+	{
+		_secondEye = !_secondEye;
+		renderEye(eye, !showSfm, secondEye);
+	}
+	else
+	{
+		_frameKey = frameKey(eye);
+		if (!_idleSkip.skip(_frameKey))
+			renderImage(eye, !showSfm);
+	}
+
+	if (showSfm)
+	{
+		_pointbasedrenderer->process(_scene->proxies()->proxy(), eye, dst);
+	}
+	else
+	{
+		_copyRenderer->width() = _renderSize.x();
+		_copyRenderer->height() = _renderSize.y();
+		_copyRenderer->upscale() = _renderSize == _resolution ? 0 : int(_upscaleFilter);
+		_copyRenderer->process(imageBuffer, dst, _renderSize.x(), _renderSize.y());
+	}
+	stampRender(false);
+}
+
+const std::vector<float>& sibr::HierarchyView::renderOffscreen(const sibr::Camera& eye)
+{
+	stampRender(true);
+	renderImage(eye, true);
+	stampRender(false);
+	return hostImage;
+}
+
+const std::vector<float>& sibr::HierarchyView::renderSensors(const sibr::Camera* eyes, int count)
+{
+	if (!m_headless)
+		throw std::runtime_error("Rendering sensors needs a headless view");
+	if (count < 1 || count > kMaxSensors)
+		throw std::runtime_error("Unsupported number of sensors");
+	if (count > 1 && !m_use_cpu)
+		throw std::runtime_error("Sharing a cut between sensors needs the CPU cut selection");
+
+	stampRender(true);
+	float* image_cuda = beginFrame();
+
+	Lod::Viewpoint views[kMaxSensors];
+	viewpointsOf(eyes, count, views);
+	stepMaintenance(views, count);
+	sizeLimit = tau2Limit(tau, tanHalfFovx(eyes[0]), _resolution.x());
+
+	const size_t pixels = size_t(_resolution.x()) * _resolution.y() * 3;
+	sensorImages.resize(pixels * count);
+	for (int k = 0; k < count; k++)
+	{
+		rasterize(eyes[k], image_cuda);
+
+		FrameTag tag = _frameTag;
+		tag.sensor = (uint32_t)k;
+		if (_frameRing)
+			publishFrame(image_cuda, tag);
+
+		// Ordered on the render stream before the next sensor overwrites the image.
+		if (m_cpu_raster)
+			std::memcpy(sensorImages.data() + k * pixels, hostImage.data(), sizeof(float) * pixels);
+		else
+			cudaMemcpyAsync(sensorImages.data() + k * pixels, image_cuda, sizeof(float) * pixels, cudaMemcpyDeviceToHost, renderStream);
+	}
+
+	if (!m_cpu_raster)
+		cudaStreamSynchronize(renderStream);
+
+	stampRender(false);
+	return sensorImages;
+}
+
+void sibr::HierarchyView::viewpointsOf(const sibr::Camera* eyes, int count, Lod::Viewpoint* views) const
+{
+	const float reference = tanHalfFovx(eyes[0]);
+	for (int k = 0; k < count; k++)
+	{
+		auto view_mat = eyes[k].view();
+		view_mat.row(1) *= -1;
+		view_mat.row(2) *= -1;
+
+		auto t = view_mat.row(2).transpose();
+		views[k].zdir = { t.x(), t.y(), t.z() };
+
+		auto inv = view_mat.inverse();
+		views[k].position = { inv(0, 3), inv(1, 3), inv(2, 3) };
+
+		// A narrower camera sees the same node larger on screen.
+		views[k].scale = reference / tanHalfFovx(eyes[k]);
+
+		if (_foveation.enabled())
+			views[k].foveation = foveationOf(eyes[k]);
+	}
+}
+
+sibr::Lod::Foveation sibr::HierarchyView::foveationOf(const sibr::Camera& eye) const
+{
+	// Camera axes with y down and z forward, as the rasterizer sees them.
 	auto view_mat = eye.view();
-	auto proj_mat = eye.viewproj();
 	view_mat.row(1) *= -1;
 	view_mat.row(2) *= -1;
-	proj_mat.row(1) *= -1;
 
-	auto t = view_mat.row(2).transpose();
-	Point zdir = { t.x(), t.y(), t.z() };
+	const float x = (2.0f * _foveaFocus[0] - 1.0f) * tanHalfFovx(eye);
+	const float y = (2.0f * _foveaFocus[1] - 1.0f) * tan(eye.fovy() * 0.5f);
+	Eigen::Vector3f dir = (x * view_mat.row(0) + y * view_mat.row(1) + view_mat.row(2)).head<3>().transpose();
+	dir.normalize();
 
-	auto inv = view_mat.inverse();
-	*cam_pos = { inv(0, 3), inv(1, 3), inv(2, 3) };
+	Lod::Foveation foveation = _foveation;
+	foveation.focus = { dir.x(), dir.y(), dir.z() };
+	return foveation;
+}
+
+void sibr::HierarchyView::setFoveation(float falloff, float radiusDegrees, float maxFactor)
+{
+	const bool wasEnabled = _foveation.enabled();
+	_foveation.falloff = std::max(0.0f, falloff);
+	_foveation.radius = std::max(0.0f, radiusDegrees) * float(EIGEN_PI) / 180.0f;
+	_foveation.maxFactor = std::max(1.0f, maxFactor);
+	if (_foveation.enabled() && !wasEnabled && !m_use_cpu)
+		SIBR_WRG << "Foveated LOD needs the CPU cut selection (--cpu-cut), using a uniform size limit" << std::endl;
+}
+
+uint64_t sibr::HierarchyView::frameKey(const sibr::Camera& eye) const
+{
+	FrameKey key;
+	key.add(eye.view().data(), sizeof(float) * 16).add(eye.viewproj().data(), sizeof(float) * 16);
+	key.add(_renderSize.x()).add(_renderSize.y());
+	key.add(tau).add(_scalingModifier).add(biglimit).add(hysteresis);
+	key.add(showSfm).add(disable_interp).add(show_level).add(_useZFar).add(_zfar);
+	key.add(_foveation.falloff).add(_foveation.radius).add(_foveation.maxFactor);
+	key.add(_foveaFocus[0]).add(_foveaFocus[1]);
+	return key.value();
+}
+
+float sibr::HierarchyView::tanHalfFovx(const sibr::Camera& eye)
+{
+	float fovx = 2.0f * atan(tan(eye.fovy() * 0.5f) * eye.aspect());
+	return tan(fovx * 0.5f);
+}
+
+void sibr::HierarchyView::renderImage(const sibr::Camera& eye, bool raster)
+{
+	float* image_cuda = beginFrame();
+
+	Lod::Viewpoint view;
+	viewpointsOf(&eye, 1, &view);
+	stepMaintenance(&view, 1);
+	sizeLimit = tau2Limit(tau, tanHalfFovx(eye), _resolution.x());
 
-	float* image_cuda;
+	if (raster)
+	{
+		if (_dynamicEnabled)
+			startRenderTimer();
+		rasterize(eye, image_cuda);
+		if (_dynamicEnabled)
+			stopRenderTimer();
+		if (_frameRing)
+			publishFrame(image_cuda, _frameTag);
+	}
+
+	endFrame(raster);
+}
+
+void sibr::HierarchyView::renderEye(const sibr::Camera& eye, bool raster, bool second)
+{
+	float* image_cuda = beginFrame();
+
+	if (second)
+	{
+		// Predicts the right eye of the next pair.
+		_eyeOffset = _leftRotation.conjugate() * (eye.position() - _leftPosition);
+	}
+	else
+	{
+		sibr::Camera right(eye);
+		right.position(eye.position() + eye.rotation() * _eyeOffset);
+		const sibr::Camera pair[2] = { eye, right };
+
+		Lod::Viewpoint views[2];
+		viewpointsOf(pair, 2, views);
+		_pairView = views[0];
+		for (int k = 0; k < 3; k++)
+			_pairView.position.xyz[k] = 0.5f * (views[0].position.xyz[k] + views[1].position.xyz[k]);
+
+		// The switching kernels see a single camera, the midpoint stands for both eyes.
+		if (m_use_cpu)
+			stepMaintenance(views, 2);
+		else
+			stepMaintenance(&_pairView, 1);
+		sizeLimit = tau2Limit(tau, tanHalfFovx(eye), _resolution.x());
+
+		_leftPosition = eye.position();
+		_leftRotation = eye.rotation();
+	}
+
+	if (raster)
+	{
+		if (_dynamicEnabled)
+			startRenderTimer();
+		rasterize(eye, image_cuda, second ? EyeShare::Second : EyeShare::First);
+		if (_dynamicEnabled)
+			stopRenderTimer();
+		if (_frameRing)
+		{
+			FrameTag tag = _frameTag;
+			tag.sensor = second ? 1 : 0;
+			publishFrame(image_cuda, tag);
+		}
+	}
+
+	endFrame(raster);
+}
+
+void sibr::HierarchyView::setDynamicResolution(float targetMs, float minScale, UpscaleFilter filter)
+{
+	if (targetMs > 0.0f)
+		_dynamicResolution.options().targetMs = targetMs;
+	_dynamicResolution.options().minScale = minScale;
+	_upscaleFilter = filter;
+
+	_dynamicEnabled = targetMs > 0.0f && !m_headless && !_frameRing;
+	if (targetMs > 0.0f && !_dynamicEnabled)
+		SIBR_WRG << "Dynamic resolution needs a window and no frame ring, rendering at full resolution" << std::endl;
+
+	if (_dynamicEnabled && !m_cpu_raster && !_renderTimers[0].start)
+	{
+		for (RenderTimer& timer : _renderTimers)
+		{
+			cudaEventCreate(&timer.start);
+			cudaEventCreate(&timer.end);
+		}
+	}
+	if (!_dynamicEnabled)
+	{
+		_dynamicResolution.reset();
+		_renderSize = _resolution;
+	}
+}
+
+void sibr::HierarchyView::startRenderTimer()
+{
+	if (m_cpu_raster)
+	{
+		_hostRenderStart = PoseTelemetry::now();
+		return;
+	}
+	RenderTimer& timer = _renderTimers[_renderTimerSlot];
+	timer.pending = false;
+	cudaEventRecord(timer.start, renderStream);
+}
+
+void sibr::HierarchyView::stopRenderTimer()
+{
+	if (m_cpu_raster)
+	{
+		_hostRenderMs = (PoseTelemetry::now() - _hostRenderStart) * 1e-3f;
+		return;
+	}
+	RenderTimer& timer = _renderTimers[_renderTimerSlot];
+	cudaEventRecord(timer.end, renderStream);
+	timer.pending = true;
+	_renderTimerSlot = (_renderTimerSlot + 1) % kRenderTimers;
+}
+
+void sibr::HierarchyView::updateRenderSize()
+{
+	// Only render times that are already available are used, the frame never waits for the GPU.
+	if (m_cpu_raster)
+	{
+		_dynamicResolution.update(_hostRenderMs);
+		_hostRenderMs = 0.0f;
+	}
+	else
+	{
+		for (int k = 0; k < kRenderTimers; k++)
+		{
+			RenderTimer& timer = _renderTimers[(_renderTimerSlot + k) % kRenderTimers];
+			float ms;
+			if (timer.pending && cudaEventQuery(timer.end) == cudaSuccess && cudaEventElapsedTime(&ms, timer.start, timer.end) == cudaSuccess)
+			{
+				_dynamicResolution.update(ms);
+				timer.pending = false;
+			}
+		}
+	}
+
+	const float scale = _dynamicResolution.scale();
+	_renderSize = sibr::Vector2u(DynamicResolution::scaled(_resolution.x(), scale), DynamicResolution::scaled(_resolution.y(), scale));
+}
+
+void sibr::HierarchyView::resizeView(const sibr::Vector2u& size)
+{
+	// Ring consumers expect a fixed frame size.
+	if (size.x() == 0 || size.y() == 0 || _frameRing)
+		return;
+
+	if (!m_cpu_raster)
+		cudaStreamSynchronize(renderStream);
+
+	const DisplayFormat format = BufferCopyRenderer::negotiate(_requestedFormat, size.x(), size.y());
+	if (format != _displayFormat)
+	{
+		// Pooled buffers have the old layout.
+		for (ImageBuffers& buffers : imagePool)
+			releaseImage(buffers);
+		imagePool.clear();
+		_copyRenderer.reset(new BufferCopyRenderer(format));
+		_copyRenderer->flip() = true;
+		_displayFormat = format;
+	}
+
+	_resolution = size;
+	useImageSize(size);
+
+	// The per-pixel rasterizer buffer only grows, the next frame sizes it for the new resolution.
+	if (imgPtr)
+	{
+		deviceArena.free(imgPtr);
+		imgPtr = nullptr;
+		allocdImg = 0;
+	}
+
+	if (_dynamicEnabled)
+	{
+		const float scale = _dynamicResolution.scale();
+		_renderSize = sibr::Vector2u(DynamicResolution::scaled(size.x(), scale), DynamicResolution::scaled(size.y(), scale));
+	}
+	else
+	{
+		_renderSize = size;
+	}
+	_idleSkip.invalidate();
+}
+
+void sibr::HierarchyView::useImageSize(const sibr::Vector2u& size)
+{
+	auto it = std::find_if(imagePool.begin(), imagePool.end(), [&size](const ImageBuffers& buffers) { return buffers.size == size; });
+	if (it == imagePool.end())
+	{
+		if (imagePool.size() >= kImagePoolSize)
+		{
+			auto oldest = std::min_element(imagePool.begin(), imagePool.end(), [](const ImageBuffers& a, const ImageBuffers& b) { return a.lastUse < b.lastUse; });
+			releaseImage(*oldest);
+			imagePool.erase(oldest);
+		}
+
+		ImageBuffers buffers;
+		buffers.size = size;
+		// Compact formats are rasterized into a device image and packed into the display buffer.
+		if (!m_cpu_raster && (m_headless || _displayFormat != DisplayFormat::Float))
+			deviceArena.alloc(&buffers.offscreen, sizeof(float) * 3 * size.x() * size.y(), DeviceMemory::Image);
+		if (!m_headless)
+		{
+			glCreateBuffers(1, &buffers.gl);
+			glNamedBufferStorage(buffers.gl, displayBytes(_displayFormat, size.x(), size.y()), nullptr, GL_DYNAMIC_STORAGE_BIT);
+		}
+		imagePool.push_back(buffers);
+		it = imagePool.end() - 1;
+	}
+
+	it->lastUse = ++imageUses;
+	currentImage = size_t(it - imagePool.begin());
+	imageBuffer = it->gl;
+	imageBufferCuda = it->cuda;
+	offscreen_cuda = it->offscreen;
+
+	// Host images keep their capacity, shrinking does not reallocate.
+	hostImage.resize(size_t(size.x()) * size.y() * 3);
+	if (m_cpu_raster && !m_headless && _displayFormat != DisplayFormat::Float)
+		hostDisplay.resize(displayBytes(_displayFormat, size.x(), size.y()) / sizeof(uint32_t));
+}
+
+void sibr::HierarchyView::releaseImage(ImageBuffers& buffers)
+{
+	if (buffers.cuda)
+		cudaGraphicsUnregisterResource(buffers.cuda);
+	deviceArena.free(buffers.offscreen);
+	if (buffers.gl)
+		glDeleteBuffers(1, &buffers.gl);
+	buffers = ImageBuffers();
+}
+
+float* sibr::HierarchyView::beginFrame()
+{
+	float* image_cuda = offscreen_cuda;
 	size_t bytes;
-	cudaGraphicsMapResources(1, &imageBufferCuda, renderStream);
-	cudaGraphicsResourceGetMappedPointer((void**)&image_cuda, &bytes, imageBufferCuda);
+	if (!m_cpu_raster && !m_headless)
+	{
+		ImageBuffers& buffers = imagePool[currentImage];
+		if (!buffers.cuda)
+			cudaGraphicsGLRegisterBuffer(&buffers.cuda, buffers.gl, cudaGraphicsRegisterFlagsWriteDiscard);
+		imageBufferCuda = buffers.cuda;
+		cudaGraphicsMapResources(1, &imageBufferCuda, renderStream);
+		cudaGraphicsResourceGetMappedPointer(&displayMapped, &bytes, imageBufferCuda);
+		if (_displayFormat == DisplayFormat::Float)
+			image_cuda = (float*)displayMapped;
+	}
+	return image_cuda;
+}
 
+void sibr::HierarchyView::stepMaintenance(const Lod::Viewpoint* views, int count)
+{
 	frame++;
 
 	buffered |= frame % cleanupFrequency == 0;
 
 	if (frame == 1 
-	|| (frame % 2 == 0 && updateResult.wait_for(std::chrono::seconds(0)) == std::future_status::ready))
+	|| m_lockstep
+	|| (frame % 2 == 0 && maintenanceReady()))
 	{
-		if (frame == 1)
+		// Nothing was started for these views: the first frame, or a lockstep
+		// pose that was not known yet when the previous frame was rendered.
+		// Run the step now, so the cut does not depend on when the pose arrived.
+		if (!maintenanceRunning)
 		{
-			updateResult = std::async(
-				std::launch::async, &sibr::HierarchyView::asyncTask,
-				this,
-				cam_pos,
-				zdir,
-				false);
+			postMaintenance(views, count, false);
+			_maintenanceKey = _frameKey;
 		}
 
-		auto res = updateResult.get();
+		auto res = waitMaintenance();
+		_idleSkip.maintained(_maintenanceKey, maintenanceCutChanged);
 
-		cudaStreamSynchronize(renderStream);
+		if (!m_cpu_raster)
+			cudaStreamSynchronize(renderStream);
 
 		std::swap(currSet, otherSet);
+		std::swap(currCut, otherCut);
 		if (std::get<0>(res) == otherMem)
 			std::swap(otherMem, currMem);
 
@@ -965,99 +1795,280 @@ void sibr::HierarchyView::onRenderIBR(sibr::IRenderTarget& dst, const sibr::Came
 			cudaStreamSynchronize(renderStream);
 		}
 
-		updateResult = std::async(
-			std::launch::async, &sibr::HierarchyView::asyncTask,
-			this,
-			cam_pos,
-			zdir,
-			buffered);
-		buffered = false;
+		if (m_lockstep)
+		{
+			// Only the step for the lookahead poses overlaps with this frame.
+			if (_lookahead)
+			{
+				Lod::Viewpoint next[kMaxSensors];
+				const int nextCount = std::min(_lookaheadCount, kMaxSensors);
+				viewpointsOf(_lookahead, nextCount, next);
+				postMaintenance(next, nextCount, buffered);
+				// Not the key of any rendered frame, the result never lets a frame be skipped.
+				_maintenanceKey = ~_frameKey;
+				buffered = false;
+			}
+		}
+		else
+		{
+			postMaintenance(views, count, buffered);
+			_maintenanceKey = _frameKey;
+			buffered = false;
+		}
 	}
+}
+
+void sibr::HierarchyView::rasterize(const sibr::Camera& eye, float* image_cuda, EyeShare share)
+{
+	auto view_mat = eye.view();
+	auto proj_mat = eye.viewproj();
+	view_mat.row(1) *= -1;
+	view_mat.row(2) *= -1;
+	proj_mat.row(1) *= -1;
+
+	auto t = view_mat.row(2).transpose();
+	Point zdir = { t.x(), t.y(), t.z() };
+
+	auto inv = view_mat.inverse();
+	*cam_pos = { inv(0, 3), inv(1, 3), inv(2, 3) };
 
 	float fovy = eye.fovy();
 	float fovx = 2.0f * atan(tan(eye.fovy() * 0.5f) * eye.aspect());
 	float tan_fovx = tan(fovx * 0.5f);
 	float tan_fovy = tan(fovy * 0.5f);
-	sizeLimit = tau2Limit(tau, tan_fovx, _resolution.x());
+	float limit = tau2Limit(tau, tan_fovx, _resolution.x());
 
-	if (showSfm)
+	*view_mat_ptr = view_mat;
+	*proj_mat_ptr = proj_mat;
+
+	Lod::Viewpoint view;
+	view.position = *cam_pos;
+	view.zdir = zdir;
+	if (_foveation.enabled())
+		view.foveation = foveationOf(eye);
+
+	// Both eyes of a pair blend the LOD levels as seen from their midpoint, so they match.
+	const Lod::Viewpoint& lodView = share == EyeShare::None ? view : _pairView;
+	const bool shared = share == EyeShare::Second;
+
+	if (m_cpu_raster)
 	{
-		_pointbasedrenderer->process(_scene->proxies()->proxy(), eye, dst);
+		renderHost(tan_fovx, tan_fovy, lodView, limit, share);
+		return;
 	}
-	else
+
+	int* parent_ptr = nullptr;
+	float* ts_ptr = nullptr;
+	int* kids_ptr = nullptr;
+	if (!disable_interp && (!m_use_cpu || currCut->parents_uploaded))
 	{
-		*view_mat_ptr = view_mat;
-		*proj_mat_ptr = proj_mat;
+		parent_ptr = currSet->parent_indices;
+		ts_ptr = ts_cuda;
+		kids_ptr = kids_cuda;
+	}
+
+	// The second eye of a pair reuses the weights of the first.
+	if (!shared)
+	{
+		if (!m_use_cpu)
+		{
+			Switching::getTsIndexed(
+				*currSet->to_render,
+				currSet->nodes_of_render_indices,
+				limit,
+				(int*)currMem->nodes_cuda,
+				(float*)currMem->boxes_cuda,
+				lodView.position.xyz[0], lodView.position.xyz[1], lodView.position.xyz[2],
+				lodView.zdir.xyz[0], lodView.zdir.xyz[1], lodView.zdir.xyz[2],
+				ts_cuda,
+				kids_cuda,
+				renderStream
+			);
+		}
+		else if (parent_ptr)
+		{
+			computeHostTs(lodView, limit);
+			cudaMemcpyAsync(ts_cuda, hostTs.data(), sizeof(float) * hostTs.size(), cudaMemcpyHostToDevice, renderStream);
+			cudaMemcpyAsync(kids_cuda, hostKids.data(), sizeof(int) * hostKids.size(), cudaMemcpyHostToDevice, renderStream);
+		}
+	}
+
+	CudaRasterizer::Rasterizer::forward(
+		geomBufferFunc,
+		binningBufferFunc,
+		imgBufferFunc,
+		*currSet->to_render + skyboxnum,
+		3,
+		16,
+		background_cuda,
+		_renderSize.x(), _renderSize.y(),
+		currSet->render_indices,
+		parent_ptr,
+		ts_ptr,
+		kids_ptr,
+		(float*)currMem->pos_cuda,
+		(float*)currMem->shs_cuda,
+		nullptr,
+		(float*)currMem->alpha_cuda,
+		(float*)currMem->scale_cuda,
+		_scalingModifier,
+		(float*)currMem->rot_cuda,
+		nullptr,
+		(float*)view_mat_ptr,
+		(float*)proj_mat_ptr,
+		(float*)cam_pos,
+		tan_fovx,
+		tan_fovy,
+		false,
+		image_cuda,
+		nullptr,
+		radii_cuda,
+		rect_cuda,
+		nullptr,
+		nullptr,
+		false,
+		skyboxnum,
+		renderStream,
+		renderhelper,
+		biglimit,
+		true
+	);
+}
 
-		int* parent_ptr = nullptr;
-		float* ts_ptr = nullptr;
-		int* kids_ptr = nullptr;
-		if (!disable_interp)
+void sibr::HierarchyView::endFrame(bool raster)
+{
+	if (m_cpu_raster)
+		return;
+
+	if (m_headless)
+	{
+		if (raster)
 		{
-			parent_ptr = currSet->parent_indices;
-			ts_ptr = ts_cuda;
-			kids_ptr = kids_cuda;
+			cudaMemcpyAsync(hostImage.data(), offscreen_cuda, sizeof(float) * hostImage.size(), cudaMemcpyDeviceToHost, renderStream);
+			cudaStreamSynchronize(renderStream);
 		}
+	}
+	else
+	{
+		if (raster && _displayFormat != DisplayFormat::Float)
+			packDisplayDevice(_displayFormat, offscreen_cuda, _renderSize.x(), _renderSize.y(), displayMapped, renderStream);
+		cudaGraphicsUnmapResources(1, &imageBufferCuda, renderStream);
+	}
+}
+
+bool sibr::HierarchyView::enableFrameRing(const std::string& name, int slots)
+{
+	std::unique_ptr<FrameRing> ring(new FrameRing());
+	const size_t bytes = sizeof(float) * 3 * _resolution.x() * _resolution.y();
+	if (!ring->create(name, (uint32_t)std::max(1, slots), _resolution.x(), _resolution.y(), FrameFormat::RGB32FPlanar, bytes))
+		return false;
+
+	// Pinning the mapping lets the device copy straight into the slots.
+	if (!m_cpu_raster)
+		_frameRingRegistered = cudaHostRegister(ring->mapping(), ring->mappingSize(), cudaHostRegisterDefault) == cudaSuccess;
+
+	_frameRing = std::move(ring);
+
+	// Ring frames have the full resolution.
+	if (_dynamicEnabled)
+		setDynamicResolution(0.0f, _dynamicResolution.options().minScale, _upscaleFilter);
+	return true;
+}
+
+void sibr::HierarchyView::publishFrame(const float* image_cuda, const FrameTag& tag)
+{
+	// Nobody to read the frame, do not stall the render stream for it.
+	_publishedFrame = 0;
+	if (!_frameRing->hasReaders())
+		return;
 
-		Switching::getTsIndexed(
-			*currSet->to_render,
-			currSet->nodes_of_render_indices,
-			sizeLimit,
-			(int*)currMem->nodes_cuda,
-			(float*)currMem->boxes_cuda,
-			cam_pos->xyz[0], cam_pos->xyz[1], cam_pos->xyz[2],
-			zdir.xyz[0], zdir.xyz[1], zdir.xyz[2],
-			ts_cuda,
-			kids_cuda,
-			renderStream
-		);
-
-		CudaRasterizer::Rasterizer::forward(
-			geomBufferFunc,
-			binningBufferFunc,
-			imgBufferFunc,
-			*currSet->to_render + skyboxnum,
-			3,
-			16,
-			background_cuda,
-			_resolution.x(), _resolution.y(),
-			currSet->render_indices,
+	void* slot = _frameRing->beginWrite();
+	if (image_cuda)
+	{
+		cudaMemcpyAsync(slot, image_cuda, _frameRing->frameBytes(), cudaMemcpyDeviceToHost, renderStream);
+		cudaStreamSynchronize(renderStream);
+	}
+	else
+	{
+		std::memcpy(slot, hostImage.data(), _frameRing->frameBytes());
+	}
+	_frameRing->endWrite(tag);
+	_publishedFrame = _frameRing->published();
+}
+
+void sibr::HierarchyView::renderHost(float tan_fovx, float tan_fovy, const Lod::Viewpoint& viewpoint, float limit, EyeShare share)
+{
+	const int* parent_ptr = nullptr;
+	if (!disable_interp)
+	{
+		if (share != EyeShare::Second)
+			computeHostTs(viewpoint, limit);
+		parent_ptr = currCut->parent_indices.data();
+	}
+
+	CpuRasterizer::Splats splats = {
+		(const float*)pos.data(), (const float*)rot.data(), (const float*)scale.data(), alpha.data(), (const float*)shs.data() };
+	CpuRasterizer::Splats sky = {
+		(const float*)skyboxpos.data(), (const float*)skyboxrot.data(), (const float*)skyboxscale.data(), skyboxalpha.data(), (const float*)skyboxsh.data() };
+
+	CpuRasterizer::View view = {
+		view_mat_ptr->data(),
+		proj_mat_ptr->data(),
+		*cam_pos,
+		tan_fovx,
+		tan_fovy,
+		(int)_renderSize.x(),
+		(int)_renderSize.y() };
+
+	const float background[3] = { 0.0f, 0.0f, 0.0f };
+	if (share == EyeShare::None)
+	{
+		cpuRasterizer.forward(
+			splats,
+			currCut->to_render(),
+			currCut->render_indices.data(),
 			parent_ptr,
-			ts_ptr,
-			kids_ptr,
-			(float*)currMem->pos_cuda,
-			(float*)currMem->shs_cuda,
-			nullptr,
-			(float*)currMem->alpha_cuda,
-			(float*)currMem->scale_cuda,
-			_scalingModifier,
-			(float*)currMem->rot_cuda,
-			nullptr,
-			(float*)view_mat_ptr,
-			(float*)proj_mat_ptr,
-			(float*)cam_pos,
-			tan_fovx,
-			tan_fovy,
-			false,
-			image_cuda,
-			nullptr,
-			radii_cuda,
-			rect_cuda,
-			nullptr,
-			nullptr,
-			false,
+			hostTs.data(),
+			hostKids.data(),
+			sky,
 			skyboxnum,
-			renderStream,
-			renderhelper,
-			biglimit,
-			true
-		);
+			_scalingModifier,
+			view,
+			background,
+			hostImage.data());
+	}
+	else
+	{
+		// Colors and covariances of the pair, the eyes are at most half their distance from the midpoint.
+		if (share == EyeShare::First)
+		{
+			cpuRasterizer.prepare(
+				splats,
+				currCut->to_render(),
+				currCut->render_indices.data(),
+				parent_ptr,
+				hostTs.data(),
+				hostKids.data(),
+				sky,
+				skyboxnum,
+				_scalingModifier,
+				viewpoint.position,
+				viewpoint.zdir,
+				0.5f * _eyeOffset.norm());
+		}
+		cpuRasterizer.render(view, background, hostImage.data());
 	}
 
-	cudaGraphicsUnmapResources(1, &imageBufferCuda, renderStream);
-	if (!showSfm)
+	if (m_headless)
+		return;
+	if (_displayFormat == DisplayFormat::Float)
 	{
-		_copyRenderer->process(imageBuffer, dst, _resolution.x(), _resolution.y());
+		glNamedBufferSubData(imageBuffer, 0, displayBytes(_displayFormat, _renderSize.x(), _renderSize.y()), hostImage.data());
+	}
+	else
+	{
+		packDisplay(_displayFormat, hostImage.data(), _renderSize.x(), _renderSize.y(), hostDisplay.data());
+		glNamedBufferSubData(imageBuffer, 0, displayBytes(_displayFormat, _renderSize.x(), _renderSize.y()), hostDisplay.data());
 	}
 }
 
@@ -1081,6 +2092,18 @@ void sibr::HierarchyView::onGUI()
 
 		ImGui::InputInt("Cleanup Rate", &cleanupFrequency);
 		cleanupFrequency = std::max(10, cleanupFrequency);
+		ImGui::SliderFloat("Compact at fragmentation", &compactionPolicy.triggerFragmentation, 0.01f, 0.9f);
+		ImGui::InputInt("Compaction slice (Gaussians)", &compactionPolicy.sliceGaussians);
+		compactionPolicy.sliceGaussians = std::max(1000, compactionPolicy.sliceGaussians);
+		ImGui::Text("Fragmentation %.1f%% (%d / %d nodes live)", 100.0f * lastMeasure.fragmentation(), lastMeasure.liveSlots, lastMeasure.usedSlots);
+		if (compactor.running())
+			ImGui::Text("Compacting: %d / %d Gaussians moved", compactor.movedGaussians(), compactor.plannedGaussians());
+
+		ImGui::SliderFloat("LOD Hysteresis", &hysteresis, 0.0f, 1.0f);
+		ImGui::Text("Flips %llu (last period %llu), held in band %llu", (unsigned long long)flips.totalFlips(), (unsigned long long)flips.lastPeriodFlips(), (unsigned long long)flips.lastPeriodHeld());
+
+		if (m_use_cpu)
+			ImGui::Text("CPU cut: %d nodes, %d Gaussians", (int)currCut->active_nodes.size(), currCut->to_render());
 
 		ImGui::Checkbox("Show Level", &show_level);
 		ImGui::Checkbox("Disable Interp", &disable_interp);
@@ -1091,10 +2114,135 @@ void sibr::HierarchyView::onGUI()
 		ImGui::PlotLines("Active Gauss", usage_vals, 100, 0, "", 0, GAUSS_MEMLIMIT, ImVec2(0, 80.f));
 
 		ImGui::InputFloat("Biglimit", &biglimit);
+
+		if (ImGui::CollapsingHeader("Foveation"))
+		{
+			float falloff = _foveation.falloff;
+			float radius = _foveation.radius * 180.0f / float(EIGEN_PI);
+			float maxFactor = _foveation.maxFactor;
+			bool changed = ImGui::SliderFloat("Falloff (per radian)", &falloff, 0.0f, 16.0f);
+			changed |= ImGui::SliderFloat("Fovea radius (deg)", &radius, 0.0f, 60.0f);
+			changed |= ImGui::SliderFloat("Max limit factor", &maxFactor, 1.0f, 32.0f);
+			if (changed)
+				setFoveation(falloff, radius, maxFactor);
+			ImGui::SliderFloat2("Focus", _foveaFocus, 0.0f, 1.0f);
+			if (!m_use_cpu)
+				ImGui::Text("Needs the CPU cut selection");
+		}
+
+		if (!m_headless && ImGui::CollapsingHeader("Idle skipping"))
+		{
+			ImGui::Checkbox("Skip unchanged frames", &_idleSkip.enabled);
+			ImGui::Text("Skipped %llu of %llu frames (%.1f%%), cut version %llu", (unsigned long long)_idleSkip.skipped(), (unsigned long long)_idleSkip.frames(),
+				100.0 * _idleSkip.skipRate(), (unsigned long long)_idleSkip.cutVersion());
+		}
+
+		if (!m_headless && !m_cpu_raster && ImGui::CollapsingHeader("Device memory"))
+		{
+			for (size_t c = 0; c < size_t(DeviceMemory::Count); c++)
+			{
+				const DeviceMemory category = DeviceMemory(c);
+				ImGui::Text("%-9s %8.1f MB, peak %8.1f MB", deviceMemoryName(category), deviceArena.live(category) / 1e6, deviceArena.peak(category) / 1e6);
+			}
+			ImGui::Text("Reserved %.1f MB, pinned host %.1f MB", deviceArena.reserved() / 1e6, deviceArena.pinnedHost() / 1e6);
+		}
+
+		if (!m_headless && ImGui::CollapsingHeader("Dynamic resolution"))
+		{
+			bool enabled = _dynamicEnabled;
+			float target = _dynamicResolution.options().targetMs;
+			float minScale = _dynamicResolution.options().minScale;
+			int filter = int(_upscaleFilter);
+			const char* filters[] = { "nearest", "bilinear", "bicubic" };
+			bool changed = ImGui::Checkbox("Enabled", &enabled);
+			changed |= ImGui::InputFloat("Target render ms", &target);
+			changed |= ImGui::SliderFloat("Min scale", &minScale, 0.25f, 1.0f);
+			changed |= ImGui::Combo("Upscale", &filter, filters, 3);
+			if (changed)
+				setDynamicResolution(enabled ? std::max(target, 0.1f) : 0.0f, minScale, UpscaleFilter(filter));
+			ImGui::Text("Render %ux%u (scale %.2f), %.2f ms, %llu changes", _renderSize.x(), _renderSize.y(), _dynamicResolution.scale(), _dynamicResolution.smoothedMs(), (unsigned long long)_dynamicResolution.changes());
+		}
+
+		if (_poseTelemetry && ImGui::CollapsingHeader("Pose channel"))
+		{
+			uint64_t counts[PoseHistogram::kBuckets];
+			const uint64_t last = _poseTelemetry->lastPacket();
+			ImGui::Text("%.1f packets/s, last %.1f ms ago", _poseTelemetry->packetRate(), last ? (PoseTelemetry::now() - last) * 1e-3 : 0.0);
+			ImGui::Text("Packets %llu, parse failures %llu, superseded %llu", (unsigned long long)_poseTelemetry->packets(), (unsigned long long)_poseTelemetry->parseFailures(), (unsigned long long)_poseTelemetry->supersededPackets());
+			ImGui::Text("Applied %llu, overwritten %llu", (unsigned long long)_poseTelemetry->appliedPoses(), (unsigned long long)_poseTelemetry->overwritten());
+			_poseTelemetry->interArrival().snapshot(counts);
+			ImGui::Text("Inter-arrival p50 %llu us, p99 %llu us", (unsigned long long)PoseHistogram::percentile(counts, 0.5), (unsigned long long)PoseHistogram::percentile(counts, 0.99));
+			_poseTelemetry->jitter().snapshot(counts);
+			ImGui::Text("Jitter p50 %llu us, p99 %llu us", (unsigned long long)PoseHistogram::percentile(counts, 0.5), (unsigned long long)PoseHistogram::percentile(counts, 0.99));
+			_poseTelemetry->queueLatency().snapshot(counts);
+			ImGui::Text("Queue latency p50 %llu us, p99 %llu us", (unsigned long long)PoseHistogram::percentile(counts, 0.5), (unsigned long long)PoseHistogram::percentile(counts, 0.99));
+		}
+
+		if (_latencyTrace && ImGui::CollapsingHeader("Latency"))
+		{
+			uint64_t counts[PoseHistogram::kBuckets];
+			ImGui::Text("Poses traced %llu", (unsigned long long)_latencyTrace->samples());
+			for (int s = 0; s < LatencyTrace::StageCount; s++)
+			{
+				_latencyTrace->histogram(s).snapshot(counts);
+				ImGui::Text("%-8s p50 %llu us, p99 %llu us", LatencyTrace::stageName(s), (unsigned long long)PoseHistogram::percentile(counts, 0.5), (unsigned long long)PoseHistogram::percentile(counts, 0.99));
+			}
+
+			const char* stages[LatencyTrace::StageCount];
+			for (int s = 0; s < LatencyTrace::StageCount; s++)
+				stages[s] = LatencyTrace::stageName(s);
+			ImGui::Combo("Stage", &_latencyStage, stages, LatencyTrace::StageCount);
+
+			// Up to the highest non-empty bucket, log-spaced like PoseHistogram.
+			_latencyTrace->histogram(_latencyStage).snapshot(counts);
+			float bars[PoseHistogram::kBuckets];
+			int used = 1;
+			for (int b = 0; b < PoseHistogram::kBuckets; b++)
+			{
+				bars[b] = (float)counts[b];
+				if (counts[b])
+					used = b + 1;
+			}
+			ImGui::PlotHistogram("##latency", bars, used, 0, "", 0, FLT_MAX, ImVec2(0, 80.f));
+			ImGui::Text("Last bucket up to %llu us", (unsigned long long)PoseHistogram::bucketLimit(used - 1));
+		}
 	}
 	ImGui::End();
 }
 
 sibr::HierarchyView::~HierarchyView()
 {
+	if (_frameRingRegistered)
+		cudaHostUnregister(_frameRing->mapping());
+
+	if (!m_cpu_raster)
+		cudaStreamSynchronize(renderStream);
+	for (ImageBuffers& buffers : imagePool)
+		releaseImage(buffers);
+
+	for (RenderTimer& timer : _renderTimers)
+	{
+		if (timer.start)
+			cudaEventDestroy(timer.start);
+		if (timer.end)
+			cudaEventDestroy(timer.end);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(maintenanceMutex);
+		maintenanceStop = true;
+	}
+	maintenanceCv.notify_all();
+	if (maintenanceThread.joinable())
+		maintenanceThread.join();
+
+	// The switching code grows its scratch space itself, everything else goes with the arena.
+	if (!m_cpu_raster)
+	{
+		cudaDeviceSynchronize();
+		if (scratchspace)
+			cudaFree(scratchspace);
+		cudaStreamDestroy(renderStream);
+		cudaStreamDestroy(maintenanceStream);
+	}
 }
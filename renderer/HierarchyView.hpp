@@ -27,9 +27,24 @@
 #include <cuda_runtime.h>
 #include <cuda_gl_interop.h>
 #include "common.h"
+#include "Compaction.hpp"
+#include "LodHysteresis.hpp"
+#include "LodMath.hpp"
+#include "CpuSwitching.hpp"
+#include "CpuRasterizer.hpp"
+#include "PoseTelemetry.hpp"
+#include "LatencyTrace.hpp"
+#include "FrameRing.hpp"
+#include "DisplayFormat.hpp"
+#include "DynamicResolution.hpp"
+#include "IdleSkip.hpp"
+#include "DeviceArena.hpp"
 #include <types.h>
 #include <chrono>
-#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 
 typedef Eigen::Matrix<float, 48, 1> SHs;
 
@@ -52,8 +67,12 @@ namespace sibr {
 		 * \param ibrScene The scene to use for rendering.
 		 * \param render_w rendering width
 		 * \param render_h rendering height
+		 * \param useCpu select the cut on the CPU instead of with the switching kernels
+		 * \param cpuRaster render on the CPU as well, no CUDA resource is created (implies useCpu)
+		 * \param headless no GL resource is created, frames are only available through renderOffscreen
+		 * \param displayFormat layout of the buffer the copy pass reads, may be made more compact if the GL context cannot hold it
 		 */
-		HierarchyView(const sibr::BasicIBRScene::Ptr& ibrScene, uint render_w, uint render_h, const char* file, const char* scaffoldfile, int64_t budget);
+		HierarchyView(const sibr::BasicIBRScene::Ptr& ibrScene, uint render_w, uint render_h, const char* file, const char* scaffoldfile, int64_t budget, bool useCpu = false, bool cpuRaster = false, bool headless = false, DisplayFormat displayFormat = DisplayFormat::Float);
 
 		/** Replace the current scene.
 		 *\param newScene the new scene to render */
@@ -66,6 +85,27 @@ namespace sibr {
 		 */
 		void onRenderIBR(sibr::IRenderTarget& dst, const sibr::Camera& eye) override;
 
+		/**
+		 * Render without any GL context.
+		 * \param eye The novel viewpoint.
+		 * \return the image as planar RGB floats, valid until the next call
+		 */
+		const std::vector<float>& renderOffscreen(const sibr::Camera& eye);
+
+		/** Most cameras rendered from one shared cut by renderSensors. */
+		static constexpr int kMaxSensors = 8;
+
+		/**
+		 * Render several cameras of a rig from one cut that satisfies all of
+		 * them, without any GL context. The maintenance step runs once for the
+		 * whole rig, then every camera is rasterized from the same resident
+		 * Gaussians. More than one camera needs the CPU cut selection.
+		 * \param eyes cameras, all rendered at the view resolution
+		 * \param count number of cameras, 1 to kMaxSensors
+		 * \return count planar RGB float images back to back, valid until the next call
+		 */
+		const std::vector<float>& renderSensors(const sibr::Camera* eyes, int count);
+
 		/**
 		 * Update inputs (do nothing).
 		 * \param input The inputs state.
@@ -77,6 +117,85 @@ namespace sibr {
 		 */
 		void onGUI() override;
 
+		/**
+		 * Publish every rendered frame to a shared memory ring.
+		 * \param name POSIX shared memory name, e.g. "/hierarchy_frames"
+		 * \param slots number of frames kept
+		 * \return false if the ring could not be created
+		 */
+		bool enableFrameRing(const std::string& name, int slots);
+
+		/**
+		 * Render below the display resolution while the render time is over
+		 * targetMs, the copy pass upscales with filter. Windowed views only, and
+		 * disabled while frames are published to a frame ring.
+		 * \param targetMs render time to keep under, 0 to always render at full resolution
+		 * \param minScale lowest per-axis scale
+		 */
+		void setDynamicResolution(float targetMs, float minScale, UpscaleFilter filter);
+
+		/**
+		 * Coarser LOD away from a focus point. Needs the CPU cut selection, the
+		 * switching kernels only know a single size limit.
+		 * \param falloff growth of the size limit per radian beyond radius, 0 disables foveation
+		 * \param radiusDegrees half angle around the focus kept at the full size limit
+		 * \param maxFactor coarsest limit, as a multiple of the full one
+		 */
+		void setFoveation(float falloff, float radiusDegrees, float maxFactor);
+
+		/** Focus point in normalized image coordinates, x right, y down, (0.5, 0.5) being the center. */
+		void setFoveaFocus(float x, float y) { _foveaFocus[0] = x; _foveaFocus[1] = y; }
+
+		/** \return the size the next frame is rendered at. */
+		const sibr::Vector2u& renderSize() const { return _renderSize; }
+
+		/**
+		 * Show the last image again instead of rendering when the camera, the
+		 * render settings and the cut are unchanged. The maintenance step is
+		 * paused as well until something changes. Windowed views only.
+		 */
+		void setIdleSkip(bool enabled) { _idleSkip.enabled = enabled; }
+
+		/** \return the skip decisions and their counters. */
+		IdleSkip& idleSkip() { return _idleSkip; }
+
+		/**
+		 * Stereo mode: onRenderIBR is called for the left then the right eye of
+		 * every frame, as StereoAnaglyphRdrMode does. The pair runs one
+		 * maintenance step whose cut satisfies both eyes, and shares the LOD
+		 * interpolation weights, taken at the midpoint of the eyes. The CPU
+		 * backend also shares the interpolated Gaussians, their 3D covariances
+		 * and their colors. Idle skipping is off, the image buffer only keeps the
+		 * right eye.
+		 */
+		void setStereo(bool stereo) { _stereo = stereo; _secondEye = false; }
+
+		/**
+		 * Lockstep mode: every frame is rendered with the cut maintained for its
+		 * own poses, so the cut only depends on the sequence of rendered poses.
+		 * The step for the lookahead pose starts before rasterization so it
+		 * overlaps with it; without lookahead the frame runs its own step first.
+		 */
+		void setLockstep(bool lockstep) { m_lockstep = lockstep; }
+
+		/** Cameras the next frame will be rendered from in lockstep mode, nullptr if unknown (the current ones are used). */
+		void setLookahead(const sibr::Camera* next, int count = 1) { _lookahead = next; _lookaheadCount = count; }
+
+		/** \return the number of the frame just published to the frame ring, 0 if none (no ring or no reader attached). */
+		uint64_t publishedFrame() const { return _publishedFrame; }
+
+		/** Pose identification stored with the next published frames. Also starts the latency stamps of the frame. */
+		void setFrameTag(const FrameTag& tag);
+
+		/** \return the latency stamps of the current frame, arrival to render end. */
+		const LatencyStamps& frameStamps() const { return _frameStamps; }
+
+		/** Show the motion-to-photon histograms in the GUI, nullptr to hide them. */
+		void setLatencyTrace(const LatencyTrace* trace) { _latencyTrace = trace; }
+
+		/** Show the stats of the pose channel in the GUI, nullptr to hide them. */
+		void setPoseTelemetry(const PoseTelemetry* telemetry) { _poseTelemetry = telemetry; }
+
 		/** \return a reference to the scene */
 		const std::shared_ptr<sibr::BasicIBRScene>& getScene() const { return _scene; }
 
@@ -85,10 +204,21 @@ namespace sibr {
 	protected:
 
 		float biglimit = 30.0f;
-		int cleanupFrequency = 100;
+		int cleanupFrequency = 100; ///< Frames between two fragmentation measurements.
 
 		float tau = 9.0f;
 		float sizeLimit = 0.03f;
+		/**
+		 * Ratio between the expand and collapse thresholds minus one, 0 (the default) disables the band.
+		 * The CPU cut applies the band to every node. The switching kernels only take one limit, so on
+		 * the GPU path they run with the collapse threshold and the band only holds back uploads of
+		 * children that are not resident yet; nodes whose children are resident still switch at the
+		 * collapse threshold alone.
+		 */
+		float hysteresis = 0.0f;
+		Lod::Band lodBand = { 0.03f, 0.03f };
+		Lod::FlipCounter flips;
+		int maintenanceStep = 0;
 
 		int GAUSS_MEMLIMIT = 16000000;
 
@@ -114,7 +244,34 @@ namespace sibr {
 			int* render_indices;
 		};
 
-		std::future< std::tuple<sibr::HierarchyView::MemSet*, int, int>> updateResult;
+		/** Hand a maintenance step for count cameras to the worker thread, views are copied. */
+		void postMaintenance(const Lod::Viewpoint* views, int count, bool measure);
+
+		/** \return true once the posted maintenance step is done. */
+		bool maintenanceReady();
+
+		/** Wait for the posted maintenance step and return its result, rethrowing its error. */
+		std::tuple<sibr::HierarchyView::MemSet*, int, int> waitMaintenance();
+
+		/** Body of the maintenance thread, kept alive for the lifetime of the view so steps do not allocate. */
+		void maintenanceLoop();
+
+		std::thread maintenanceThread;
+		std::mutex maintenanceMutex;
+		std::condition_variable maintenanceCv;
+		bool maintenancePending = false;
+		bool maintenanceDone = false;
+		bool maintenanceStop = false;
+		Lod::Viewpoint maintenanceViews[kMaxSensors];
+		int maintenanceViewCount = 0;
+		bool maintenanceMeasure = false;
+		std::tuple<sibr::HierarchyView::MemSet*, int, int> maintenanceResult;
+		std::exception_ptr maintenanceError;
+		bool maintenanceCutChanged = true; ///< Set by the maintenance task, read once waitMaintenance returned.
+		bool maintenanceRunning = false; ///< A step was posted and not waited for yet. Render thread only.
+
+		std::vector<int> packageIndices;
+		std::vector<int> packageParentCudaIndices;
 
 		MemSet mems[2];
 		MemSet* currMem = nullptr;
@@ -135,7 +292,9 @@ namespace sibr {
 			const int* indices_to_expand_cuda,
 			std::vector<int>& node_indices,
 			std::vector<int>& cuda_parent_indices,
-			int* cuda_parent_starts
+			int* cuda_parent_starts,
+			const Point& viewpoint,
+			const Point& zdir
 		);
 
 		std::vector<sibr::Vector3f> pos;
@@ -150,22 +309,44 @@ namespace sibr {
 		int* package_parent_cuda_starts;
 		int* need_children;
 
-		int* new_node_count;
-		int* new_gauss_count;
-
 		int* newN, * newG, *newE;
 
 		int* cuda2cpu;
-		int* cuda2cpu1_cuda;
-		int* cuda2cpu2_cuda;
 
 		float usage_vals[100];
 		int frame = 0;
 
 		int* radii_cuda;
 
-		GLuint imageBuffer;
-		cudaGraphicsResource_t imageBufferCuda;
+		GLuint imageBuffer = 0;
+		cudaGraphicsResource_t imageBufferCuda = nullptr;
+		float* offscreen_cuda = nullptr; ///< Device image when headless (downloaded to hostImage) or the display format is compact (packed into imageBuffer).
+		void* displayMapped = nullptr; ///< imageBuffer while mapped for the frame.
+		DisplayFormat _displayFormat = DisplayFormat::Float;
+		DisplayFormat _requestedFormat = DisplayFormat::Float;
+
+		/** Image buffers of one view resolution, pooled so resizing back to it is free. */
+		struct ImageBuffers
+		{
+			sibr::Vector2u size;
+			GLuint gl = 0;
+			cudaGraphicsResource_t cuda = nullptr; ///< Registered the first time the device path maps it.
+			float* offscreen = nullptr;
+			uint64_t lastUse = 0;
+		};
+		static constexpr size_t kImagePoolSize = 4;
+		std::vector<ImageBuffers> imagePool;
+		size_t currentImage = 0;
+		uint64_t imageUses = 0;
+
+		/** Make the buffers of size current, creating them if the pool has none and dropping the least recently used ones. */
+		void useImageSize(const sibr::Vector2u& size);
+
+		/** Free the GL buffer, CUDA registration and device image of buffers. */
+		void releaseImage(ImageBuffers& buffers);
+
+		/** Follow a new view resolution, e.g. after the sub-view was resized. */
+		void resizeView(const sibr::Vector2u& size);
 
 		bool showSfm = false;
 
@@ -185,8 +366,11 @@ namespace sibr {
 		float _zfar = -1;
 
 		std::shared_ptr<sibr::BasicIBRScene> _scene; ///< The current scene.
+		const PoseTelemetry* _poseTelemetry = nullptr;
+		const LatencyTrace* _latencyTrace = nullptr;
+		int _latencyStage = LatencyTrace::Total;
 		PointBasedRenderer::Ptr _pointbasedrenderer;
-		BufferCopyRenderer* _copyRenderer;
+		std::unique_ptr<BufferCopyRenderer> _copyRenderer;
 
 		std::vector<int> activenodes1;
 		std::vector<int> activenodes2;
@@ -195,7 +379,183 @@ namespace sibr {
 		std::vector<Node> nodes;
 		std::vector<Box> boxes;
 
-		std::tuple<sibr::HierarchyView::MemSet*, int, int> asyncTask(Point* campos, Point zdir, bool cleanup);
+		std::tuple<sibr::HierarchyView::MemSet*, int, int> asyncTask(const Lod::Viewpoint* views, int count, bool measure);
+
+		/** Run the maintenance step and, if raster is set, render eye into the image buffer. */
+		void renderImage(const sibr::Camera& eye, bool raster);
+
+		/** Map the image buffer for this frame. \return the device image, null when rasterizing on the host */
+		float* beginFrame();
+
+		/** Swap in the result of the running maintenance step if it is due and start the next one for views. */
+		void stepMaintenance(const Lod::Viewpoint* views, int count);
+
+		/** What a render shares with the other eye of a stereo pair. */
+		enum class EyeShare
+		{
+			None,   ///< Not part of a pair.
+			First,  ///< Computes the shared state at _pairView.
+			Second, ///< Reuses the shared state of the first eye.
+		};
+
+		/** Render eye from the current cut into image_cuda, or hostImage on the CPU backend. */
+		void rasterize(const sibr::Camera& eye, float* image_cuda, EyeShare share = EyeShare::None);
+
+		/** Stereo counterpart of renderImage, the first eye also runs the maintenance step of the pair. */
+		void renderEye(const sibr::Camera& eye, bool raster, bool second);
+
+		bool _stereo = false;
+		bool _secondEye = false;  ///< The next onRenderIBR renders the right eye.
+		sibr::Vector3f _eyeOffset = sibr::Vector3f::Zero(); ///< Right eye position in the frame of the left one, from the last pair.
+		sibr::Vector3f _leftPosition = sibr::Vector3f::Zero();
+		sibr::Quaternionf _leftRotation = sibr::Quaternionf::Identity();
+		Lod::Viewpoint _pairView; ///< Midpoint of the eyes, with the direction of the left one.
+
+		/** Download or unmap the image buffer. */
+		void endFrame(bool raster);
+
+		/** Copy the frame just rendered (device image, or hostImage if null) to the frame ring. */
+		void publishFrame(const float* image_cuda, const FrameTag& tag);
+
+		/**
+		 * Camera positions and viewing directions as used by the maintenance step.
+		 * Sizes are scaled to the field of view of the first camera.
+		 */
+		void viewpointsOf(const sibr::Camera* eyes, int count, Lod::Viewpoint* views) const;
+
+		Lod::Foveation _foveation;
+		float _foveaFocus[2] = { 0.5f, 0.5f };
+
+		/** \return _foveation with its focus turned into a world direction seen from eye. */
+		Lod::Foveation foveationOf(const sibr::Camera& eye) const;
+
+		/** \return the tangent of half the horizontal field of view of eye. */
+		static float tanHalfFovx(const sibr::Camera& eye);
+
+		IdleSkip _idleSkip;
+		uint64_t _frameKey = 0;       ///< Key of the frame being rendered.
+		uint64_t _maintenanceKey = 0; ///< Key of the frame the running maintenance step was started from.
+
+		/** \return the key of everything the image of eye depends on besides the cut. */
+		uint64_t frameKey(const sibr::Camera& eye) const;
+
+		bool m_lockstep = false;
+		const sibr::Camera* _lookahead = nullptr;
+		int _lookaheadCount = 0;
+
+		std::vector<float> sensorImages;
+
+		std::unique_ptr<FrameRing> _frameRing;
+		bool _frameRingRegistered = false;
+		uint64_t _publishedFrame = 0;
+		FrameTag _frameTag;
+		LatencyStamps _frameStamps;
+
+		sibr::Vector2u _renderSize; ///< At most _resolution, smaller with dynamic resolution.
+		DynamicResolution _dynamicResolution;
+		bool _dynamicEnabled = false;
+		UpscaleFilter _upscaleFilter = UpscaleFilter::Bicubic;
+
+		/** Render time of one frame on the render stream. */
+		struct RenderTimer
+		{
+			cudaEvent_t start = nullptr;
+			cudaEvent_t end = nullptr;
+			bool pending = false;
+		};
+		static constexpr int kRenderTimers = 2;
+		RenderTimer _renderTimers[kRenderTimers];
+		int _renderTimerSlot = 0;
+		uint64_t _hostRenderStart = 0;
+		float _hostRenderMs = 0.0f;
+
+		/** Time the rasterization for the dynamic resolution, events on the GPU backend. */
+		void startRenderTimer();
+		void stopRenderTimer();
+
+		/** Feed the finished render times to the dynamic resolution and size the next frame. */
+		void updateRenderSize();
+
+		/** Stamp the render begin (first view of the frame only) or the render end of the current frame. */
+		void stampRender(bool begin);
+
+		/** Allocate the device buffers, streams and the CUDA registered image buffer. */
+		void initDevice(uint render_w, uint render_h);
+
+		/** Set up the host-only backend. */
+		void initHost(uint render_w, uint render_h);
+
+		/** Rasterize the current host cut on the CPU into hostImage and upload it to imageBuffer. */
+		void renderHost(float tan_fovx, float tan_fovy, const Lod::Viewpoint& viewpoint, float limit, EyeShare share);
+
+		/** Compute the interpolation weights of the current host cut into hostTs and hostKids. */
+		void computeHostTs(const Lod::Viewpoint& view, float limit);
+
+		std::vector<float> hostTs;
+		std::vector<int> hostKids;
+
+		// Residency of the host cut on the device: Gaussians of the nodes that enter the cut are
+		// appended to the current MemSet, so whatever the frame being rendered reads stays in place.
+		std::vector<int> hostSlot;      ///< First slot of a resident node, -1 if not resident.
+		std::vector<int> hostSlotCount; ///< Gaussians resident for a node: all of them, or only the first for a parent.
+		std::vector<int> hostNeed;      ///< Gaussians the new cut needs for a node, -1 for a parent only.
+		std::vector<int> hostNeedStamp; ///< hostStamp of the step that set hostNeed.
+		std::vector<int> hostNeeded;
+		std::vector<int> hostResident;
+		std::vector<int> hostParents;
+		int hostStamp = 0;
+
+		CpuRasterizer::Rasterizer cpuRasterizer;
+		std::vector<float> hostImage;
+		std::vector<uint32_t> hostDisplay; ///< hostImage packed to a compact display format before the upload.
+		Point hostCamPos, hostCamPosOld;
+		sibr::Matrix4f hostView, hostProj;
+		int hostToRender[2];
+
+		std::vector<sibr::Vector3f> skyboxpos;
+		std::vector<sibr::Vector4f> skyboxrot;
+		std::vector<SHs> skyboxsh;
+		std::vector<float> skyboxalpha;
+		std::vector<sibr::Vector3f> skyboxscale;
+
+		/** Maintenance step of the CPU backend: select the cut on the host and upload it if it changed. */
+		std::tuple<sibr::HierarchyView::MemSet*, int, int> cpuTask(const Lod::Viewpoint* views, int count);
+
+		/**
+		 * Upload the Gaussians of the nodes entering a host cut, and of the parents it blends
+		 * towards if they fit, then the render and parent indices of the cut into useSet.
+		 * \param uploaded Gaussians copied from the host
+		 * \return the MemSet the cut is resident in, otherMem if the store had to be compacted
+		 */
+		MemSet* uploadCut(CpuSwitching::Cut& cut, LightSet* useSet, int& uploaded);
+
+		CpuSwitching::State cpuState;
+		CpuSwitching::Cut cpuCuts[2];
+		CpuSwitching::Cut* currCut = &cpuCuts[0];
+		CpuSwitching::Cut* otherCut = &cpuCuts[1];
+
+		/** Download the active slots of the current step into activeHost. */
+		void fetchActiveNodes();
+
+		/** Move Gaussian payload runs from one MemSet to the other with one kernel on the maintenance stream. */
+		void copyRuns(const std::vector<Compaction::Run>& runs, MemSet* from, MemSet* to);
+
+		/** Complete the running compaction into otherMem and redo the step on it.
+		 * \return the MemSet to render from */
+		MemSet* finishCompaction(Point zdir);
+
+		Compaction::Policy compactionPolicy;
+		Compaction::Compactor compactor;
+		Compaction::Measure lastMeasure;
+		bool compactionDrained = false;
+		std::vector<Compaction::Slot> resident;
+		std::vector<Compaction::Run> compactionRuns;
+		Compaction::Run* compactionRuns_cuda = nullptr;
+		size_t compactionRunsCapacity = 0;
+		std::vector<char> liveHost;
+		std::vector<int> activeHost;
+		std::vector<int> splitsHost;
+		std::vector<int> splitsRemapped;
 
 		int* activenodes1_cuda;
 		int* activenodes2_cuda;
@@ -231,10 +591,15 @@ namespace sibr {
 		bool disable_interp = false;
 		bool show_level = false;
 		bool m_use_cpu = false;
+		bool m_cpu_raster = false;
+		bool m_headless = false;
 
 		cudaStream_t renderStream;
 		cudaStream_t maintenanceStream;
 
+		/** Owns every device and pinned buffer of the view except the switching scratch space. */
+		DeviceArena deviceArena;
+
 		int* NsrcI, *NsrcI2;
 		int* NdstI, * NdstI2;
 		int* numI;
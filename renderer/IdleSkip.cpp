@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "IdleSkip.hpp"
+
+namespace sibr {
+
+	FrameKey& FrameKey::add(const void* data, size_t bytes)
+	{
+		const unsigned char* p = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < bytes; i++)
+		{
+			_hash ^= p[i];
+			_hash *= 1099511628211ull;
+		}
+		return *this;
+	}
+
+	bool IdleSkip::skip(uint64_t key)
+	{
+		_frames++;
+		if (enabled && _valid && _settled && key == _lastKey)
+		{
+			_skipped++;
+			return true;
+		}
+
+		if (!_valid || key != _lastKey)
+			_settled = false;
+		_lastKey = key;
+		_valid = true;
+		return false;
+	}
+
+	void IdleSkip::maintained(uint64_t key, bool cutChanged)
+	{
+		if (cutChanged)
+			_cutVersion++;
+		// A step started from an older key says nothing about the current frame.
+		_settled = !cutChanged && _valid && key == _lastKey;
+	}
+
+	void IdleSkip::report(std::ostream& out)
+	{
+		const uint64_t frames = _frames - _reportFrames;
+		const uint64_t skipped = _skipped - _reportSkipped;
+		out << "[idle] " << skipped << " of " << frames << " frames skipped (" << (frames ? 100.0 * skipped / frames : 0.0) << "%)"
+			<< ", " << _cutVersion - _reportCutVersion << " cut changes"
+			<< std::endl;
+
+		_reportFrames = _frames;
+		_reportSkipped = _skipped;
+		_reportCutVersion = _cutVersion;
+	}
+
+}
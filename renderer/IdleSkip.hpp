@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+
+#pragma once
+
+# include "Config.hpp"
+# include <cstddef>
+# include <cstdint>
+# include <ostream>
+
+namespace sibr {
+
+	/** FNV-1a hash of everything a frame is rendered from. */
+	class SIBR_EXP_ULR_EXPORT FrameKey
+	{
+	public:
+
+		FrameKey& add(const void* data, size_t bytes);
+
+		template<typename T>
+		FrameKey& add(const T& value) { return add(&value, sizeof(T)); }
+
+		uint64_t value() const { return _hash; }
+
+	private:
+
+		uint64_t _hash = 14695981039346656037ull;
+	};
+
+	/**
+	 * Decides when a frame can show the last image again. A frame is skipped
+	 * if its key equals the one of the last rendered frame and a maintenance
+	 * step computed for that key left the cut as it was, so the cut has
+	 * settled and rendering again would give the same image.
+	 */
+	class SIBR_EXP_ULR_EXPORT IdleSkip
+	{
+	public:
+
+		/**
+		 * Called once per frame.
+		 * \param key key of the frame inputs
+		 * \return true if the last image can be shown instead of rendering
+		 */
+		bool skip(uint64_t key);
+
+		/**
+		 * Called when the result of a maintenance step is swapped in.
+		 * \param key key of the frame the step was started from
+		 * \param cutChanged the step changed the resident set or the cut
+		 */
+		void maintained(uint64_t key, bool cutChanged);
+
+		/** Render the next frame whatever its key, e.g. after the image buffer was lost. */
+		void invalidate() { _valid = false; _settled = false; }
+
+		bool enabled = false;
+
+		/** \return the number of maintenance steps that changed the cut. */
+		uint64_t cutVersion() const { return _cutVersion; }
+
+		uint64_t frames() const { return _frames; }
+		uint64_t skipped() const { return _skipped; }
+
+		/** \return the fraction of all frames that were skipped. */
+		double skipRate() const { return _frames ? double(_skipped) / _frames : 0.0; }
+
+		/** Write the skip rate of the period since the last report and start a new period. */
+		void report(std::ostream& out);
+
+	private:
+
+		uint64_t _lastKey = 0;
+		bool _valid = false;
+		bool _settled = false;
+		uint64_t _cutVersion = 0;
+		uint64_t _frames = 0;
+		uint64_t _skipped = 0;
+		uint64_t _reportFrames = 0;
+		uint64_t _reportSkipped = 0;
+		uint64_t _reportCutVersion = 0;
+	};
+
+}
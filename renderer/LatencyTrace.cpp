@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "LatencyTrace.hpp"
+
+namespace sibr {
+
+	namespace {
+
+		uint64_t span(uint64_t from, uint64_t to)
+		{
+			return from != 0 && to >= from ? to - from : 0;
+		}
+
+	}
+
+	const char* LatencyTrace::stageName(int stage)
+	{
+		static const char* names[StageCount] = { "queue", "wait", "render", "present", "total" };
+		return stage >= 0 && stage < StageCount ? names[stage] : "";
+	}
+
+	bool LatencyTrace::openCsv(const std::string& path)
+	{
+		_csv.open(path);
+		if (!_csv)
+			return false;
+		_csv << "arrival_us";
+		for (int s = 0; s < StageCount; s++)
+			_csv << "," << stageName(s) << "_us";
+		_csv << "\n";
+		return true;
+	}
+
+	void LatencyTrace::record(const LatencyStamps& stamps)
+	{
+		if (stamps.arrival == 0 || stamps.arrival == _lastArrival || stamps.presented == 0)
+			return;
+		_lastArrival = stamps.arrival;
+
+		// A missing stamp folds its stage into the next one, the total stays exact.
+		const uint64_t applied = stamps.applied ? stamps.applied : stamps.arrival;
+		const uint64_t begin = stamps.renderBegin ? stamps.renderBegin : applied;
+		const uint64_t end = stamps.renderEnd ? stamps.renderEnd : begin;
+		uint64_t values[StageCount];
+		values[Queue] = span(stamps.arrival, applied);
+		values[Wait] = span(applied, begin);
+		values[Render] = span(begin, end);
+		values[Present] = span(end, stamps.presented);
+		values[Total] = span(stamps.arrival, stamps.presented);
+
+		for (int s = 0; s < StageCount; s++)
+			_histograms[s].add(values[s]);
+		_samples++;
+
+		if (_csv.is_open())
+		{
+			_csv << stamps.arrival;
+			for (int s = 0; s < StageCount; s++)
+				_csv << "," << values[s];
+			_csv << "\n";
+		}
+	}
+
+	void LatencyTrace::writeHistograms(std::ostream& out) const
+	{
+		uint64_t counts[StageCount][PoseHistogram::kBuckets];
+		for (int s = 0; s < StageCount; s++)
+			_histograms[s].snapshot(counts[s]);
+
+		out << "bucket_limit_us";
+		for (int s = 0; s < StageCount; s++)
+			out << "," << stageName(s);
+		out << "\n";
+		for (int b = 0; b < PoseHistogram::kBuckets; b++)
+		{
+			out << PoseHistogram::bucketLimit(b);
+			for (int s = 0; s < StageCount; s++)
+				out << "," << counts[s][b];
+			out << "\n";
+		}
+	}
+
+	void LatencyTrace::report(std::ostream& out)
+	{
+		out << "[latency] " << _samples - _reportSamples << " poses";
+		for (int s = 0; s < StageCount; s++)
+		{
+			uint64_t counts[PoseHistogram::kBuckets], period[PoseHistogram::kBuckets];
+			_histograms[s].snapshot(counts);
+			for (int b = 0; b < PoseHistogram::kBuckets; b++)
+			{
+				period[b] = counts[b] - _reportCounts[s][b];
+				_reportCounts[s][b] = counts[b];
+			}
+			out << ", " << stageName(s) << " p50/p99 " << PoseHistogram::percentile(period, 0.5) << "/" << PoseHistogram::percentile(period, 0.99);
+		}
+		out << " us" << std::endl;
+		_reportSamples = _samples;
+	}
+
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+
+#pragma once
+
+# include "Config.hpp"
+# include "PoseTelemetry.hpp"
+# include <cstdint>
+# include <fstream>
+# include <ostream>
+# include <string>
+
+namespace sibr {
+
+	/** Steady clock microseconds (PoseTelemetry::now) at which a pose passed each stage, 0 if it did not. */
+	struct LatencyStamps
+	{
+		uint64_t arrival = 0;     ///< Packet parsed by the receive thread.
+		uint64_t applied = 0;     ///< Fetched from the mailbox by the render loop.
+		uint64_t renderBegin = 0; ///< The view started rendering the frame using it.
+		uint64_t renderEnd = 0;   ///< The view returned, GPU work may still be queued.
+		uint64_t presented = 0;   ///< Buffer swap returned (headless: frame available).
+	};
+
+	/**
+	 * Motion-to-photon trace: per-stage latency histograms of every pose,
+	 * taken on the first frame that uses it, and optionally one CSV row per
+	 * pose. Owned by the render thread.
+	 */
+	class SIBR_EXP_ULR_EXPORT LatencyTrace
+	{
+	public:
+
+		enum Stage
+		{
+			Queue,   ///< arrival to applied
+			Wait,    ///< applied to render begin
+			Render,  ///< render begin to render end
+			Present, ///< render end to presented
+			Total,   ///< arrival to presented
+			StageCount
+		};
+
+		static const char* stageName(int stage);
+
+		/** Write one row per recorded pose to path. \return false if the file cannot be opened */
+		bool openCsv(const std::string& path);
+
+		/** Record the stamps of a presented frame. Frames reusing the pose of the previous one are ignored. */
+		void record(const LatencyStamps& stamps);
+
+		/** Write the bucket counts of every stage, one row per bucket. */
+		void writeHistograms(std::ostream& out) const;
+
+		/** Write the percentiles of the period since the last report and start a new period. */
+		void report(std::ostream& out);
+
+		const PoseHistogram& histogram(int stage) const { return _histograms[stage]; }
+		uint64_t samples() const { return _samples; }
+
+	private:
+
+		PoseHistogram _histograms[StageCount];
+		uint64_t _samples = 0;
+		uint64_t _lastArrival = 0;
+		std::ofstream _csv;
+
+		uint64_t _reportCounts[StageCount][PoseHistogram::kBuckets] = {};
+		uint64_t _reportSamples = 0;
+	};
+
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "LodHysteresis.hpp"
+
+namespace sibr {
+namespace Lod {
+
+	void FlipCounter::resize(size_t nodeCount)
+	{
+		_lastExpansion.assign(nodeCount, -1);
+	}
+
+	bool FlipCounter::expanded(int node, int step)
+	{
+		_expansions++;
+		if (node < 0 || node >= (int)_lastExpansion.size())
+			return false;
+
+		int last = _lastExpansion[node];
+		_lastExpansion[node] = step;
+		if (last >= 0 && step - last < window)
+		{
+			_flips++;
+			return true;
+		}
+		return false;
+	}
+
+	void FlipCounter::nextPeriod()
+	{
+		_lastPeriodFlips = _flips - _periodFlips;
+		_lastPeriodHeld = _held - _periodHeld;
+		_periodFlips = _flips;
+		_periodHeld = _held;
+	}
+
+}
+}
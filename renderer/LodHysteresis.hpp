@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+
+#pragma once
+
+# include "Config.hpp"
+# include <vector>
+# include <cstdint>
+# include <cmath>
+
+namespace sibr {
+
+	namespace Lod {
+
+		/**
+		 * Expand and collapse thresholds around a size limit. A node is expanded
+		 * once its size exceeds `expand` and collapsed back once it drops below
+		 * `collapse`; in between it keeps its current state.
+		 */
+		struct Band
+		{
+			float expand;
+			float collapse;
+
+			/** Split sizeLimit so that expand / collapse == 1 + ratio. */
+			static Band make(float sizeLimit, float ratio)
+			{
+				float s = std::sqrt(1.0f + std::fmax(0.0f, ratio));
+				return { sizeLimit * s, sizeLimit / s };
+			}
+
+			/** \return the new expansion state of a node of the given size. */
+			bool decide(float size, bool expanded) const
+			{
+				return expanded ? size >= collapse : size > expand;
+			}
+		};
+
+		/**
+		 * Counts nodes that are expanded again shortly after having been
+		 * collapsed, i.e. the cut thrashing the band is meant to prevent.
+		 */
+		class SIBR_EXP_ULR_EXPORT FlipCounter
+		{
+		public:
+
+			/** Size the per-node history for a hierarchy of nodeCount nodes. */
+			void resize(size_t nodeCount);
+
+			/** Record that node was expanded at maintenance step `step`.
+			 * \return true if it was already expanded less than `window` steps before */
+			bool expanded(int node, int step);
+
+			/** Record that an expansion request was held back by the band. */
+			void held(int count = 1) { _held += count; }
+
+			/** Start a new accounting period for the per-period rates. */
+			void nextPeriod();
+
+			int window = 60; ///< Steps within which a re-expansion counts as a flip.
+
+			uint64_t totalExpansions() const { return _expansions; }
+			uint64_t totalFlips() const { return _flips; }
+			uint64_t totalHeld() const { return _held; }
+			uint64_t lastPeriodFlips() const { return _lastPeriodFlips; }
+			uint64_t lastPeriodHeld() const { return _lastPeriodHeld; }
+
+		private:
+
+			std::vector<int> _lastExpansion;
+			uint64_t _expansions = 0;
+			uint64_t _flips = 0;
+			uint64_t _held = 0;
+			uint64_t _periodFlips = 0;
+			uint64_t _periodHeld = 0;
+			uint64_t _lastPeriodFlips = 0;
+			uint64_t _lastPeriodHeld = 0;
+		};
+
+	}
+
+}
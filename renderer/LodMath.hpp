@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+
+#pragma once
+
+#include "common.h"
+#include <types.h>
+#include <cfloat>
+#include <cmath>
+
+namespace sibr {
+
+	/**
+	 * Host versions of the size estimates used by the switching kernels.
+	 * Boxes are read through the same 8-float layout (min xyzw, max xyzw)
+	 * that is handed to Switching as float*, the node extent being stored
+	 * in the w component of the min corner.
+	 */
+	namespace Lod {
+
+		/** \return the projected size of a node box seen from viewpoint, looking along zdir.
+		 * Boxes at or behind the camera plane are considered infinitely large. */
+		inline float computeSize(const Box& box, const Point& viewpoint, const Point& zdir)
+		{
+			if (viewpoint.xyz[0] == INFINITY)
+				return FLT_MAX;
+
+			const float* b = reinterpret_cast<const float*>(&box);
+			float depth = 0.0f;
+			for (int i = 0; i < 3; i++)
+			{
+				float closest = std::fmax(b[i], std::fmin(b[4 + i], viewpoint.xyz[i]));
+				depth += (closest - viewpoint.xyz[i]) * zdir.xyz[i];
+			}
+
+			if (depth <= 0.0f)
+				return FLT_MAX;
+
+			return b[3] / depth;
+		}
+
+		/**
+		 * Size limit growing with the angle between a node and a focus
+		 * direction, e.g. the gaze of an eye-tracked headset: nodes within
+		 * radius of the focus get the full limit, farther ones up to maxFactor
+		 * times coarser.
+		 */
+		struct Foveation
+		{
+			Point focus = { { 0.0f, 0.0f, 1.0f } }; ///< Unit direction of the focus, world space.
+			float radius = 0.17f;   ///< Radians around the focus kept at the full size limit.
+			float falloff = 0.0f;   ///< Growth of the limit factor per radian beyond radius, 0 disables foveation.
+			float maxFactor = 8.0f;
+
+			bool enabled() const { return falloff > 0.0f; }
+
+			/** \return the factor the size limit of a node box seen from viewpoint is multiplied by, at least 1.
+			 * The angle is taken to the nearest point of the bounding sphere of the box, so a node is never
+			 * coarsened while any part of it lies within radius of the focus. */
+			float factor(const Box& box, const Point& viewpoint) const
+			{
+				const float* b = reinterpret_cast<const float*>(&box);
+				float distance2 = 0.0f, radius2 = 0.0f, along = 0.0f;
+				for (int i = 0; i < 3; i++)
+				{
+					const float c = 0.5f * (b[i] + b[4 + i]) - viewpoint.xyz[i];
+					const float h = 0.5f * (b[4 + i] - b[i]);
+					distance2 += c * c;
+					radius2 += h * h;
+					along += c * focus.xyz[i];
+				}
+				if (distance2 <= radius2)
+					return 1.0f;
+
+				const float distance = std::sqrt(distance2);
+				const float angle = std::acos(std::fmin(1.0f, std::fmax(-1.0f, along / distance))) - std::asin(std::sqrt(radius2) / distance);
+				return std::fmin(maxFactor, 1.0f + falloff * std::fmax(0.0f, angle - radius));
+			}
+		};
+
+		/** A camera a shared cut has to satisfy. */
+		struct Viewpoint
+		{
+			Point position;
+			Point zdir;
+			float scale = 1.0f; ///< Converts its projected sizes to those of the reference camera the size limit is set for.
+			Foveation foveation;
+		};
+
+		/** \return the largest projected size of a node box over count cameras, divided by their foveation factors. */
+		inline float computeSize(const Box& box, const Viewpoint* views, int count)
+		{
+			float size = 0.0f;
+			for (int k = 0; k < count; k++)
+			{
+				float s = computeSize(box, views[k].position, views[k].zdir);
+				if (s == FLT_MAX)
+					return FLT_MAX;
+				if (views[k].foveation.enabled())
+					s /= views[k].foveation.factor(box, views[k].position);
+				size = std::fmax(size, s * views[k].scale);
+			}
+			return size;
+		}
+
+	}
+
+}
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "PoseChannel.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <ctime>
+#endif
+
+namespace sibr {
+
+	static_assert(std::atomic<uint32_t>::is_always_lock_free, "pose channel needs address free 32 bit atomics");
+
+	namespace {
+
+		/** Reads of the slot poll tries before giving up on a write in progress. */
+		const int kPollAttempts = 1024;
+
+		// Shared between processes, so no FUTEX_PRIVATE_FLAG.
+		void futexWait(std::atomic<uint32_t>* word, uint32_t expected, uint32_t timeoutUs)
+		{
+#ifdef __linux__
+			timespec timeout;
+			timeout.tv_sec = timeoutUs / 1000000;
+			timeout.tv_nsec = (timeoutUs % 1000000) * 1000;
+			syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+#else
+			std::this_thread::sleep_for(std::chrono::microseconds(std::min<uint32_t>(timeoutUs, 50)));
+#endif
+		}
+
+		void futexWake(std::atomic<uint32_t>* word)
+		{
+#ifdef __linux__
+			syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+		}
+
+	}
+
+	PoseChannel::~PoseChannel()
+	{
+#ifndef _WIN32
+		if (_slot)
+		{
+			munmap(_slot, sizeof(PoseChannelSlot));
+			if (_owner)
+				shm_unlink(_name.c_str());
+		}
+#endif
+	}
+
+	bool PoseChannel::create(const std::string& name)
+	{
+		return map(name, true);
+	}
+
+	bool PoseChannel::open(const std::string& name)
+	{
+		return map(name, false);
+	}
+
+	bool PoseChannel::map(const std::string& name, bool create)
+	{
+#ifdef _WIN32
+		return false;
+#else
+		if (_slot)
+			return false;
+
+		int fd;
+		if (create)
+		{
+			shm_unlink(name.c_str());
+			fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+			if (fd >= 0 && ftruncate(fd, (off_t)sizeof(PoseChannelSlot)) != 0)
+			{
+				close(fd);
+				shm_unlink(name.c_str());
+				return false;
+			}
+		}
+		else
+		{
+			fd = shm_open(name.c_str(), O_RDWR, 0);
+		}
+		if (fd < 0)
+			return false;
+
+		void* mapping = mmap(nullptr, sizeof(PoseChannelSlot), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (mapping == MAP_FAILED)
+		{
+			if (create)
+				shm_unlink(name.c_str());
+			return false;
+		}
+
+		PoseChannelSlot* slot;
+		if (create)
+		{
+			// ftruncate zero fills: sequence 0, nothing written yet. Writers check the magic last.
+			slot = new (mapping) PoseChannelSlot();
+			slot->version = kPoseChannelVersion;
+			std::atomic_thread_fence(std::memory_order_release);
+			slot->magic = kPoseChannelMagic;
+		}
+		else
+		{
+			slot = static_cast<PoseChannelSlot*>(mapping);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot->magic != kPoseChannelMagic || slot->version != kPoseChannelVersion)
+			{
+				munmap(mapping, sizeof(PoseChannelSlot));
+				return false;
+			}
+		}
+
+		_name = name;
+		_owner = create;
+		_slot = slot;
+		_last = slot->sequence.load(std::memory_order_acquire) & ~1u;
+		return true;
+#endif
+	}
+
+	bool PoseChannel::write(const char* data, size_t length, bool wake)
+	{
+		if (!_slot || length > kPoseChannelCapacity)
+			return false;
+
+		const uint32_t sequence = _slot->sequence.load(std::memory_order_relaxed);
+		_slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		_slot->length = (uint32_t)length;
+		std::memcpy(_slot->data, data, length);
+		_slot->sequence.store(sequence + 2, std::memory_order_seq_cst);
+
+		// Ordered after the sequence store, so a reader either sees the new value or is counted here.
+		if (wake && _slot->waiting.load(std::memory_order_seq_cst) != 0)
+			futexWake(&_slot->sequence);
+		return true;
+	}
+
+	bool PoseChannel::poll(char* out, size_t& length)
+	{
+		if (!_slot)
+			return false;
+
+		// A write takes well under a microsecond. A writer that died in the middle
+		// of one leaves the sequence odd for good, give up instead of spinning.
+		for (int attempt = 0; attempt < kPollAttempts; attempt++)
+		{
+			const uint32_t before = _slot->sequence.load(std::memory_order_acquire);
+			if (before == _last)
+				return false;
+			if (before & 1u)
+				continue;
+
+			const size_t size = std::min<size_t>(_slot->length, kPoseChannelCapacity);
+			std::memcpy(out, _slot->data, size);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (_slot->sequence.load(std::memory_order_relaxed) != before)
+				continue;
+
+			_overwritten += (before - _last) / 2 - 1;
+			_last = before;
+			length = size;
+			return true;
+		}
+		return false;
+	}
+
+	bool PoseChannel::wait(char* out, size_t& length, uint32_t timeoutUs, bool spin)
+	{
+		if (poll(out, length))
+			return true;
+
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutUs);
+		while (std::chrono::steady_clock::now() < deadline)
+		{
+			if (!spin)
+			{
+				_slot->waiting.fetch_add(1, std::memory_order_seq_cst);
+				// Also sleep through a write in progress, its end wakes us.
+				const uint32_t current = _slot->sequence.load(std::memory_order_seq_cst);
+				if (current == _last || (current & 1u))
+					futexWait(&_slot->sequence, current, timeoutUs);
+				_slot->waiting.fetch_sub(1, std::memory_order_relaxed);
+			}
+			if (poll(out, length))
+				return true;
+		}
+		return false;
+	}
+
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+
+#pragma once
+
+# include "Config.hpp"
+# include "PoseMessage.hpp"
+# include <atomic>
+# include <cstddef>
+# include <cstdint>
+# include <string>
+
+namespace sibr {
+
+	/** Largest packet a PoseChannel carries: a SensorRequest with every sensor. */
+	constexpr size_t kPoseChannelCapacity = kSensorHeaderSize + kMaxSensors * kSensorPoseSize;
+
+	/**
+	 * Shared memory layout of a PoseChannel, native endian. The packet is any
+	 * of the binary or JSON formats accepted on the UDP socket.
+	 */
+	struct PoseChannelSlot
+	{
+		uint32_t magic;
+		uint32_t version;
+		std::atomic<uint32_t> sequence; ///< Odd while a packet is written. Also the futex word readers sleep on.
+		std::atomic<uint32_t> waiting;  ///< Readers sleeping on sequence, the writer only wakes them if non zero.
+		uint32_t length;
+		char data[kPoseChannelCapacity];
+	};
+
+	constexpr uint32_t kPoseChannelMagic = 0x43505648; // "HVPC"
+	constexpr uint32_t kPoseChannelVersion = 1;
+
+	/**
+	 * Single slot pose input in POSIX shared memory, for clients on the same
+	 * host. The writer never waits: it overwrites the slot under a seqlock and,
+	 * if a reader sleeps, wakes it with a futex (Linux). The reader gets the
+	 * newest packet and counts the ones overwritten before it saw them, so it
+	 * cannot carry lockstep requests. The object is private to the user that
+	 * created it. Unavailable (create / open fail) on non-POSIX systems.
+	 */
+	class SIBR_EXP_ULR_EXPORT PoseChannel
+	{
+	public:
+
+		PoseChannel() = default;
+		PoseChannel(const PoseChannel&) = delete;
+		PoseChannel& operator=(const PoseChannel&) = delete;
+		~PoseChannel();
+
+		/** Reader side: create (or replace) the shared memory object name. The creator unlinks it on destruction. */
+		bool create(const std::string& name);
+
+		/** Writer side: map an existing channel. */
+		bool open(const std::string& name);
+
+		/**
+		 * Writer side: publish a packet.
+		 * \param length at most kPoseChannelCapacity bytes
+		 * \param wake wake a sleeping reader, a spinning reader does not need it
+		 * \return false if the packet is too large
+		 */
+		bool write(const char* data, size_t length, bool wake = true);
+
+		/**
+		 * Reader side: copy the newest packet if one was written since the last call.
+		 * Gives up after a bounded number of tries if a write stays in progress.
+		 * \param out kPoseChannelCapacity bytes
+		 * \param length packet size
+		 * \return true if a new packet was copied
+		 */
+		bool poll(char* out, size_t& length);
+
+		/**
+		 * Reader side: wait for a new packet, sleeping on the futex or busy polling.
+		 * \param timeoutUs give up after this many microseconds
+		 * \param spin poll instead of sleeping, the lowest latency at the cost of a core
+		 * \return true if a new packet was copied
+		 */
+		bool wait(char* out, size_t& length, uint32_t timeoutUs, bool spin);
+
+		/** \return the number of packets overwritten before the reader saw them (reader thread). */
+		uint64_t overwritten() const { return _overwritten; }
+
+		bool valid() const { return _slot != nullptr; }
+
+	private:
+
+		bool map(const std::string& name, bool create);
+
+		std::string _name;
+		bool _owner = false;
+		PoseChannelSlot* _slot = nullptr;
+		uint32_t _last = 0;
+		uint64_t _overwritten = 0;
+	};
+
+}
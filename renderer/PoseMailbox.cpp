@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "PoseMailbox.hpp"
+
+namespace sibr {
+
+	void PoseMailbox::publish(const PoseMessage& pose)
+	{
+		PoseSample& slot = _slots[_write];
+		slot.pose = pose;
+		slot.sequence = _published.load(std::memory_order_relaxed) + 1;
+		_published.store(slot.sequence, std::memory_order_relaxed);
+
+		// Hand the written slot over and take back whichever slot was shared.
+		uint32_t previous = _shared.exchange(_write | kFresh, std::memory_order_acq_rel);
+		_write = previous & kIndex;
+	}
+
+	bool PoseMailbox::fetch(PoseSample& out)
+	{
+		if (!(_shared.load(std::memory_order_relaxed) & kFresh))
+			return false;
+
+		uint32_t previous = _shared.exchange(_read, std::memory_order_acq_rel);
+		_read = previous & kIndex;
+
+		out = _slots[_read];
+		if (_lastSequence != 0 && out.sequence > _lastSequence + 1)
+			_skipped += out.sequence - _lastSequence - 1;
+		_lastSequence = out.sequence;
+		return true;
+	}
+
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+
+#pragma once
+
+# include "Config.hpp"
+# include "PoseMessage.hpp"
+# include <atomic>
+# include <cstdint>
+
+namespace sibr {
+
+	/** Pose as handed over by the mailbox. */
+	struct PoseSample
+	{
+		PoseMessage pose;
+		uint64_t sequence = 0; ///< 1 for the first published pose, incremented on every publish.
+	};
+
+	/**
+	 * Single producer, single consumer triple buffer holding the newest pose.
+	 * Neither side ever blocks: the producer always has a slot of its own to
+	 * write, and the consumer swaps in the last completed slot. Poses published
+	 * between two fetches are overwritten and counted as skipped.
+	 */
+	class SIBR_EXP_ULR_EXPORT PoseMailbox
+	{
+	public:
+
+		/** Producer side: store pose as the newest one. */
+		void publish(const PoseMessage& pose);
+
+		/**
+		 * Consumer side: take the newest pose if one arrived since the last fetch.
+		 * \param out newest pose, only written if the function returns true
+		 * \return true if a new pose was available
+		 */
+		bool fetch(PoseSample& out);
+
+		/** \return the number of poses published so far (any thread). */
+		uint64_t published() const { return _published.load(std::memory_order_relaxed); }
+
+		/** \return the number of poses overwritten before the consumer saw them (consumer thread). */
+		uint64_t skipped() const { return _skipped; }
+
+	private:
+
+		static constexpr uint32_t kIndex = 3;
+		static constexpr uint32_t kFresh = 4;
+
+		PoseSample _slots[3];
+		std::atomic<uint32_t> _shared = { 0 };
+		std::atomic<uint64_t> _published = { 0 };
+
+		// Owned by the producer.
+		uint32_t _write = 1;
+
+		// Owned by the consumer.
+		uint32_t _read = 2;
+		uint64_t _lastSequence = 0;
+		uint64_t _skipped = 0;
+	};
+
+}
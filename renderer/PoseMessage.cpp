@@ -0,0 +1,317 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "PoseMessage.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace sibr {
+
+	namespace {
+
+		/** Find "key": inside [begin, end) and return the position after the colon. */
+		const char* findKey(const char* begin, const char* end, const char* key)
+		{
+			const size_t n = std::strlen(key);
+			for (const char* p = begin; p + n + 2 <= end; p++)
+			{
+				if (p[0] != '"' || std::strncmp(p + 1, key, n) != 0 || p[n + 1] != '"')
+					continue;
+				const char* q = p + n + 2;
+				while (q < end && (*q == ' ' || *q == '\t' || *q == '\r' || *q == '\n'))
+					q++;
+				if (q < end && *q == ':')
+					return q + 1;
+			}
+			return nullptr;
+		}
+
+		/** Range of the flat object following "key":, the closing brace excluded. */
+		bool findObject(const char* begin, const char* end, const char* key, const char*& objBegin, const char*& objEnd)
+		{
+			const char* p = findKey(begin, end, key);
+			if (!p)
+				return false;
+			p = static_cast<const char*>(std::memchr(p, '{', end - p));
+			if (!p)
+				return false;
+			const char* q = static_cast<const char*>(std::memchr(p, '}', end - p));
+			if (!q)
+				return false;
+			objBegin = p + 1;
+			objEnd = q;
+			return true;
+		}
+
+		bool readFloat(const char* begin, const char* end, const char* key, float& value)
+		{
+			const char* p = findKey(begin, end, key);
+			if (!p)
+				return false;
+			char* stop = nullptr;
+			value = std::strtof(p, &stop);
+			return stop != p && stop <= end;
+		}
+
+		/** Optional integer field, value is left untouched if absent. */
+		void readInteger(const char* begin, const char* end, const char* key, int64_t& value)
+		{
+			const char* p = findKey(begin, end, key);
+			if (!p)
+				return;
+			char* stop = nullptr;
+			long long v = std::strtoll(p, &stop, 10);
+			if (stop != p && stop <= end)
+				value = (int64_t)v;
+		}
+
+	}
+
+	bool parsePoseJson(const char* data, size_t length, PoseMessage& out)
+	{
+		if (length == 0 || length > kMaxPoseMessage)
+			return false;
+
+		// strtof needs a terminated string, copy to the stack rather than allocate.
+		char text[kMaxPoseMessage + 1];
+		std::memcpy(text, data, length);
+		text[length] = '\0';
+		const char* end = text + length;
+
+		const char* b, * e;
+		PoseMessage pose;
+		if (!findObject(text, end, "position", b, e) ||
+			!readFloat(b, e, "x", pose.position[0]) ||
+			!readFloat(b, e, "y", pose.position[1]) ||
+			!readFloat(b, e, "z", pose.position[2]))
+			return false;
+
+		if (!findObject(text, end, "rotation", b, e) ||
+			!readFloat(b, e, "w", pose.rotation[0]) ||
+			!readFloat(b, e, "x", pose.rotation[1]) ||
+			!readFloat(b, e, "y", pose.rotation[2]) ||
+			!readFloat(b, e, "z", pose.rotation[3]))
+			return false;
+
+		int64_t sequence = 0, timestamp = 0;
+		readInteger(text, end, "sequence", sequence);
+		readInteger(text, end, "timestamp", timestamp);
+		readInteger(text, end, "frame_id", pose.frameId);
+		pose.sequence = (uint32_t)sequence;
+
+		if (findObject(text, end, "gaze", b, e))
+		{
+			pose.hasGaze = readFloat(b, e, "x", pose.gaze[0]) && readFloat(b, e, "y", pose.gaze[1]);
+			if (!pose.hasGaze)
+				return false;
+		}
+		pose.timestamp = (uint64_t)std::max<int64_t>(0, timestamp);
+
+		out = pose;
+		return true;
+	}
+
+	namespace {
+
+		template<typename T>
+		T readLE(const char* p)
+		{
+			T v;
+			std::memcpy(&v, p, sizeof(T));
+			return v;
+		}
+
+		template<typename T>
+		void writeLE(char* p, T v)
+		{
+			std::memcpy(p, &v, sizeof(T));
+		}
+
+	}
+
+	// Hosts are assumed little endian, as are all the targets we build for.
+	bool parsePoseBinary(const char* data, size_t length, PoseMessage& out)
+	{
+		if (length < kPoseBinarySize ||
+			(uint8_t)data[0] != kPoseMagic ||
+			(uint8_t)data[1] != kPoseVersion)
+			return false;
+
+		PoseMessage pose;
+		uint16_t flags = readLE<uint16_t>(data + 2);
+		pose.hasGaze = (flags & kPoseHasGaze) != 0;
+		if (length != (pose.hasGaze ? kPoseGazeBinarySize : kPoseBinarySize))
+			return false;
+		pose.sequence = readLE<uint32_t>(data + 4);
+		pose.timestamp = readLE<uint64_t>(data + 8);
+		pose.frameId = (flags & kPoseHasFrameId) ? (int64_t)readLE<uint64_t>(data + 16) : -1;
+		for (int i = 0; i < 3; i++)
+			pose.position[i] = readLE<float>(data + 24 + 4 * i);
+		for (int i = 0; i < 4; i++)
+			pose.rotation[i] = readLE<float>(data + 36 + 4 * i);
+		if (pose.hasGaze)
+		{
+			pose.gaze[0] = readLE<float>(data + 52);
+			pose.gaze[1] = readLE<float>(data + 56);
+		}
+
+		out = pose;
+		return true;
+	}
+
+	size_t encodePoseBinary(const PoseMessage& pose, char* out)
+	{
+		out[0] = (char)kPoseMagic;
+		out[1] = (char)kPoseVersion;
+		writeLE<uint16_t>(out + 2, uint16_t((pose.frameId >= 0 ? kPoseHasFrameId : 0) | (pose.hasGaze ? kPoseHasGaze : 0)));
+		writeLE<uint32_t>(out + 4, pose.sequence);
+		writeLE<uint64_t>(out + 8, pose.timestamp);
+		writeLE<uint64_t>(out + 16, pose.frameId >= 0 ? (uint64_t)pose.frameId : 0);
+		for (int i = 0; i < 3; i++)
+			writeLE<float>(out + 24 + 4 * i, pose.position[i]);
+		for (int i = 0; i < 4; i++)
+			writeLE<float>(out + 36 + 4 * i, pose.rotation[i]);
+		if (!pose.hasGaze)
+			return kPoseBinarySize;
+		writeLE<float>(out + 52, pose.gaze[0]);
+		writeLE<float>(out + 56, pose.gaze[1]);
+		return kPoseGazeBinarySize;
+	}
+
+	void encodeFrameResponse(const FrameResponse& response, char* out)
+	{
+		out[0] = (char)kFrameResponseMagic;
+		out[1] = (char)kPoseVersion;
+		writeLE<uint16_t>(out + 2, response.status);
+		writeLE<uint32_t>(out + 4, 0);
+		writeLE<int64_t>(out + 8, response.frameId);
+		writeLE<uint64_t>(out + 16, response.ringFrame);
+		writeLE<uint64_t>(out + 24, response.renderedAt);
+	}
+
+	bool parseFrameResponse(const char* data, size_t length, FrameResponse& out)
+	{
+		if (length != kFrameResponseSize ||
+			(uint8_t)data[0] != kFrameResponseMagic ||
+			(uint8_t)data[1] != kPoseVersion)
+			return false;
+
+		out.status = readLE<uint16_t>(data + 2);
+		out.frameId = readLE<int64_t>(data + 8);
+		out.ringFrame = readLE<uint64_t>(data + 16);
+		out.renderedAt = readLE<uint64_t>(data + 24);
+		return true;
+	}
+
+	bool parseSensorRequest(const char* data, size_t length, SensorRequest& out)
+	{
+		if (length < kSensorHeaderSize ||
+			(uint8_t)data[0] != kSensorRequestMagic ||
+			(uint8_t)data[1] != kPoseVersion)
+			return false;
+
+		const int count = readLE<uint16_t>(data + 2);
+		if (count < 1 || count > kMaxSensors || length != kSensorHeaderSize + count * kSensorPoseSize)
+			return false;
+
+		out.sequence = readLE<uint32_t>(data + 4);
+		out.timestamp = readLE<uint64_t>(data + 8);
+		out.frameId = readLE<int64_t>(data + 16);
+		out.count = count;
+		for (int k = 0; k < count; k++)
+		{
+			const char* p = data + kSensorHeaderSize + k * kSensorPoseSize;
+			SensorPose& sensor = out.sensors[k];
+			for (int i = 0; i < 3; i++)
+				sensor.position[i] = readLE<float>(p + 4 * i);
+			for (int i = 0; i < 4; i++)
+				sensor.rotation[i] = readLE<float>(p + 12 + 4 * i);
+			sensor.fovy = readLE<float>(p + 28);
+		}
+		return true;
+	}
+
+	size_t encodeSensorRequest(const SensorRequest& request, char* out)
+	{
+		out[0] = (char)kSensorRequestMagic;
+		out[1] = (char)kPoseVersion;
+		writeLE<uint16_t>(out + 2, (uint16_t)request.count);
+		writeLE<uint32_t>(out + 4, request.sequence);
+		writeLE<uint64_t>(out + 8, request.timestamp);
+		writeLE<int64_t>(out + 16, request.frameId);
+		for (int k = 0; k < request.count; k++)
+		{
+			char* p = out + kSensorHeaderSize + k * kSensorPoseSize;
+			const SensorPose& sensor = request.sensors[k];
+			for (int i = 0; i < 3; i++)
+				writeLE<float>(p + 4 * i, sensor.position[i]);
+			for (int i = 0; i < 4; i++)
+				writeLE<float>(p + 12 + 4 * i, sensor.rotation[i]);
+			writeLE<float>(p + 28, sensor.fovy);
+		}
+		return kSensorHeaderSize + request.count * kSensorPoseSize;
+	}
+
+	SensorRequest sensorRequestOf(const PoseMessage& pose)
+	{
+		SensorRequest request;
+		request.sequence = pose.sequence;
+		request.timestamp = pose.timestamp;
+		request.frameId = pose.frameId;
+		request.receivedAt = pose.receivedAt;
+		request.count = 1;
+		std::copy(pose.position, pose.position + 3, request.sensors[0].position);
+		std::copy(pose.rotation, pose.rotation + 4, request.sensors[0].rotation);
+		return request;
+	}
+
+	bool parsePose(const char* data, size_t length, PoseMessage& out)
+	{
+		if (length > 0 && (uint8_t)data[0] == kPoseMagic)
+			return parsePoseBinary(data, length, out);
+		return parsePoseJson(data, length, out);
+	}
+
+	int parseNewestPose(const char* const* data, const size_t* lengths, int count, PoseMessage& out, int& rejected)
+	{
+		count = std::min(count, kMaxPoseBatch);
+
+		// Newest first: by arrival, or by sequence if every packet carries one.
+		int order[kMaxPoseBatch];
+		uint32_t sequence[kMaxPoseBatch];
+		bool sequenced = true;
+		for (int i = 0; i < count; i++)
+		{
+			order[i] = count - 1 - i;
+			sequenced = sequenced && (lengths[i] == kPoseBinarySize || lengths[i] == kPoseGazeBinarySize) && (uint8_t)data[i][0] == kPoseMagic;
+			if (sequenced)
+				sequence[i] = readLE<uint32_t>(data[i] + 4);
+		}
+		if (sequenced)
+		{
+			std::stable_sort(order, order + count, [&](int a, int b) {
+				return (int32_t)(sequence[a] - sequence[b]) > 0;
+			});
+		}
+
+		for (int k = 0; k < count; k++)
+		{
+			int i = order[k];
+			if (parsePose(data[i], lengths[i], out))
+				return i;
+			rejected++;
+		}
+		return -1;
+	}
+
+}
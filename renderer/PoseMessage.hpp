@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+
+#pragma once
+
+# include "Config.hpp"
+# include <cstddef>
+# include <cstdint>
+
+namespace sibr {
+
+	/** Camera pose received from an external controller. */
+	struct PoseMessage
+	{
+		float position[3] = { 0.0f, 0.0f, 0.0f };
+		float rotation[4] = { 1.0f, 0.0f, 0.0f, 0.0f }; ///< w, x, y, z
+		uint32_t sequence = 0;  ///< Sender sequence number, 0 if absent.
+		uint64_t timestamp = 0; ///< Sender time in microseconds, 0 if unknown.
+		int64_t frameId = -1;   ///< Frame the pose belongs to, -1 if absent.
+		uint64_t receivedAt = 0; ///< Local arrival time in microseconds (PoseTelemetry::now), set by the receiver.
+		bool hasGaze = false;
+		float gaze[2] = { 0.5f, 0.5f }; ///< Focus point in normalized image coordinates, x right, y down, for foveated LOD.
+	};
+
+	/** Largest pose packet accepted, in bytes. */
+	constexpr size_t kMaxPoseMessage = 1024;
+
+	/**
+	 * Binary pose packet, little endian, no padding:
+	 *
+	 *   offset  size  field
+	 *        0     1  magic, kPoseMagic (never the first byte of a JSON packet)
+	 *        1     1  version, kPoseVersion
+	 *        2     2  flags, kPoseHasFrameId
+	 *        4     4  sequence
+	 *        8     8  timestamp in microseconds
+	 *       16     8  frame id, ignored unless kPoseHasFrameId is set
+	 *       24    12  position x y z
+	 *       36    16  rotation w x y z
+	 *       52     8  gaze x y, only present if kPoseHasGaze is set
+	 */
+	constexpr uint8_t kPoseMagic = 0xA5;
+	constexpr uint8_t kPoseVersion = 1;
+	constexpr uint16_t kPoseHasFrameId = 1;
+	constexpr uint16_t kPoseHasGaze = 2;
+	constexpr size_t kPoseBinarySize = 52;
+	constexpr size_t kPoseGazeBinarySize = 60;
+
+	/**
+	 * Parse a JSON pose of the form
+	 * {"position":{"x":..,"y":..,"z":..},"rotation":{"w":..,"x":..,"y":..,"z":..}}
+	 * without building a DOM or touching the heap. The integer fields "sequence",
+	 * "timestamp" (microseconds) and "frame_id" are optional, as is a focus point
+	 * "gaze":{"x":..,"y":..}. Unknown keys are ignored.
+	 * \param data packet bytes, not null terminated
+	 * \param length packet size, at most kMaxPoseMessage
+	 * \param out parsed pose, only written on success
+	 * \return false if a field is missing or malformed
+	 */
+	SIBR_EXP_ULR_EXPORT bool parsePoseJson(const char* data, size_t length, PoseMessage& out);
+
+	/**
+	 * Parse a binary pose packet.
+	 * \return false on a size, magic or version mismatch
+	 */
+	SIBR_EXP_ULR_EXPORT bool parsePoseBinary(const char* data, size_t length, PoseMessage& out);
+
+	/**
+	 * Write pose as a binary packet, for senders and tools.
+	 * \param out kPoseGazeBinarySize bytes if pose.hasGaze, else kPoseBinarySize
+	 * \return the packet size
+	 */
+	SIBR_EXP_ULR_EXPORT size_t encodePoseBinary(const PoseMessage& pose, char* out);
+
+	/** Parse a packet of either format, told apart by its first byte. */
+	SIBR_EXP_ULR_EXPORT bool parsePose(const char* data, size_t length, PoseMessage& out);
+
+	/** Most cameras in one SensorRequest. */
+	constexpr int kMaxSensors = 8;
+
+	/** One camera of a SensorRequest, in world space. */
+	struct SensorPose
+	{
+		float position[3] = { 0.0f, 0.0f, 0.0f };
+		float rotation[4] = { 1.0f, 0.0f, 0.0f, 0.0f }; ///< w, x, y, z
+		float fovy = 0.0f; ///< Vertical field of view in radians, 0 keeps the viewer's.
+	};
+
+	/** Poses of all the cameras of a rig for one frame, rendered from one shared cut. */
+	struct SensorRequest
+	{
+		uint32_t sequence = 0;
+		uint64_t timestamp = 0;
+		int64_t frameId = -1;
+		uint64_t receivedAt = 0; ///< Set by the receiver.
+		int count = 0;
+		SensorPose sensors[kMaxSensors];
+	};
+
+	/**
+	 * Binary SensorRequest, little endian:
+	 *
+	 *   offset  size  field
+	 *        0     1  magic, kSensorRequestMagic
+	 *        1     1  version, kPoseVersion
+	 *        2     2  sensor count, 1 to kMaxSensors
+	 *        4     4  sequence
+	 *        8     8  timestamp in microseconds
+	 *       16     8  frame id, -1 if none
+	 *       24        count times kSensorPoseSize bytes: position x y z, rotation w x y z, fovy
+	 */
+	constexpr uint8_t kSensorRequestMagic = 0xA7;
+	constexpr size_t kSensorHeaderSize = 24;
+	constexpr size_t kSensorPoseSize = 32;
+
+	/** \return false on a size, magic, version or count mismatch */
+	SIBR_EXP_ULR_EXPORT bool parseSensorRequest(const char* data, size_t length, SensorRequest& out);
+
+	/**
+	 * \param out kSensorHeaderSize + count * kSensorPoseSize bytes
+	 * \return the packet size
+	 */
+	SIBR_EXP_ULR_EXPORT size_t encodeSensorRequest(const SensorRequest& request, char* out);
+
+	/** A single pose as a request for one camera that keeps the viewer's field of view. */
+	SIBR_EXP_ULR_EXPORT SensorRequest sensorRequestOf(const PoseMessage& pose);
+
+	/** Reply to a lockstep request, sent once its frame is rendered or when it was dropped. */
+	struct FrameResponse
+	{
+		enum Status : uint16_t { Rendered = 0, Dropped = 1 };
+
+		uint16_t status = Rendered;
+		int64_t frameId = -1;
+		uint64_t ringFrame = 0;  ///< Frame number in the shared memory ring, 0 if none.
+		uint64_t renderedAt = 0; ///< Server steady clock microseconds.
+	};
+
+	/**
+	 * Binary FrameResponse, little endian:
+	 *
+	 *   offset  size  field
+	 *        0     1  magic, kFrameResponseMagic
+	 *        1     1  version, kPoseVersion
+	 *        2     2  status
+	 *        4     4  reserved, 0
+	 *        8     8  frame id
+	 *       16     8  ring frame
+	 *       24     8  rendered at
+	 */
+	constexpr uint8_t kFrameResponseMagic = 0xA6;
+	constexpr size_t kFrameResponseSize = 32;
+
+	/** \param out kFrameResponseSize bytes */
+	SIBR_EXP_ULR_EXPORT void encodeFrameResponse(const FrameResponse& response, char* out);
+
+	SIBR_EXP_ULR_EXPORT bool parseFrameResponse(const char* data, size_t length, FrameResponse& out);
+
+	/** Most datagrams handled in one receive batch. */
+	constexpr int kMaxPoseBatch = 64;
+
+	/**
+	 * Parse only the newest valid pose of a batch of datagrams. When all of them
+	 * are binary packets the newest is the highest sequence number (wrap-around
+	 * aware), otherwise the last one received. Older packets are not parsed.
+	 * \param data datagrams in arrival order
+	 * \param lengths datagram sizes
+	 * \param count number of datagrams, at most kMaxPoseBatch
+	 * \param out newest valid pose
+	 * \param rejected incremented for every datagram that was tried and failed to parse
+	 * \return index of the parsed datagram, -1 if none was valid
+	 */
+	SIBR_EXP_ULR_EXPORT int parseNewestPose(const char* const* data, const size_t* lengths, int count, PoseMessage& out, int& rejected);
+
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "PosePredictor.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace sibr {
+
+	void PosePredictor::reset()
+	{
+		_valid = false;
+		_velocity.setZero();
+		_angular.setZero();
+		_offsetCount = 0;
+		_offsetNext = 0;
+		_offset = 0;
+	}
+
+	void PosePredictor::observe(const PoseMessage& pose)
+	{
+		const uint64_t time = pose.timestamp != 0 ? pose.timestamp : pose.receivedAt;
+
+		_offsets[_offsetNext] = (int64_t)pose.receivedAt - (int64_t)time;
+		_offsetNext = (_offsetNext + 1) % kOffsetWindow;
+		_offsetCount = std::min(_offsetCount + 1, kOffsetWindow);
+		_offset = *std::min_element(_offsets, _offsets + _offsetCount);
+
+		Eigen::Vector3f position(pose.position[0], pose.position[1], pose.position[2]);
+		Eigen::Quaternionf rotation(pose.rotation[0], pose.rotation[1], pose.rotation[2], pose.rotation[3]);
+		rotation.normalize();
+
+		if (_valid && time > _time && time - _time <= maxGap)
+		{
+			const float dt = (time - _time) * 1e-6f;
+
+			Eigen::Vector3f velocity = (position - _position) / dt;
+
+			Eigen::Quaternionf delta = rotation * _rotation.conjugate();
+			if (delta.w() < 0.0f)
+				delta.coeffs() *= -1.0f;
+			Eigen::AngleAxisf axisAngle(delta);
+			Eigen::Vector3f angular = axisAngle.axis() * (axisAngle.angle() / dt);
+
+			_velocity = smoothing * velocity + (1.0f - smoothing) * _velocity;
+			_angular = smoothing * angular + (1.0f - smoothing) * _angular;
+		}
+		else if (!_valid || (time > _time && time - _time > maxGap))
+		{
+			_velocity.setZero();
+			_angular.setZero();
+		}
+
+		// Out of order poses only refresh the clock offset.
+		if (!_valid || time >= _time)
+		{
+			_time = time;
+			_position = position;
+			_rotation = rotation;
+			_valid = true;
+		}
+	}
+
+	bool PosePredictor::predict(uint64_t displayTime, Eigen::Vector3f& position, Eigen::Quaternionf& rotation) const
+	{
+		if (!_valid)
+			return false;
+
+		// Target on the sender clock, never backwards and never past the horizon.
+		int64_t horizon = (int64_t)displayTime - _offset - (int64_t)_time;
+		horizon = std::max<int64_t>(0, std::min<int64_t>(horizon, (int64_t)maxHorizon));
+		_lastHorizon = horizon;
+		const float dt = horizon * 1e-6f;
+
+		position = _position + _velocity * dt;
+
+		const float speed = _angular.norm();
+		if (speed * dt > 1e-6f)
+			rotation = Eigen::Quaternionf(Eigen::AngleAxisf(speed * dt, _angular / speed)) * _rotation;
+		else
+			rotation = _rotation;
+		return true;
+	}
+
+}
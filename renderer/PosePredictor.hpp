@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+
+#pragma once
+
+# include "Config.hpp"
+# include "PoseMessage.hpp"
+# include <Eigen/Core>
+# include <Eigen/Geometry>
+# include <cstdint>
+
+namespace sibr {
+
+	/**
+	 * Constant velocity extrapolation of the received poses. Linear and angular
+	 * velocity are estimated from consecutive poses on the sender clock, the
+	 * offset to the local clock is the smallest observed arrival minus send
+	 * time over the last kOffsetWindow poses (the fastest packet bounds the
+	 * one-way delay). Poses without timestamp use their arrival time.
+	 * Not thread safe, meant for the render thread.
+	 */
+	class SIBR_EXP_ULR_EXPORT PosePredictor
+	{
+	public:
+
+		static constexpr int kOffsetWindow = 64;
+
+		float smoothing = 0.5f;       ///< Weight of the newest velocity estimate, 1 disables smoothing.
+		uint64_t maxHorizon = 100000; ///< Longest extrapolation in microseconds.
+		uint64_t maxGap = 250000;     ///< Poses further apart than this restart the velocity estimate.
+
+		/** Feed a newly received pose, receivedAt must be set. */
+		void observe(const PoseMessage& pose);
+
+		/**
+		 * Extrapolate the last pose to a local time.
+		 * \param displayTime local time in microseconds (PoseTelemetry::now), typically the expected scan-out
+		 * \param position predicted position
+		 * \param rotation predicted rotation
+		 * \return false if no pose was observed yet
+		 */
+		bool predict(uint64_t displayTime, Eigen::Vector3f& position, Eigen::Quaternionf& rotation) const;
+
+		/** Forget everything observed so far. */
+		void reset();
+
+		/** \return local minus sender clock in microseconds. */
+		int64_t clockOffset() const { return _offset; }
+
+		const Eigen::Vector3f& velocity() const { return _velocity; }
+		const Eigen::Vector3f& angularVelocity() const { return _angular; }
+
+		/** \return the extrapolation of the last predict call in microseconds. */
+		int64_t lastHorizon() const { return _lastHorizon; }
+
+	private:
+
+		bool _valid = false;
+		uint64_t _time = 0; ///< Sender time of the last pose.
+		Eigen::Vector3f _position = Eigen::Vector3f::Zero();
+		Eigen::Quaternionf _rotation = Eigen::Quaternionf::Identity();
+		Eigen::Vector3f _velocity = Eigen::Vector3f::Zero();
+		Eigen::Vector3f _angular = Eigen::Vector3f::Zero(); ///< World axis times radians per second.
+
+		int64_t _offsets[kOffsetWindow];
+		int _offsetCount = 0;
+		int _offsetNext = 0;
+		int64_t _offset = 0;
+
+		mutable int64_t _lastHorizon = 0;
+	};
+
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "PoseTelemetry.hpp"
+
+#include <chrono>
+
+namespace sibr {
+
+	int PoseHistogram::bucketOf(uint64_t value)
+	{
+		if (value < 4)
+			return (int)value;
+		int msb = 0;
+		for (uint64_t v = value; v > 1; v >>= 1)
+			msb++;
+		int bucket = 4 * (msb - 1) + (int)((value >> (msb - 2)) & 3);
+		return bucket < kBuckets ? bucket : kBuckets - 1;
+	}
+
+	uint64_t PoseHistogram::bucketLimit(int bucket)
+	{
+		if (bucket < 4)
+			return (uint64_t)bucket;
+		int msb = bucket / 4 + 1;
+		uint64_t sub = (uint64_t)(bucket % 4);
+		return ((4 + sub + 1) << (msb - 2)) - 1;
+	}
+
+	void PoseHistogram::add(uint64_t value)
+	{
+		_buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void PoseHistogram::snapshot(uint64_t* out) const
+	{
+		for (int i = 0; i < kBuckets; i++)
+			out[i] = _buckets[i].load(std::memory_order_relaxed);
+	}
+
+	uint64_t PoseHistogram::percentile(const uint64_t* counts, double q)
+	{
+		uint64_t total = 0;
+		for (int i = 0; i < kBuckets; i++)
+			total += counts[i];
+		if (total == 0)
+			return 0;
+
+		uint64_t rank = (uint64_t)(q * (double)(total - 1));
+		uint64_t seen = 0;
+		for (int i = 0; i < kBuckets; i++)
+		{
+			seen += counts[i];
+			if (seen > rank)
+				return bucketLimit(i);
+		}
+		return bucketLimit(kBuckets - 1);
+	}
+
+	uint64_t PoseTelemetry::now()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void PoseTelemetry::received(uint64_t t)
+	{
+		uint64_t last = _lastPacket.load(std::memory_order_relaxed);
+		if (last != 0 && t >= last)
+		{
+			uint64_t delta = t - last;
+			_interArrival.add(delta);
+			if (_lastDelta != 0)
+				_jitter.add(delta > _lastDelta ? delta - _lastDelta : _lastDelta - delta);
+			_lastDelta = delta;
+		}
+		_lastPacket.store(t, std::memory_order_relaxed);
+		_packets.fetch_add(1, std::memory_order_relaxed);
+
+		if (_windowStart == 0)
+			_windowStart = t;
+		_windowPackets++;
+		if (t - _windowStart >= 1000000)
+		{
+			_rate.store(_windowPackets * 1e6f / (float)(t - _windowStart), std::memory_order_relaxed);
+			_windowStart = t;
+			_windowPackets = 0;
+		}
+	}
+
+	void PoseTelemetry::applied(const PoseSample& sample, uint64_t t)
+	{
+		if (_lastSequence != 0 && sample.sequence > _lastSequence + 1)
+			_overwritten.fetch_add(sample.sequence - _lastSequence - 1, std::memory_order_relaxed);
+		_lastSequence = sample.sequence;
+
+		if (sample.pose.receivedAt != 0 && t >= sample.pose.receivedAt)
+			_queueLatency.add(t - sample.pose.receivedAt);
+		_applied.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	bool PoseTelemetry::logDue(uint64_t t)
+	{
+		if (!debugLog.load(std::memory_order_relaxed))
+			return false;
+		uint64_t last = _lastLog.load(std::memory_order_relaxed);
+		if (last != 0 && t - last < logInterval)
+			return false;
+		return _lastLog.compare_exchange_strong(last, t, std::memory_order_relaxed);
+	}
+
+	void PoseTelemetry::report(std::ostream& out)
+	{
+		uint64_t t = now();
+		uint64_t packets = this->packets();
+		uint64_t failures = parseFailures();
+		uint64_t supersededCount = supersededPackets();
+		uint64_t appliedCount = appliedPoses();
+		uint64_t overwrittenCount = overwritten();
+
+		uint64_t jitter[PoseHistogram::kBuckets], latency[PoseHistogram::kBuckets];
+		_jitter.snapshot(jitter);
+		_queueLatency.snapshot(latency);
+
+		uint64_t periodJitter[PoseHistogram::kBuckets], periodLatency[PoseHistogram::kBuckets];
+		for (int i = 0; i < PoseHistogram::kBuckets; i++)
+		{
+			periodJitter[i] = jitter[i] - _reportJitter[i];
+			periodLatency[i] = latency[i] - _reportLatency[i];
+			_reportJitter[i] = jitter[i];
+			_reportLatency[i] = latency[i];
+		}
+
+		double seconds = _reportTime != 0 && t > _reportTime ? (t - _reportTime) * 1e-6 : 0.0;
+		out << "[pose] " << (seconds > 0.0 ? (packets - _reportPackets) / seconds : 0.0) << " packets/s"
+			<< ", " << failures - _reportFailures << " parse failures"
+			<< ", " << supersededCount - _reportSuperseded << " superseded"
+			<< ", " << appliedCount - _reportApplied << " applied"
+			<< ", " << overwrittenCount - _reportOverwritten << " overwritten"
+			<< ", jitter p50/p99 " << PoseHistogram::percentile(periodJitter, 0.5) << "/" << PoseHistogram::percentile(periodJitter, 0.99) << " us"
+			<< ", queue latency p50/p99 " << PoseHistogram::percentile(periodLatency, 0.5) << "/" << PoseHistogram::percentile(periodLatency, 0.99) << " us"
+			<< std::endl;
+
+		_reportTime = t;
+		_reportPackets = packets;
+		_reportFailures = failures;
+		_reportSuperseded = supersededCount;
+		_reportApplied = appliedCount;
+		_reportOverwritten = overwrittenCount;
+	}
+
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+
+#pragma once
+
+# include "Config.hpp"
+# include "PoseMailbox.hpp"
+# include <atomic>
+# include <cstdint>
+# include <ostream>
+
+namespace sibr {
+
+	/**
+	 * Lock-free log-linear histogram of microsecond durations: exact below 4,
+	 * then four buckets per power of two, which bounds the error to 25%.
+	 */
+	class SIBR_EXP_ULR_EXPORT PoseHistogram
+	{
+	public:
+
+		static constexpr int kBuckets = 128;
+
+		/** Record one value, any thread. */
+		void add(uint64_t value);
+
+		/** Copy the bucket counts to out, kBuckets entries. */
+		void snapshot(uint64_t* out) const;
+
+		/** \return the upper bound of the bucket holding quantile q of counts, 0 if empty. */
+		static uint64_t percentile(const uint64_t* counts, double q);
+
+		static int bucketOf(uint64_t value);
+		static uint64_t bucketLimit(int bucket);
+
+	private:
+		std::atomic<uint64_t> _buckets[kBuckets] = {};
+	};
+
+	/**
+	 * Counters of the pose channel. The receive thread calls received /
+	 * rejected, the render thread calls applied; both are wait-free. Any
+	 * thread can read the totals, report() is meant for one reporting thread.
+	 */
+	class SIBR_EXP_ULR_EXPORT PoseTelemetry
+	{
+	public:
+
+		/** \return microseconds on the steady clock, the time base of all timestamps here. */
+		static uint64_t now();
+
+		/** Receive thread: a packet parsed fine at time t. */
+		void received(uint64_t t);
+
+		/** Receive thread: count packets failed to parse. */
+		void rejected(uint64_t count = 1) { _parseFailures.fetch_add(count, std::memory_order_relaxed); }
+
+		/** Receive thread: count packets dropped unparsed because a newer one came in the same batch. */
+		void superseded(uint64_t count) { _superseded.fetch_add(count, std::memory_order_relaxed); }
+
+		/** Render thread: sample was applied at time t. */
+		void applied(const PoseSample& sample, uint64_t t);
+
+		/**
+		 * Rate-limited debug logging for the receive thread.
+		 * \return true if debug logging is on and the last log is at least logInterval old
+		 */
+		bool logDue(uint64_t t);
+
+		/** Write the stats of the period since the last report and start a new period. */
+		void report(std::ostream& out);
+
+		std::atomic<bool> debugLog = { false };
+		uint64_t logInterval = 1000000; ///< Microseconds between two debug log lines.
+
+		uint64_t packets() const { return _packets.load(std::memory_order_relaxed); }
+		uint64_t parseFailures() const { return _parseFailures.load(std::memory_order_relaxed); }
+		uint64_t supersededPackets() const { return _superseded.load(std::memory_order_relaxed); }
+		uint64_t appliedPoses() const { return _applied.load(std::memory_order_relaxed); }
+		uint64_t overwritten() const { return _overwritten.load(std::memory_order_relaxed); }
+		uint64_t lastPacket() const { return _lastPacket.load(std::memory_order_relaxed); }
+		float packetRate() const { return _rate.load(std::memory_order_relaxed); }
+
+		const PoseHistogram& interArrival() const { return _interArrival; }
+		const PoseHistogram& jitter() const { return _jitter; }
+		const PoseHistogram& queueLatency() const { return _queueLatency; }
+
+	private:
+
+		std::atomic<uint64_t> _packets = { 0 };
+		std::atomic<uint64_t> _parseFailures = { 0 };
+		std::atomic<uint64_t> _superseded = { 0 };
+		std::atomic<uint64_t> _applied = { 0 };
+		std::atomic<uint64_t> _overwritten = { 0 };
+		std::atomic<uint64_t> _lastPacket = { 0 };
+		std::atomic<uint64_t> _lastLog = { 0 };
+		std::atomic<float> _rate = { 0.0f };
+
+		PoseHistogram _interArrival;
+		PoseHistogram _jitter;
+		PoseHistogram _queueLatency;
+
+		// Owned by the receive thread.
+		uint64_t _lastDelta = 0;
+		uint64_t _windowStart = 0;
+		uint64_t _windowPackets = 0;
+
+		// Owned by the render thread.
+		uint64_t _lastSequence = 0;
+
+		// Owned by the reporting thread.
+		uint64_t _reportTime = 0;
+		uint64_t _reportPackets = 0;
+		uint64_t _reportFailures = 0;
+		uint64_t _reportSuperseded = 0;
+		uint64_t _reportApplied = 0;
+		uint64_t _reportOverwritten = 0;
+		uint64_t _reportJitter[PoseHistogram::kBuckets] = {};
+		uint64_t _reportLatency[PoseHistogram::kBuckets] = {};
+	};
+
+}
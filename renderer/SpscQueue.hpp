@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+
+#pragma once
+
+# include <atomic>
+# include <cstddef>
+
+namespace sibr {
+
+	/**
+	 * Bounded wait-free queue between exactly one producer and one consumer
+	 * thread. Storage is inline, nothing is allocated after construction.
+	 */
+	template<typename T, size_t Capacity>
+	class SpscQueue
+	{
+		static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+	public:
+
+		/** Producer: append value, false if the queue holds limit elements or more. */
+		bool push(const T& value, size_t limit = Capacity)
+		{
+			const size_t tail = _tail.load(std::memory_order_relaxed);
+			if (tail - _head.load(std::memory_order_acquire) >= (limit < Capacity ? limit : Capacity))
+				return false;
+			_items[tail & (Capacity - 1)] = value;
+			_tail.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+		/** Consumer: take the oldest element, false if empty. */
+		bool pop(T& value)
+		{
+			const size_t head = _head.load(std::memory_order_relaxed);
+			if (head == _tail.load(std::memory_order_acquire))
+				return false;
+			value = _items[head & (Capacity - 1)];
+			_head.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+		/** Consumer: the oldest element without removing it, nullptr if empty. */
+		const T* front() const
+		{
+			const size_t head = _head.load(std::memory_order_relaxed);
+			if (head == _tail.load(std::memory_order_acquire))
+				return nullptr;
+			return &_items[head & (Capacity - 1)];
+		}
+
+		/** \return the number of queued elements, exact only on the consumer side. */
+		size_t size() const
+		{
+			return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+		}
+
+	private:
+		T _items[Capacity];
+		alignas(64) std::atomic<size_t> _head = { 0 };
+		alignas(64) std::atomic<size_t> _tail = { 0 };
+	};
+
+}
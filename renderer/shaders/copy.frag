@@ -10,34 +10,19 @@
  */
 
 
-#version 450
-
-layout(location = 0) out vec4 out_color;
+// Fetch of DisplayFormat::Float buffers (three float planes), appended to copy_upscale.frag.
 
 layout(std430, binding = 0) buffer colorLayout
 {
     float data[];
 } source;
 
-uniform bool flip = false;
-uniform int width = 1000;
-uniform int height = 800;
-
-in vec4 texcoord;
-
-void main(void)
+vec3 fetch(int x, int y)
 {
-	int x = int(texcoord.x * width);
-	int y;
-	
+	x = clamp(x, 0, width - 1);
+	y = clamp(y, 0, height - 1);
 	if(flip)
-		y = height - 1 - int(texcoord.y * height);
-	else
-		y = int(texcoord.y * height);
-	
-	float r = source.data[0 * width * height + (y * width + x)];
-	float g = source.data[1 * width * height + (y * width + x)];
-	float b = source.data[2 * width * height + (y * width + x)];
-    vec4 color   = vec4(r, g, b, 1);
-    out_color    = color;
+		y = height - 1 - y;
+	int i = y * width + x;
+	return vec3(source.data[i], source.data[width * height + i], source.data[2 * width * height + i]);
 }
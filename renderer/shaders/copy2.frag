@@ -10,35 +10,21 @@
  */
 
 
-#version 450
-
-layout(location = 0) out vec4 out_color;
+// Fetch of DisplayFormat::RGBA8 buffers, appended to copy_upscale.frag.
 
 layout(std430, binding = 0) buffer colorLayout
 {
     uint data[];
 } source;
 
-uniform bool flip = false;
-uniform int width = 1000;
-uniform int height = 800;
-
-in vec4 texcoord;
-
-void main(void)
+vec3 fetch(int x, int y)
 {
-	int x = int(texcoord.x * width);
-	int y;
-	
+	x = clamp(x, 0, width - 1);
+	y = clamp(y, 0, height - 1);
 	if(flip)
-		y = height - 1 - int(texcoord.y * height);
-	else
-		y = int(texcoord.y * height);
-
-	uint rgba = source.data[(y * width + x)];
+		y = height - 1 - y;
+	int i = y * width + x;
+	uint rgba = source.data[i];
 	float frac = 1.0f/255.0f;
-	float r = (rgba & 0xFF) * frac;
-	float g = ((rgba >> 8) & 0xFF) * frac;
-	float b = ((rgba >> 16) & 0xFF) * frac;
-    out_color = vec4(r, g, b, 1);
+	return vec3(rgba & 0xFF, (rgba >> 8) & 0xFF, (rgba >> 16) & 0xFF) * frac;
 }
@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2020, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use 
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact sibr@inria.fr and/or George.Drettakis@inria.fr
+ */
+
+
+// Fetch of DisplayFormat::Half buffers, appended to copy_upscale.frag.
+
+layout(std430, binding = 0) buffer colorLayout
+{
+    uint data[];
+} source;
+
+vec3 fetch(int x, int y)
+{
+	x = clamp(x, 0, width - 1);
+	y = clamp(y, 0, height - 1);
+	if(flip)
+		y = height - 1 - y;
+	int i = y * width + x;
+	// DisplayFormat::Half: red and green, then blue and an unused half.
+	vec2 rg = unpackHalf2x16(source.data[2 * i]);
+	vec2 b = unpackHalf2x16(source.data[2 * i + 1]);
+	return vec3(rg, b.x);
+}
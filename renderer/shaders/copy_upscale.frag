@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2020, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use 
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact sibr@inria.fr and/or George.Drettakis@inria.fr
+ */
+
+
+#version 450
+
+// Upscaling copy pass shared by every display format. BufferCopyRenderer appends
+// the fetch of the format (copy.frag, copy_half.frag or copy2.frag) to this source.
+
+layout(location = 0) out vec4 out_color;
+
+uniform bool flip = false;
+uniform int width = 1000;
+uniform int height = 800;
+uniform int upscale = 0; ///< UpscaleFilter: 0 nearest, 1 bilinear, 2 bicubic.
+
+in vec4 texcoord;
+
+// Color of source pixel (x, y), clamped to the source and flipped if requested.
+vec3 fetch(int x, int y);
+
+// Catmull-Rom weights of the four taps around a sample at fraction t.
+vec4 catmullRom(float t)
+{
+	float t2 = t * t;
+	float t3 = t2 * t;
+	return vec4(-0.5 * t3 + t2 - 0.5 * t,
+		1.5 * t3 - 2.5 * t2 + 1.0,
+		-1.5 * t3 + 2.0 * t2 + 0.5 * t,
+		0.5 * t3 - 0.5 * t2);
+}
+
+void main(void)
+{
+	// The source may be smaller than the target when rendering at a reduced resolution.
+	vec2 p = texcoord.xy * vec2(width, height);
+	if (upscale == 0)
+	{
+		out_color = vec4(fetch(int(p.x), int(p.y)), 1);
+		return;
+	}
+
+	p -= 0.5;
+	ivec2 i = ivec2(floor(p));
+	vec2 f = p - floor(p);
+	vec3 color;
+	if (upscale == 1)
+	{
+		color = mix(mix(fetch(i.x, i.y), fetch(i.x + 1, i.y), f.x),
+			mix(fetch(i.x, i.y + 1), fetch(i.x + 1, i.y + 1), f.x), f.y);
+	}
+	else
+	{
+		vec4 wx = catmullRom(f.x);
+		vec4 wy = catmullRom(f.y);
+		color = vec3(0);
+		for (int v = 0; v < 4; v++)
+		{
+			vec3 row = wx.x * fetch(i.x - 1, i.y + v - 1) + wx.y * fetch(i.x, i.y + v - 1)
+				+ wx.z * fetch(i.x + 1, i.y + v - 1) + wx.w * fetch(i.x + 2, i.y + v - 1);
+			color += wy[v] * row;
+		}
+		color = max(color, vec3(0));
+	}
+	out_color = vec4(color, 1);
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "Check.hpp"
+
+#include <ArenaPlacement.hpp>
+
+using namespace sibr;
+
+namespace {
+
+	void testAlignment()
+	{
+		// The capacity is rounded down, block sizes up.
+		ArenaPlacement placement(1000, 256);
+		CHECK(placement.capacity() == 768);
+		CHECK(ArenaPlacement::aligned(1, 256) == 256);
+		CHECK(ArenaPlacement::aligned(256, 256) == 256);
+		CHECK(ArenaPlacement::aligned(257, 256) == 512);
+
+		CHECK(placement.place(1) == 0);
+		CHECK(placement.blockSize(0) == 256);
+		CHECK(placement.place(0) == 256);
+		CHECK(placement.blockSize(256) == 256);
+		CHECK(placement.used() == 512);
+		CHECK(placement.blockSize(128) == 0);
+	}
+
+	void testFirstFit()
+	{
+		ArenaPlacement placement(1024, 64);
+		const size_t a = placement.place(128);
+		const size_t b = placement.place(256);
+		const size_t c = placement.place(128);
+		CHECK(a == 0 && b == 128 && c == 384);
+
+		// Free ranges: 256 bytes at 128 and 512 bytes at 512, the first one that fits wins.
+		CHECK(placement.release(b));
+		CHECK(placement.place(64) == 128);
+		CHECK(placement.place(256) == 512);
+		CHECK(placement.place(192) == 192);
+		CHECK(placement.largestFree() == 256);
+	}
+
+	void testNoSpace()
+	{
+		ArenaPlacement placement(512, 64);
+		CHECK(placement.place(513) == ArenaPlacement::kNoSpace);
+		CHECK(placement.place(512) == 0);
+		CHECK(placement.place(1) == ArenaPlacement::kNoSpace);
+		CHECK(placement.largestFree() == 0);
+		CHECK(placement.blocks() == 1);
+
+		// Enough free bytes in total, but not in one range.
+		CHECK(placement.release(0));
+		const size_t a = placement.place(128);
+		const size_t b = placement.place(128);
+		placement.place(128);
+		placement.place(128);
+		CHECK(placement.release(a) && placement.release(b + 128));
+		CHECK(placement.largestFree() == 128);
+		CHECK(placement.place(256) == ArenaPlacement::kNoSpace);
+
+		CHECK(!placement.release(64));
+		CHECK(!placement.release(a));
+		CHECK(ArenaPlacement().place(1) == ArenaPlacement::kNoSpace);
+	}
+
+	void testCoalescing()
+	{
+		ArenaPlacement placement(640, 64);
+		const size_t a = placement.place(128);
+		const size_t b = placement.place(128);
+		const size_t c = placement.place(128);
+		const size_t d = placement.place(128);
+		placement.place(128);
+		CHECK(placement.largestFree() == 0);
+
+		// b merges with a before it, then c with the range before and d's range after.
+		CHECK(placement.release(a));
+		CHECK(placement.release(b));
+		CHECK(placement.largestFree() == 256);
+		CHECK(placement.release(d));
+		CHECK(placement.largestFree() == 256);
+		CHECK(placement.release(c));
+		CHECK(placement.largestFree() == 512);
+		CHECK(placement.place(512) == 0);
+		CHECK(placement.used() == 640);
+		CHECK(placement.blocks() == 2);
+	}
+
+}
+
+int main()
+{
+	testAlignment();
+	testFirstFit();
+	testNoSpace();
+	testCoalescing();
+	return checkResult("arena placement");
+}
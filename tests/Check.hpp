@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+
+#pragma once
+
+# include <iostream>
+
+/** Failed checks of the test executable, main() returns nonzero if any. */
+inline int& checkFailures()
+{
+	static int failures = 0;
+	return failures;
+}
+
+# define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; \
+			checkFailures()++; \
+		} \
+	} while (0)
+
+/** \return the exit code of the test executable. */
+inline int checkResult(const char* name)
+{
+	if (checkFailures() == 0)
+		std::cout << "[" << name << "] passed" << std::endl;
+	else
+		std::cerr << "[" << name << "] " << checkFailures() << " checks failed" << std::endl;
+	return checkFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "Check.hpp"
+
+#include <Compaction.hpp>
+
+#include <algorithm>
+#include <random>
+
+using namespace sibr::Compaction;
+
+namespace {
+
+	const int kStride = 3;
+
+	/** Value of float j of Gaussian k of hierarchy node cpu. */
+	float payloadValue(int cpu, int k, int j)
+	{
+		return float(cpu * 1000 + k * kStride + j);
+	}
+
+	/** Give resident slot s its children, appended the way the maintenance step does. */
+	void expand(HostStore& store, int s, int children, std::mt19937& rng, int& nextCpu)
+	{
+		store.slots[s].start_children = int(store.slots.size());
+		for (int c = 0; c < children; c++)
+		{
+			Slot child;
+			child.cpu = nextCpu++;
+			child.parent = s;
+			child.start = int(store.payload.size()) / kStride;
+			child.count = int(rng() % 6);
+			child.start_children = -1;
+			for (int k = 0; k < child.count; k++)
+				for (int j = 0; j < kStride; j++)
+					store.payload.push_back(payloadValue(child.cpu, k, j));
+			store.slots.push_back(child);
+		}
+	}
+
+	/** Random hierarchy of about numSlots resident slots. */
+	HostStore randomStore(int numSlots, std::mt19937& rng, int& nextCpu)
+	{
+		HostStore store;
+		store.stride = kStride;
+		store.slots.push_back({ nextCpu++, -1, 0, 0, -1 });
+		while (int(store.slots.size()) < numSlots)
+		{
+			int s = int(rng() % store.slots.size());
+			if (store.slots[s].start_children < 0)
+				expand(store, s, 2 + int(rng() % 3), rng, nextCpu);
+		}
+		return store;
+	}
+
+	/** Random active set among the slots without resident children. */
+	std::vector<int> randomActive(const HostStore& store, std::mt19937& rng)
+	{
+		std::vector<int> active;
+		for (int s = 0; s < int(store.slots.size()); s++)
+		{
+			if (store.slots[s].start_children < 0 && rng() % 3 == 0)
+				active.push_back(s);
+		}
+		return active;
+	}
+
+	/** Check that compacted slot n holds old slot s of src with its payload. */
+	void checkSlot(const HostStore& src, int s, const std::vector<Slot>& slots, const std::vector<float>& payload, int n)
+	{
+		const Slot& o = src.slots[s];
+		const Slot& c = slots[n];
+		CHECK(c.cpu == o.cpu);
+		CHECK(c.count == o.count);
+		for (int k = 0; k < o.count; k++)
+			for (int j = 0; j < kStride; j++)
+				CHECK(payload[size_t(c.start + k) * kStride + j] == payloadValue(o.cpu, k, j));
+	}
+
+	void testCompactFrom()
+	{
+		std::mt19937 rng(7);
+		for (int round = 0; round < 20; round++)
+		{
+			int nextCpu = 0;
+			HostStore src = randomStore(200 + round * 50, rng, nextCpu);
+			std::vector<int> active = randomActive(src, rng);
+			const std::vector<int> originalActive = active;
+
+			std::vector<char> live;
+			Measure measure = markLive(src.slots.data(), int(src.slots.size()), active.data(), int(active.size()), live);
+
+			Policy policy;
+			policy.sliceGaussians = 37;
+			policy.sliceRuns = 5;
+
+			HostStore dst;
+			int steps = dst.compactFrom(src, active, policy);
+			CHECK(measure.liveGaussians == 0 || steps > 1);
+			CHECK(int(dst.slots.size()) == measure.liveSlots);
+			CHECK(int(dst.payload.size()) == measure.liveGaussians * kStride);
+
+			// The compacted store is dense: slots are back to back in the payload.
+			int next = 0;
+			for (const Slot& slot : dst.slots)
+			{
+				CHECK(slot.start == next);
+				next += slot.count;
+			}
+
+			// Run the same compaction again to get at the remap.
+			Compactor compactor;
+			std::vector<Run> runs;
+			compactor.begin(src.slots.data(), int(src.slots.size()), originalActive.data(), int(originalActive.size()));
+			compactor.finish(src.slots.data(), int(src.slots.size()), originalActive.data(), int(originalActive.size()), runs);
+			const std::vector<int>& remap = compactor.remap();
+
+			for (int s = 0; s < int(src.slots.size()); s++)
+			{
+				CHECK((remap[s] != -1) == bool(live[s]));
+				if (remap[s] == -1)
+					continue;
+				checkSlot(src, s, dst.slots, dst.payload, remap[s]);
+				const Slot& slot = dst.slots[remap[s]];
+				CHECK(slot.parent == (src.slots[s].parent < 0 ? -1 : remap[src.slots[s].parent]));
+				CHECK(slot.start_children == (src.slots[s].start_children < 0 ? -1 : remap[src.slots[s].start_children]));
+			}
+			for (size_t i = 0; i < active.size(); i++)
+				CHECK(active[i] == remap[originalActive[i]]);
+		}
+	}
+
+	void testSlices()
+	{
+		std::mt19937 rng(11);
+		int nextCpu = 0;
+		HostStore src = randomStore(500, rng, nextCpu);
+		std::vector<int> active = randomActive(src, rng);
+
+		Compactor compactor;
+		compactor.begin(src.slots.data(), int(src.slots.size()), active.data(), int(active.size()));
+		CHECK(compactor.running());
+
+		const int maxGaussians = 23, maxRuns = 4;
+		std::vector<Run> runs;
+		int end = 0;
+		bool more = true;
+		while (more)
+		{
+			more = compactor.nextSlice(maxGaussians, maxRuns, runs);
+			int moved = 0;
+			for (const Run& r : runs)
+			{
+				CHECK(r.count > 0);
+				CHECK(r.dst >= end);
+				end = r.dst + r.count;
+				moved += r.count;
+			}
+			CHECK(moved <= maxGaussians);
+			CHECK(int(runs.size()) <= maxRuns);
+		}
+		CHECK(compactor.movedGaussians() == compactor.plannedGaussians());
+		CHECK(end == compactor.plannedGaussians());
+	}
+
+	void testAppendedDuringCompaction()
+	{
+		std::mt19937 rng(13);
+		for (int round = 0; round < 20; round++)
+		{
+			int nextCpu = 0;
+			HostStore src = randomStore(300, rng, nextCpu);
+			std::vector<int> active = randomActive(src, rng);
+			const int snapshotSlots = int(src.slots.size());
+
+			HostStore dst;
+			dst.stride = kStride;
+			dst.payload.resize(src.payload.size() * 2);
+
+			Compactor compactor;
+			compactor.begin(src.slots.data(), snapshotSlots, active.data(), int(active.size()));
+			std::vector<Run> runs;
+			compactor.nextSlice(50, 8, runs);
+			dst.copyRuns(src, runs);
+			const int handedOut = runs.empty() ? 0 : runs.back().dst + runs.back().count;
+
+			// The cut moves on while the payload is copied: some active leaves get their children.
+			std::vector<int> moved;
+			for (int a : active)
+			{
+				if (rng() % 2 == 0)
+				{
+					int first = int(src.slots.size());
+					expand(src, a, 2, rng, nextCpu);
+					moved.push_back(first);
+					moved.push_back(first + 1);
+				}
+				else
+					moved.push_back(a);
+			}
+			active = moved;
+
+			std::vector<Run> tailRuns;
+			compactor.finish(src.slots.data(), int(src.slots.size()), active.data(), int(active.size()), tailRuns);
+			int end = handedOut;
+			for (const Run& r : tailRuns)
+			{
+				CHECK(r.dst >= end);
+				end = r.dst + r.count;
+			}
+			CHECK(end == compactor.gaussianCount());
+			dst.copyRuns(src, tailRuns);
+
+			const std::vector<int>& remap = compactor.remap();
+			for (int a : active)
+				CHECK(remap[a] != -1);
+			for (int s = 0; s < int(src.slots.size()); s++)
+			{
+				if (remap[s] == -1)
+					continue;
+				checkSlot(src, s, compactor.slots(), dst.payload, remap[s]);
+				if (s >= snapshotSlots)
+					CHECK(remap[src.slots[s].parent] != -1);
+			}
+		}
+	}
+
+}
+
+int main()
+{
+	testCompactFrom();
+	testSlices();
+	testAppendedDuringCompaction();
+	return checkResult("compaction");
+}
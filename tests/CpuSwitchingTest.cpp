@@ -0,0 +1,479 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "Check.hpp"
+
+#include "TestHierarchy.hpp"
+
+#include <CpuSwitching.hpp>
+
+#include <cuda_runtime.h>
+#include <runtime_switching.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <random>
+#include <set>
+#include <tuple>
+
+using namespace sibr;
+using namespace sibr::Test;
+
+namespace {
+
+	bool wants(const Hierarchy& h, const Lod::Band& band, const Lod::Viewpoint& view, int id)
+	{
+		return h.nodes[id].count_children > 0 && band.decide(Lod::computeSize(h.boxes[id], &view, 1), false);
+	}
+
+	/** Cut without budget: every node that wants to is expanded. */
+	std::vector<int> referenceCut(const Hierarchy& h, const Lod::Band& band, const Lod::Viewpoint& view)
+	{
+		std::vector<int> cut;
+		std::vector<int> stack = { 0 };
+		while (!stack.empty())
+		{
+			int id = stack.back();
+			stack.pop_back();
+			if (!wants(h, band, view, id))
+			{
+				cut.push_back(id);
+				continue;
+			}
+			for (int c = 0; c < h.nodes[id].count_children; c++)
+				stack.push_back(h.nodes[id].start_children + c);
+		}
+		std::sort(cut.begin(), cut.end());
+		return cut;
+	}
+
+	/** Cut with budget: repeatedly try the largest node that wants to expand, keep it if it does not fit. */
+	std::vector<int> referenceGreedyCut(const Hierarchy& h, const Lod::Band& band, const Lod::Viewpoint& view, int budget, std::vector<int>& rejected)
+	{
+		std::set<int> cut = { 0 };
+		std::set<int> tried;
+		int64_t total = gaussianCount(h.nodes[0]);
+		rejected.clear();
+		while (true)
+		{
+			int best = -1;
+			float bestSize = -1.0f;
+			for (int id : cut)
+			{
+				if (tried.count(id) || !wants(h, band, view, id))
+					continue;
+				float size = Lod::computeSize(h.boxes[id], &view, 1);
+				if (size > bestSize)
+				{
+					best = id;
+					bestSize = size;
+				}
+			}
+			if (best < 0)
+				break;
+
+			tried.insert(best);
+			const Node& node = h.nodes[best];
+			int64_t grow = -gaussianCount(node);
+			for (int c = 0; c < node.count_children; c++)
+				grow += gaussianCount(h.nodes[node.start_children + c]);
+			if (total + grow > budget)
+			{
+				rejected.push_back(best);
+				continue;
+			}
+
+			total += grow;
+			cut.erase(best);
+			for (int c = 0; c < node.count_children; c++)
+				cut.insert(node.start_children + c);
+		}
+		std::sort(rejected.begin(), rejected.end());
+		return std::vector<int>(cut.begin(), cut.end());
+	}
+
+	int cutGaussians(const Hierarchy& h, const std::vector<int>& cut)
+	{
+		int total = 0;
+		for (int id : cut)
+			total += gaussianCount(h.nodes[id]);
+		return total;
+	}
+
+	/** The render arrays list the Gaussians of the active nodes in order. */
+	void checkLayout(const Hierarchy& h, const CpuSwitching::Cut& cut)
+	{
+		size_t k = 0;
+		for (int id : cut.active_nodes)
+		{
+			const Node& node = h.nodes[id];
+			for (int j = 0; j < gaussianCount(node); j++, k++)
+			{
+				CHECK(cut.render_indices[k] == node.start + j);
+				CHECK(cut.nodes_of_render_indices[k] == id);
+				CHECK(cut.parent_indices[k] == (node.parent >= 0 ? h.nodes[node.parent].start : -1));
+			}
+		}
+		CHECK(k == cut.render_indices.size());
+	}
+
+	Lod::Viewpoint randomView(std::mt19937& rng)
+	{
+		std::uniform_real_distribution<float> u(0.0f, 1.0f);
+		Lod::Viewpoint view;
+		view.position = { { -4.0f - 8.0f * u(rng), 16.0f * u(rng), 16.0f * u(rng) } };
+		Eigen::Vector3f dir = Eigen::Vector3f(8.0f, 8.0f, 8.0f) - Eigen::Vector3f(view.position.xyz[0], view.position.xyz[1], view.position.xyz[2]);
+		dir.normalize();
+		view.zdir = { { dir.x(), dir.y(), dir.z() } };
+		return view;
+	}
+
+	void testUnconstrained()
+	{
+		std::mt19937 rng(3);
+		for (int round = 0; round < 20; round++)
+		{
+			Hierarchy h = randomHierarchy(7, rng);
+			Lod::Viewpoint view = randomView(rng);
+			Lod::Band band = Lod::Band::make(0.05f + 0.1f * (round % 5), 0.0f);
+
+			CpuSwitching::State state;
+			CpuSwitching::Cut cut;
+			CpuSwitching::selectCut(h.nodes, h.boxes, &view, 1, band, 1 << 30, state, cut);
+
+			std::vector<int> active = cut.active_nodes;
+			std::sort(active.begin(), active.end());
+			CHECK(active == referenceCut(h, band, view));
+			CHECK(cut.nodes_to_expand.empty());
+			checkLayout(h, cut);
+		}
+	}
+
+	void testBudget()
+	{
+		std::mt19937 rng(5);
+		for (int round = 0; round < 20; round++)
+		{
+			Hierarchy h = randomHierarchy(6, rng);
+			Lod::Viewpoint view = randomView(rng);
+			Lod::Band band = Lod::Band::make(0.05f, 0.0f);
+			const int full = cutGaussians(h, referenceCut(h, band, view));
+
+			for (int budget : { full / 8, full / 3, full / 2, full - 1 })
+			{
+				CpuSwitching::State state;
+				CpuSwitching::Cut cut;
+				CpuSwitching::selectCut(h.nodes, h.boxes, &view, 1, band, budget, state, cut);
+
+				std::vector<int> rejected;
+				CHECK(cut.active_nodes == referenceGreedyCut(h, band, view, budget, rejected));
+				std::vector<int> toExpand = cut.nodes_to_expand;
+				std::sort(toExpand.begin(), toExpand.end());
+				CHECK(toExpand == rejected);
+				CHECK(cut.to_render() <= std::max(budget, gaussianCount(h.nodes[0])));
+				checkLayout(h, cut);
+			}
+		}
+	}
+
+	bool near(float a, float b)
+	{
+		return std::abs(a - b) < 1e-5f;
+	}
+
+	/** Box in front of a camera at the origin looking along x, at depth 10 with the given extent. */
+	Box boxAtDepth10(float extent)
+	{
+		Box box(Eigen::Vector3f(10, -1, -1), Eigen::Vector3f(12, 1, 1));
+		box.minn.xyz[3] = extent;
+		return box;
+	}
+
+	/** Blend weights of a root with two children, computed by hand. */
+	void testBlendFormula()
+	{
+		std::vector<Node> nodes(3);
+		for (Node& node : nodes)
+		{
+			node.depth = 1;
+			node.parent = 0;
+			node.start = 0;
+			node.count_leafs = 1;
+			node.count_merged = 0;
+			node.start_children = -1;
+			node.count_children = 0;
+		}
+		nodes[0].depth = 0;
+		nodes[0].parent = -1;
+		nodes[0].start_children = 1;
+		nodes[0].count_children = 2;
+
+		// Projected sizes: parent 0.4, a small child 0.1 and a large one 0.3.
+		std::vector<Box> boxes = { boxAtDepth10(4.0f), boxAtDepth10(1.0f), boxAtDepth10(3.0f) };
+		Lod::Viewpoint view;
+		view.position = { { 0, 0, 0 } };
+		view.zdir = { { 1, 0, 0 } };
+
+		const int owners[3] = { 0, 1, 2 };
+		float ts[3];
+		int kids[3];
+		auto weights = [&](float limit) {
+			CpuSwitching::getTsIndexed(3, owners, limit, nodes, boxes, view, ts, kids);
+		};
+
+		// The blend starts at the larger of half the parent and the child itself, and ends at the parent.
+		weights(0.25f);
+		CHECK(ts[0] == 1.0f && kids[0] == 1);
+		CHECK(near(ts[1], 1.0f - (0.25f - 0.2f) / (0.4f - 0.2f)));
+		CHECK(near(ts[2], 1.0f));
+		CHECK(kids[1] == 2 && kids[2] == 2);
+
+		weights(0.325f);
+		CHECK(near(ts[1], 1.0f - (0.325f - 0.2f) / (0.4f - 0.2f)));
+		CHECK(near(ts[2], 1.0f - (0.325f - 0.3f) / (0.4f - 0.3f)));
+
+		// Limit at the parent size: fully blended towards the parent.
+		weights(0.4f);
+		CHECK(near(ts[1], 0.0f) && near(ts[2], 0.0f));
+
+		// Parent larger than twice the limit: no blending at all.
+		weights(0.19f);
+		CHECK(ts[1] == 1.0f && ts[2] == 1.0f);
+	}
+
+	/** Range of the blend weights and child counts on the cuts of random hierarchies. */
+	void testBlendWeights()
+	{
+		std::mt19937 rng(7);
+		for (int round = 0; round < 20; round++)
+		{
+			Hierarchy h = randomHierarchy(6, rng);
+			Lod::Viewpoint view = randomView(rng);
+			const float limit = 0.05f + 0.1f * (round % 5);
+			Lod::Band band = Lod::Band::make(limit, 0.0f);
+
+			CpuSwitching::State state;
+			CpuSwitching::Cut cut;
+			CpuSwitching::selectCut(h.nodes, h.boxes, &view, 1, band, 1 << 30, state, cut);
+
+			const int N = cut.to_render();
+			std::vector<float> ts(N);
+			std::vector<int> kids(N);
+			CpuSwitching::getTsIndexed(N, cut.nodes_of_render_indices.data(), limit, h.nodes, h.boxes, view, ts.data(), kids.data());
+			for (int i = 0; i < N; i++)
+			{
+				const Node& node = h.nodes[cut.nodes_of_render_indices[i]];
+				CHECK(ts[i] >= 0.0f && ts[i] <= 1.0f);
+				if (node.parent < 0)
+				{
+					CHECK(ts[i] == 1.0f);
+					CHECK(kids[i] == 1);
+					continue;
+				}
+				CHECK(kids[i] == h.nodes[node.parent].count_children);
+				if (Lod::computeSize(h.boxes[node.parent], &view, 1) > 2.0f * limit)
+					CHECK(ts[i] == 1.0f);
+			}
+		}
+	}
+
+	/** Device copy of a fully resident hierarchy and the work arrays of the switching kernels. */
+	struct DeviceHierarchy
+	{
+		int* nodes = nullptr;
+		float* boxes = nullptr;
+		float* viewpoint = nullptr;
+		int* splits = nullptr;
+		int* active[2] = { nullptr, nullptr };
+		int* render_indices = nullptr;
+		int* parent_indices = nullptr;
+		int* nodes_of_render_indices = nullptr;
+		int* nodes_to_expand = nullptr;
+		int* NsrcI = nullptr;
+		int* NdstI = nullptr;
+		char* NsrcC = nullptr;
+		int* numI = nullptr;
+		float* ts = nullptr;
+		int* kids = nullptr;
+		char* scratchspace = nullptr;
+		size_t scratchspacesize = 0;
+		int* counts = nullptr; ///< Pinned: active nodes, Gaussians to render, nodes needing children.
+		int maxN = 0;
+
+		explicit DeviceHierarchy(const Hierarchy& h)
+		{
+			int gaussians = 0;
+			for (const Node& node : h.nodes)
+				gaussians += gaussianCount(node);
+			maxN = std::max(gaussians, (int)h.nodes.size());
+
+			cudaMalloc(&nodes, sizeof(Node) * h.nodes.size());
+			cudaMemcpy(nodes, h.nodes.data(), sizeof(Node) * h.nodes.size(), cudaMemcpyHostToDevice);
+			cudaMalloc(&boxes, sizeof(Box) * h.boxes.size());
+			cudaMemcpy(boxes, h.boxes.data(), sizeof(Box) * h.boxes.size(), cudaMemcpyHostToDevice);
+			cudaMalloc(&viewpoint, sizeof(Point));
+			cudaMalloc(&splits, sizeof(int) * maxN);
+			cudaMemset(splits, 0, sizeof(int) * maxN);
+			for (int*& a : active)
+				cudaMalloc(&a, sizeof(int) * maxN);
+			for (int** a : { &render_indices, &parent_indices, &nodes_of_render_indices, &nodes_to_expand, &NsrcI, &NdstI, &kids })
+				cudaMalloc(a, sizeof(int) * maxN);
+			cudaMalloc(&NsrcC, maxN);
+			cudaMalloc(&numI, sizeof(int));
+			cudaMalloc(&ts, sizeof(float) * maxN);
+			cudaMallocHost(&counts, 3 * sizeof(int));
+		}
+
+		~DeviceHierarchy()
+		{
+			for (void* p : { (void*)nodes, (void*)boxes, (void*)viewpoint, (void*)splits, (void*)active[0], (void*)active[1],
+				(void*)render_indices, (void*)parent_indices, (void*)nodes_of_render_indices, (void*)nodes_to_expand,
+				(void*)NsrcI, (void*)NdstI, (void*)NsrcC, (void*)numI, (void*)ts, (void*)kids, (void*)scratchspace })
+				cudaFree(p);
+			cudaFreeHost(counts);
+		}
+
+		/** Run switching steps from the root until the cut stops changing, like the GPU path of the view. */
+		void cut(float limit, const Lod::Viewpoint& view)
+		{
+			const int root = 0;
+			cudaMemcpy(active[0], &root, sizeof(int), cudaMemcpyHostToDevice);
+			cudaMemcpy(viewpoint, &view.position, sizeof(Point), cudaMemcpyHostToDevice);
+			counts[0] = 1;
+			for (int step = 0; step < 64; step++)
+			{
+				const int before = counts[0];
+				int add_success = 0;
+				Switching::changeToSizeStep(
+					limit,
+					counts[0],
+					active[0],
+					active[1],
+					nodes,
+					boxes,
+					viewpoint,
+					view.zdir.xyz[0], view.zdir.xyz[1], view.zdir.xyz[2],
+					splits,
+					render_indices,
+					parent_indices,
+					nodes_of_render_indices,
+					nodes_to_expand,
+					nullptr,
+					scratchspace,
+					scratchspacesize,
+					NsrcI,
+					NdstI,
+					NsrcC,
+					numI,
+					maxN,
+					add_success,
+					&counts[0],
+					&counts[1],
+					&counts[2],
+					0);
+				cudaDeviceSynchronize();
+				CHECK(add_success == 1);
+				std::swap(active[0], active[1]);
+				if (step > 0 && counts[0] == before)
+					break;
+			}
+		}
+
+		template<typename T>
+		std::vector<T> download(const T* ptr, int count) const
+		{
+			std::vector<T> host(count);
+			cudaMemcpy(host.data(), ptr, sizeof(T) * count, cudaMemcpyDeviceToHost);
+			return host;
+		}
+	};
+
+	/** Same cut, Gaussians and blend weights as the switching kernels on a fully resident hierarchy. */
+	void testDeviceParity()
+	{
+		int devices = 0;
+		if (cudaGetDeviceCount(&devices) != cudaSuccess || devices == 0)
+		{
+			std::cout << "[cpu switching] no CUDA device, parity with the switching kernels not checked" << std::endl;
+			return;
+		}
+
+		std::mt19937 rng(9);
+		for (int round = 0; round < 10; round++)
+		{
+			Hierarchy h = randomHierarchy(6, rng);
+			Lod::Viewpoint view = randomView(rng);
+			const float limit = 0.05f + 0.05f * (round % 4);
+			Lod::Band band = Lod::Band::make(limit, 0.0f);
+
+			CpuSwitching::State state;
+			CpuSwitching::Cut cut;
+			CpuSwitching::selectCut(h.nodes, h.boxes, &view, 1, band, 1 << 30, state, cut);
+
+			DeviceHierarchy device(h);
+			device.cut(band.collapse, view);
+			CHECK(device.counts[2] == 0);
+
+			std::vector<int> active = device.download(device.active[0], device.counts[0]);
+			std::sort(active.begin(), active.end());
+			std::vector<int> hostActive = cut.active_nodes;
+			std::sort(hostActive.begin(), hostActive.end());
+			CHECK(active == hostActive);
+
+			// The kernels may order the Gaussians differently, compare them as sets.
+			const int N = device.counts[1];
+			CHECK(N == cut.to_render());
+			if (N != cut.to_render())
+				continue;
+			const std::vector<int> render = device.download(device.render_indices, N);
+			const std::vector<int> parents = device.download(device.parent_indices, N);
+			const std::vector<int> owners = device.download(device.nodes_of_render_indices, N);
+			std::vector<std::tuple<int, int, int>> deviceGaussians, hostGaussians;
+			for (int i = 0; i < N; i++)
+			{
+				deviceGaussians.emplace_back(render[i], parents[i], owners[i]);
+				hostGaussians.emplace_back(cut.render_indices[i], cut.parent_indices[i], cut.nodes_of_render_indices[i]);
+			}
+			std::sort(deviceGaussians.begin(), deviceGaussians.end());
+			std::sort(hostGaussians.begin(), hostGaussians.end());
+			CHECK(deviceGaussians == hostGaussians);
+
+			// Blend weights of the device cut, from both implementations.
+			Switching::getTsIndexed(N, device.nodes_of_render_indices, limit, device.nodes, device.boxes,
+				view.position.xyz[0], view.position.xyz[1], view.position.xyz[2],
+				view.zdir.xyz[0], view.zdir.xyz[1], view.zdir.xyz[2],
+				device.ts, device.kids, 0);
+			cudaDeviceSynchronize();
+			const std::vector<float> ts = device.download(device.ts, N);
+			const std::vector<int> kids = device.download(device.kids, N);
+			std::vector<float> hostTs(N);
+			std::vector<int> hostKids(N);
+			CpuSwitching::getTsIndexed(N, owners.data(), limit, h.nodes, h.boxes, view.position, view.zdir, hostTs.data(), hostKids.data());
+			for (int i = 0; i < N; i++)
+			{
+				CHECK(std::abs(ts[i] - hostTs[i]) < 1e-4f);
+				CHECK(kids[i] == hostKids[i]);
+			}
+		}
+	}
+
+}
+
+int main()
+{
+	testUnconstrained();
+	testBudget();
+	testBlendFormula();
+	testBlendWeights();
+	testDeviceParity();
+	return checkResult("cpu switching");
+}
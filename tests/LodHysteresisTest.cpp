@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "Check.hpp"
+
+#include <LodHysteresis.hpp>
+
+#include <cmath>
+
+using namespace sibr::Lod;
+
+namespace {
+
+	void testBand()
+	{
+		Band band = Band::make(1.0f, 0.44f);
+		CHECK(std::abs(band.expand - 1.2f) < 1e-5f);
+		CHECK(std::abs(band.collapse - 1.0f / 1.2f) < 1e-5f);
+		CHECK(std::abs(band.expand / band.collapse - 1.44f) < 1e-5f);
+
+		// Between the thresholds a node keeps its previous state.
+		CHECK(!band.decide(1.0f, false));
+		CHECK(band.decide(1.0f, true));
+		CHECK(!band.decide(band.expand, false));
+		CHECK(band.decide(band.collapse, true));
+
+		CHECK(band.decide(1.3f, false));
+		CHECK(band.decide(1.3f, true));
+		CHECK(!band.decide(0.8f, false));
+		CHECK(!band.decide(0.8f, true));
+
+		// Without hysteresis (or a negative ratio) both thresholds are the size limit.
+		for (float ratio : { 0.0f, -1.0f })
+		{
+			Band flat = Band::make(0.5f, ratio);
+			CHECK(flat.expand == 0.5f && flat.collapse == 0.5f);
+			CHECK(flat.decide(0.5f, true));
+			CHECK(!flat.decide(0.5f, false));
+		}
+	}
+
+	void testFlipCounter()
+	{
+		FlipCounter counter;
+		counter.window = 10;
+		counter.resize(4);
+
+		// Re-expanded within the window: a flip. At or after the window: not.
+		CHECK(!counter.expanded(1, 0));
+		CHECK(counter.expanded(1, 9));
+		CHECK(!counter.expanded(1, 19));
+		CHECK(!counter.expanded(2, 5));
+		CHECK(counter.expanded(2, 6));
+		CHECK(counter.totalExpansions() == 5);
+		CHECK(counter.totalFlips() == 2);
+
+		// Nodes out of range are counted as expansions only.
+		CHECK(!counter.expanded(4, 20));
+		CHECK(!counter.expanded(-1, 20));
+		CHECK(counter.totalExpansions() == 7);
+		CHECK(counter.totalFlips() == 2);
+
+		counter.held(3);
+		counter.nextPeriod();
+		CHECK(counter.lastPeriodFlips() == 2);
+		CHECK(counter.lastPeriodHeld() == 3);
+
+		CHECK(counter.expanded(2, 10));
+		counter.held();
+		counter.nextPeriod();
+		CHECK(counter.lastPeriodFlips() == 1);
+		CHECK(counter.lastPeriodHeld() == 1);
+		CHECK(counter.totalFlips() == 3);
+		CHECK(counter.totalHeld() == 4);
+
+		// Resizing forgets the history.
+		counter.resize(4);
+		CHECK(!counter.expanded(2, 11));
+	}
+
+}
+
+int main()
+{
+	testBand();
+	testFlipCounter();
+	return checkResult("lod hysteresis");
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "Check.hpp"
+
+#include <PosePredictor.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace sibr;
+
+namespace {
+
+	/** Pose at x on the sender clock time, received latency microseconds later. */
+	PoseMessage poseAt(float x, uint64_t time, uint64_t latency = 1000)
+	{
+		PoseMessage pose;
+		pose.position[0] = x;
+		pose.rotation[0] = 1.0f;
+		pose.timestamp = time;
+		pose.receivedAt = time + latency;
+		return pose;
+	}
+
+	bool near(float a, float b)
+	{
+		return std::abs(a - b) < 1e-3f * std::max(1.0f, std::abs(b));
+	}
+
+	/** Three poses moving at 100 units per second along x, 10 ms apart. */
+	void observeMotion(PosePredictor& predictor)
+	{
+		for (int i = 0; i < 3; i++)
+			predictor.observe(poseAt(1.0f * i, 1000000 + 10000 * i));
+	}
+
+	void testVelocity()
+	{
+		PosePredictor predictor;
+		predictor.smoothing = 1.0f;
+		Eigen::Vector3f position;
+		Eigen::Quaternionf rotation;
+		CHECK(!predictor.predict(0, position, rotation));
+
+		observeMotion(predictor);
+		CHECK(near(predictor.velocity().x(), 100.0f));
+		CHECK(predictor.clockOffset() == 1000);
+
+		// 20 ms after the last pose was sent: 2 units further.
+		CHECK(predictor.predict(1020000 + 1000 + 20000, position, rotation));
+		CHECK(predictor.lastHorizon() == 20000);
+		CHECK(near(position.x(), 4.0f));
+	}
+
+	void testReorder()
+	{
+		PosePredictor predictor;
+		predictor.smoothing = 1.0f;
+		observeMotion(predictor);
+
+		// A datagram overtaken by the newer ones changes neither the pose nor the velocity.
+		predictor.observe(poseAt(0.5f, 1005000));
+		CHECK(near(predictor.velocity().x(), 100.0f));
+		Eigen::Vector3f position;
+		Eigen::Quaternionf rotation;
+		predictor.predict(1020000 + 1000, position, rotation);
+		CHECK(near(position.x(), 2.0f));
+
+		// Neither does a duplicate.
+		predictor.observe(poseAt(2.0f, 1020000));
+		CHECK(near(predictor.velocity().x(), 100.0f));
+	}
+
+	void testGap()
+	{
+		PosePredictor predictor;
+		predictor.smoothing = 1.0f;
+		observeMotion(predictor);
+
+		// Resuming after a pause restarts the estimate, the pose jumps without extrapolating the jump.
+		predictor.observe(poseAt(50.0f, 1020000 + predictor.maxGap + 1));
+		CHECK(predictor.velocity().isZero());
+		Eigen::Vector3f position;
+		Eigen::Quaternionf rotation;
+		predictor.predict(1020000 + predictor.maxGap + 1 + 1000 + 30000, position, rotation);
+		CHECK(near(position.x(), 50.0f));
+	}
+
+	void testHorizon()
+	{
+		PosePredictor predictor;
+		predictor.smoothing = 1.0f;
+		observeMotion(predictor);
+		Eigen::Vector3f position;
+		Eigen::Quaternionf rotation;
+
+		// Far in the future: clamped to the horizon.
+		predictor.predict(1020000 + 1000 + 10 * predictor.maxHorizon, position, rotation);
+		CHECK(predictor.lastHorizon() == int64_t(predictor.maxHorizon));
+		CHECK(near(position.x(), 2.0f + 100.0f * predictor.maxHorizon * 1e-6f));
+
+		// Before the last pose: never extrapolated backwards.
+		predictor.predict(1000000, position, rotation);
+		CHECK(predictor.lastHorizon() == 0);
+		CHECK(near(position.x(), 2.0f));
+	}
+
+}
+
+int main()
+{
+	testVelocity();
+	testReorder();
+	testGap();
+	testHorizon();
+	return checkResult("pose predictor");
+}
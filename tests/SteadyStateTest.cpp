@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+#include "Check.hpp"
+#include "TestHierarchy.hpp"
+
+#include <CpuRasterizer.hpp>
+#include <CpuSwitching.hpp>
+#include <IdleSkip.hpp>
+#include <LatencyTrace.hpp>
+#include <PoseMailbox.hpp>
+#include <PoseMessage.hpp>
+#include <PosePredictor.hpp>
+#include <PoseTelemetry.hpp>
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+// Count every heap allocation of the process, the steady state must not make any.
+static std::atomic<uint64_t> _allocations {0};
+
+// Every form of new and delete goes through this pair. They are kept out of line so
+// the compiler does not see std::free applied to the result of operator new.
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+static void* countedAlloc(size_t size)
+{
+	_allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+static void countedFree(void* p) noexcept
+{
+	std::free(p);
+}
+
+void* operator new(size_t size) { return countedAlloc(size); }
+void* operator new[](size_t size) { return countedAlloc(size); }
+void operator delete(void* p) noexcept { countedFree(p); }
+void operator delete[](void* p) noexcept { countedFree(p); }
+void operator delete(void* p, size_t) noexcept { countedFree(p); }
+void operator delete[](void* p, size_t) noexcept { countedFree(p); }
+
+using namespace sibr;
+using namespace sibr::Test;
+
+namespace {
+
+	const int kFramesPerLoop = 90;
+	const int kWidth = 64, kHeight = 48;
+
+	/** Host Gaussians for every node of the hierarchy, inside the node's box. */
+	struct Gaussians
+	{
+		std::vector<float> pos, rot, scale, alpha, shs;
+
+		explicit Gaussians(const Hierarchy& h)
+		{
+			size_t total = 0;
+			for (const Node& node : h.nodes)
+				total += gaussianCount(node);
+			pos.resize(total * 3);
+			rot.resize(total * 4);
+			scale.resize(total * 3);
+			alpha.assign(total, 0.6f);
+			shs.assign(total * 48, 0.0f);
+
+			for (size_t id = 0; id < h.nodes.size(); id++)
+			{
+				const Box& box = h.boxes[id];
+				for (int k = 0; k < gaussianCount(h.nodes[id]); k++)
+				{
+					const size_t g = h.nodes[id].start + k;
+					for (int a = 0; a < 3; a++)
+					{
+						const float extent = box.maxx.xyz[a] - box.minn.xyz[a];
+						pos[g * 3 + a] = box.minn.xyz[a] + extent * (k + 1) / (gaussianCount(h.nodes[id]) + 1);
+						scale[g * 3 + a] = 0.2f * extent;
+						shs[g * 48 + a] = 0.2f * a + 0.1f * float(id % 5);
+					}
+					rot[g * 4] = 1.0f;
+				}
+			}
+		}
+
+		CpuRasterizer::Splats splats() const
+		{
+			CpuRasterizer::Splats s;
+			s.pos = pos.data();
+			s.rot = rot.data();
+			s.scale = scale.data();
+			s.alpha = alpha.data();
+			s.shs = shs.data();
+			return s;
+		}
+	};
+
+	/** Pose of frame i of the orbit around the hierarchy, repeated every kFramesPerLoop frames. */
+	PoseMessage orbitPose(int frame)
+	{
+		const float angle = 6.2831853f * float(frame % kFramesPerLoop) / kFramesPerLoop;
+		const Eigen::Vector3f center(8.0f, 8.0f, 8.0f);
+		const Eigen::Vector3f position = center + Eigen::Vector3f(std::cos(angle), std::sin(angle), 0.3f) * 14.0f;
+		const Eigen::Quaternionf rotation(Eigen::AngleAxisf(angle, Eigen::Vector3f::UnitZ()));
+
+		PoseMessage pose;
+		for (int a = 0; a < 3; a++)
+			pose.position[a] = position[a];
+		pose.rotation[0] = rotation.w();
+		pose.rotation[1] = rotation.x();
+		pose.rotation[2] = rotation.y();
+		pose.rotation[3] = rotation.z();
+		pose.sequence = uint32_t(frame + 1);
+		pose.timestamp = uint64_t(frame) * 16667;
+		return pose;
+	}
+
+	/** Camera looking at the center of the hierarchy from position, OpenCV axes like the scene cameras. */
+	void lookAt(const Eigen::Vector3f& position, Eigen::Matrix4f& viewMatrix, Eigen::Matrix4f& projMatrix, Lod::Viewpoint& viewpoint, float tanFov)
+	{
+		const Eigen::Vector3f z = (Eigen::Vector3f(8.0f, 8.0f, 8.0f) - position).normalized();
+		const Eigen::Vector3f x = z.cross(Eigen::Vector3f::UnitZ()).normalized();
+		const Eigen::Vector3f y = z.cross(x);
+
+		viewMatrix.setIdentity();
+		viewMatrix.block<1, 3>(0, 0) = x.transpose();
+		viewMatrix.block<1, 3>(1, 0) = y.transpose();
+		viewMatrix.block<1, 3>(2, 0) = z.transpose();
+		viewMatrix.block<3, 1>(0, 3) = -viewMatrix.block<3, 3>(0, 0) * position;
+
+		const float n = 0.01f, f = 100.0f;
+		Eigen::Matrix4f proj = Eigen::Matrix4f::Zero();
+		proj(0, 0) = 1.0f / tanFov;
+		proj(1, 1) = 1.0f / tanFov;
+		proj(2, 2) = f / (f - n);
+		proj(2, 3) = -f * n / (f - n);
+		proj(3, 2) = 1.0f;
+		projMatrix = proj * viewMatrix;
+
+		viewpoint.position = { { position.x(), position.y(), position.z() } };
+		viewpoint.zdir = { { z.x(), z.y(), z.z() } };
+	}
+
+}
+
+int main()
+{
+	std::mt19937 rng(17);
+	const Hierarchy h = randomHierarchy(7, rng);
+	const Gaussians gaussians(h);
+	const CpuRasterizer::Splats splats = gaussians.splats();
+
+	// State owned by the pose thread and the render loop of the viewer.
+	PoseMailbox mailbox;
+	PoseTelemetry telemetry;
+	PosePredictor predictor;
+	LatencyTrace trace;
+	IdleSkip idleSkip;
+	PoseSample sample;
+
+	// Maintenance and rendering state of the CPU backend, reused every frame.
+	const float sizeLimit = 0.05f;
+	const Lod::Band band = Lod::Band::make(sizeLimit, 0.0f);
+	const int budget = int(gaussians.alpha.size() / 4);
+	CpuSwitching::State switchingState;
+	CpuSwitching::Cut cut;
+	std::vector<float> ts;
+	std::vector<int> kids;
+	CpuRasterizer::Rasterizer rasterizer;
+	std::vector<float> image(size_t(kWidth) * kHeight * 3);
+	const float background[3] = { 0.0f, 0.0f, 0.0f };
+	const float tanFov = 0.6f;
+
+	// Datagrams of one receive batch: two binary packets and a JSON one.
+	char buffers[3][kMaxPoseMessage];
+	const char* data[3] = { buffers[0], buffers[1], buffers[2] };
+	size_t lengths[3];
+
+	uint64_t warmAllocations = 0;
+	int rendered = 0;
+	for (int frame = 0; frame < 4 * kFramesPerLoop; frame++)
+	{
+		// The first orbit is warm-up, every buffer has reached its largest size after it.
+		if (frame == kFramesPerLoop)
+			warmAllocations = _allocations.load();
+
+		// Receive thread: parse the newest pose of the batch and hand it over.
+		const PoseMessage sent = orbitPose(frame);
+		PoseMessage older = orbitPose(frame);
+		older.sequence -= 1;
+		lengths[0] = encodePoseBinary(older, buffers[0]);
+		lengths[1] = encodePoseBinary(sent, buffers[1]);
+		lengths[2] = (size_t)std::snprintf(buffers[2], kMaxPoseMessage,
+			"{\"position\":{\"x\":%f,\"y\":%f,\"z\":%f},\"rotation\":{\"w\":%f,\"x\":%f,\"y\":%f,\"z\":%f},\"sequence\":%u}",
+			sent.position[0], sent.position[1], sent.position[2], sent.rotation[0], sent.rotation[1], sent.rotation[2], sent.rotation[3], sent.sequence);
+
+		PoseMessage pose;
+		int rejected = 0;
+		const int chosen = parseNewestPose(data, lengths, 3, pose, rejected);
+		CHECK(chosen >= 0 && rejected == 0);
+		pose.receivedAt = PoseTelemetry::now();
+		telemetry.received(pose.receivedAt);
+		telemetry.superseded(2);
+		mailbox.publish(pose);
+
+		// Render loop: fetch and extrapolate the pose, select the cut, rasterize.
+		LatencyStamps stamps;
+		CHECK(mailbox.fetch(sample));
+		stamps.arrival = sample.pose.receivedAt;
+		stamps.applied = PoseTelemetry::now();
+		telemetry.applied(sample, stamps.applied);
+		predictor.observe(sample.pose);
+		Eigen::Vector3f predicted;
+		Eigen::Quaternionf predictedRotation;
+		predictor.predict(stamps.applied + 16667, predicted, predictedRotation);
+
+		Eigen::Matrix4f viewMatrix, projMatrix;
+		Lod::Viewpoint viewpoint;
+		lookAt(Eigen::Vector3f(sample.pose.position[0], sample.pose.position[1], sample.pose.position[2]), viewMatrix, projMatrix, viewpoint, tanFov);
+
+		FrameKey key;
+		key.add(viewMatrix).add(projMatrix).add(sizeLimit);
+		stamps.renderBegin = PoseTelemetry::now();
+		if (!idleSkip.skip(key.value()))
+		{
+			CpuSwitching::selectCut(h.nodes, h.boxes, &viewpoint, 1, band, budget, switchingState, cut);
+			idleSkip.maintained(key.value(), true);
+
+			const int N = cut.to_render();
+			ts.resize(N);
+			kids.resize(N);
+			CpuSwitching::getTsIndexed(N, cut.nodes_of_render_indices.data(), sizeLimit, h.nodes, h.boxes, viewpoint, ts.data(), kids.data());
+
+			CpuRasterizer::View view;
+			view.viewmatrix = viewMatrix.data();
+			view.projmatrix = projMatrix.data();
+			view.campos = viewpoint.position;
+			view.tan_fovx = tanFov;
+			view.tan_fovy = tanFov;
+			view.width = kWidth;
+			view.height = kHeight;
+			rendered += rasterizer.forward(splats, N, cut.render_indices.data(), cut.parent_indices.data(), ts.data(), kids.data(),
+				CpuRasterizer::Splats(), 0, 1.0f, view, background, image.data()) > 0;
+		}
+		stamps.renderEnd = PoseTelemetry::now();
+		stamps.presented = stamps.renderEnd;
+		trace.record(stamps);
+	}
+
+	const uint64_t steadyAllocations = _allocations.load() - warmAllocations;
+	if (steadyAllocations)
+		std::cerr << steadyAllocations << " heap allocations after warm-up" << std::endl;
+	CHECK(steadyAllocations == 0);
+	CHECK(rendered > 0);
+	CHECK(trace.samples() == uint64_t(4 * kFramesPerLoop));
+	return checkResult("steady state");
+}
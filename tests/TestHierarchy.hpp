@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2024, Inria
+ * GRAPHDECO research group, https://team.inria.fr/graphdeco
+ * All rights reserved.
+ *
+ * This software is free for non-commercial, research and evaluation use
+ * under the terms of the LICENSE.md file.
+ *
+ * For inquiries contact  george.drettakis@inria.fr
+ */
+
+
+#pragma once
+
+# include <types.h>
+# include <Eigen/Dense>
+# include <random>
+# include <utility>
+# include <vector>
+
+namespace sibr {
+namespace Test {
+
+	struct Hierarchy
+	{
+		std::vector<Node> nodes;
+		std::vector<Box> boxes;
+	};
+
+	inline int gaussianCount(const Node& node)
+	{
+		return node.count_leafs + node.count_merged;
+	}
+
+	/** Random spatial hierarchy: boxes split along their longest axis, nodes in breadth first order. */
+	inline Hierarchy randomHierarchy(int maxDepth, std::mt19937& rng)
+	{
+		Hierarchy h;
+		std::vector<std::pair<Eigen::Vector3f, Eigen::Vector3f>> bounds;
+
+		auto addNode = [&](int parent, int depth, const Eigen::Vector3f& mi, const Eigen::Vector3f& ma) {
+			Node node;
+			node.depth = depth;
+			node.parent = parent;
+			node.start_children = -1;
+			node.count_children = 0;
+			node.count_leafs = 0;
+			node.count_merged = 0;
+			Box box(mi, ma);
+			box.minn.xyz[3] = (ma - mi).norm();
+			h.nodes.push_back(node);
+			h.boxes.push_back(box);
+			bounds.push_back({ mi, ma });
+		};
+
+		addNode(-1, 0, Eigen::Vector3f(0, 0, 0), Eigen::Vector3f(16, 16, 16));
+		for (size_t id = 0; id < h.nodes.size(); id++)
+		{
+			const int depth = h.nodes[id].depth;
+			if (depth >= maxDepth || (depth > 2 && rng() % 4 == 0))
+				continue;
+
+			const Eigen::Vector3f mi = bounds[id].first, ma = bounds[id].second;
+			int axis = 0;
+			for (int a = 1; a < 3; a++)
+				if (ma[a] - mi[a] > ma[axis] - mi[axis])
+					axis = a;
+
+			const int children = 2 + int(rng() % 3);
+			h.nodes[id].start_children = int(h.nodes.size());
+			h.nodes[id].count_children = children;
+			for (int c = 0; c < children; c++)
+			{
+				Eigen::Vector3f cmi = mi, cma = ma;
+				cmi[axis] = mi[axis] + (ma[axis] - mi[axis]) * c / children;
+				cma[axis] = mi[axis] + (ma[axis] - mi[axis]) * (c + 1) / children;
+				addNode(int(id), depth + 1, cmi, cma);
+			}
+		}
+
+		int start = 0;
+		for (Node& node : h.nodes)
+		{
+			if (node.count_children == 0)
+				node.count_leafs = 1 + int(rng() % 3);
+			else
+				node.count_merged = 1;
+			node.start = start;
+			start += gaussianCount(node);
+		}
+		return h;
+	}
+
+}
+}